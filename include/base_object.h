@@ -225,6 +225,13 @@ class BaseObject : public std::enable_shared_from_this<BaseObject>
      */
     inline virtual void setNotUpdated() { _updatedParams = false; }
 
+    /**
+     * \brief Get the number of parameter modifications since the object creation.
+     * Contrary to wasUpdated(), this can be checked by multiple observers.
+     * \return Return the modification count
+     */
+    uint64_t getUpdateCount() const { return _updateCount; }
+
     /**
      * \brief Set the object savability
      * \param savable Desired savability
@@ -360,6 +367,7 @@ class BaseObject : public std::enable_shared_from_this<BaseObject>
 
     std::unordered_map<std::string, AttributeFunctor> _attribFunctions; //!< Map of all attributes
     bool _updatedParams{true};                                          //!< True if the parameters have been updated and the object needs to reflect these changes
+    std::atomic<uint64_t> _updateCount{0};                              //!< Incremented after each parameter modification
 
     std::future<void> _asyncTask{};
     std::mutex _asyncTaskMutex{};
@@ -79,8 +79,9 @@ class Camera : public BaseObject
 
     /**
      * \brief Tessellate the objects for this camera
+     * \param objects If not empty, only tessellate the objects in this list
      */
-    void blendingTessellateForCurrentCamera();
+    void blendingTessellateForCurrentCamera(const std::vector<std::shared_ptr<Object>>& objects = {});
 
     /**
      * \brief Compute the blending for all objects seen by this camera
@@ -92,6 +93,16 @@ class Camera : public BaseObject
      */
     void computeVertexVisibility();
 
+    /**
+     * \brief Compute the vertex visibility and the blending contribution of the given cameras
+     * Cameras are processed in batches of up to Shader::maxCameraLayers: their visibility is rendered in a single pass into the layers
+     * of an array texture, then resolved and converted to blending contributions with one compute dispatch per geometry.
+     * Objects with a blending map get the contributions in texture space instead. This camera holds the shared framebuffer.
+     * \param cameras Cameras to compute the contribution for
+     * \param onlyObjects If not empty, only compute the contribution to the objects in this list
+     */
+    void computeBlendingContributions(const std::vector<std::shared_ptr<Camera>>& cameras, const std::vector<std::shared_ptr<Object>>& onlyObjects = {});
+
     /**
      * \brief Get the projection matrix
      * \return Return the projection matrix
@@ -117,6 +128,24 @@ class Camera : public BaseObject
      */
     void drawModelOnce(const std::string& modelName, const glm::dmat4& rtMatrix);
 
+    /**
+     * \brief Get the parameters of this camera which the blending depends on
+     * \return Return the view and projection matrices, the size and the blending parameters
+     */
+    std::vector<double> getBlendingParameters();
+
+    /**
+     * \brief Get the number of objects culled during the last render
+     * \return Return the culled objects count
+     */
+    int getCulledObjectCount() const { return _culledObjectCount; }
+
+    /**
+     * \brief Get whether the last render has been skipped, as none of its inputs changed
+     * \return Return true if the render was skipped
+     */
+    bool wasRenderSkipped() const { return _renderSkipped; }
+
     /**
      * \brief Get the output texture for this camera
      * \return Return a pointer to the output textures
@@ -158,6 +187,14 @@ class Camera : public BaseObject
      */
     Values pickFragment(float x, float y, float& fragDepth);
 
+    /**
+     * \brief Get the coordinates of the given fragment asynchronously, not to stall the rendering
+     * \param x Target x coordinate
+     * \param y Target y coordinate
+     * \param callback Function called on a later frame with the world coordinates of the fragment and its depth in camera space
+     */
+    void pickFragmentAsync(float x, float y, std::function<void(const Values&, float)> callback);
+
     /**
      * \brief Get the coordinates of the closest calibration point
      * \param x Target x coordinate
@@ -174,11 +211,34 @@ class Camera : public BaseObject
      */
     Values pickVertexOrCalibrationPoint(float x, float y);
 
+    /**
+     * \brief Pick the closest calibration point or vertex asynchronously, not to stall the rendering
+     * \param x Target x coordinate
+     * \param y Target y coordinate
+     * \param callback Function called on a later frame with the closest point or vertex, or an empty Values if none is close enough
+     */
+    void pickVertexOrCalibrationPointAsync(float x, float y, std::function<void(const Values&)> callback);
+
+    /**
+     * \brief Check whether this camera can be rendered in a single pass with the given one
+     * This is the case when both have the same size and output format and see the same textured objects
+     * \param other Other camera
+     * \return Return true if the cameras can be rendered as layers of a single framebuffer
+     */
+    bool isLayerCompatible(const Camera& other) const;
+
     /**
      * \brief Render this camera into its textures
      */
     void render() override;
 
+    /**
+     * \brief Render the given cameras in a single pass, each of them into a layer of a shared framebuffer which is then copied to their output
+     * The cameras must be layer compatible with this one, which holds the shared framebuffer
+     * \param cameras Cameras to render, including this one
+     */
+    void renderLayered(const std::vector<std::shared_ptr<Camera>>& cameras);
+
     /**
      * \brief Set the given calibration point. This point is then selected
      * \return Return true if the point has been added or if it already existed
@@ -232,6 +292,36 @@ class Camera : public BaseObject
     bool _isColorLUTActivated{false};
     glm::mat3 _colorMixMatrix;
 
+    // Uniforms shared by all objects seen by this camera, laid out following std140
+    struct UniformBlock
+    {
+        glm::vec4 wireframeColor{1.f};
+        glm::vec4 attributes{0.f};         //!< Blending width and brightness
+        glm::vec4 fovAndColorBalance{0.f}; //!< Horizontal and vertical FOV, r/g and b/g
+        glm::ivec4 flags{0};               //!< Show camera count and color LUT activation
+        glm::vec4 colorMixMatrix[3]{};     //!< mat3 columns are padded to vec4
+        glm::vec4 colorLUT[256]{};         //!< vec3 array elements are padded to vec4
+    };
+    UniformBlock _uniformBlock{};
+    GLuint _uniformBuffer{0};
+    bool _uniformBufferReady{false};
+
+    // Render skipping and culling
+    std::vector<int64_t> _renderSignature{}; //!< Inputs of the last render, which is skipped if they did not change
+    bool _renderSkipped{false};              //!< True if the last render was skipped
+    int _culledObjectCount{0};               //!< Number of objects culled during the last render
+
+    // Single pass rendering of multiple cameras, used when this camera renders a group of cameras
+    std::unique_ptr<Framebuffer> _layeredFbo{nullptr}; //!< Framebuffer with one layer per camera
+    std::vector<int> _layeredFboParameters{};          //!< Size, layer count and format of the layered framebuffer
+    GLuint _layerReadFbo{0};                           //!< Framebuffer used to copy a single layer
+    GLuint _layersBuffer{0};                           //!< Storage buffer holding the uniforms of each camera
+    std::vector<UniformBlock> _layerBlocks{};
+
+    // Batched visibility computation for the blending
+    std::unique_ptr<Framebuffer> _visibilityFbo{nullptr}; //!< Framebuffer holding the primitive IDs seen by each camera, one per layer
+    std::vector<int> _visibilityFboParameters{};          //!< Size and layer count of the visibility framebuffer
+
     // Some default models use in various situations
     std::list<std::shared_ptr<Mesh>> _modelMeshes;
     std::unordered_map<std::string, std::shared_ptr<Object>> _models;
@@ -300,11 +390,63 @@ class Camera : public BaseObject
      */
     void loadDefaultModels();
 
+    /**
+     * \brief Get the coordinates of the fragment at the given pixel and depth, in world coordinates
+     * \param realX X coordinate, in pixels
+     * \param realY Y coordinate, in pixels
+     * \param depth Depth read from the output framebuffer
+     * \param fragDepth Fragment depth in camera space
+     * \return Return the world coordinates of the fragment, or an empty Values if there is none
+     */
+    Values pickFragmentAtDepth(float realX, float realY, float depth, float& fragDepth);
+
+    /**
+     * \brief Get the coordinates of the vertex closest to the given pixel and depth
+     * \param realX X coordinate, in pixels
+     * \param realY Y coordinate, in pixels
+     * \param depth Depth read from the output framebuffer
+     * \return Return the coordinates of the closest vertex, or an empty Values if there is none
+     */
+    Values pickVertexAtDepth(float realX, float realY, float depth);
+
+    /**
+     * \brief Choose between the given vertex and the closest calibration point
+     * \param x Target x coordinate
+     * \param y Target y coordinate
+     * \param vertex Picked vertex, may be empty
+     * \return Return the closest of the vertex and calibration point, or an empty Values if there is none
+     */
+    Values selectVertexOrCalibrationPoint(float x, float y, const Values& vertex);
+
     /**
      * \brief Send calibration points to the model
      */
     void sendCalibrationPointsToObjects();
 
+    /**
+     * \brief Check whether this camera can be rendered as a layer in a single pass with other cameras
+     * \return Return true if it can be rendered as a layer
+     */
+    bool canRenderLayered() const;
+
+    /**
+     * \brief Apply pending size and format changes to the framebuffers
+     */
+    void updateFramebuffers();
+
+    /**
+     * \brief Update the signature of the inputs of the render, and check whether it changed since the last render
+     * \param uniformsUpdated True if the camera uniforms changed since the last render
+     * \return Return true if the camera needs to be rendered
+     */
+    bool updateRenderSignature(bool uniformsUpdated);
+
+    /**
+     * \brief Update the uniform buffer shared by all objects, and bind it
+     * \return Return true if the content of the buffer changed
+     */
+    bool updateUniformBuffer();
+
     /**
      * \brief Register new functors to modify attributes
      */
@@ -25,13 +25,19 @@
 #ifndef SPLASH_CONTROLLER_BLENDER_H
 #define SPLASH_CONTROLLER_BLENDER_H
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "./controller.h"
 
 namespace Splash
 {
 
+class Object;
+
 class Blender : public ControllerObject
 {
   public:
@@ -57,17 +63,72 @@ class Blender : public ControllerObject
     void forceUpdate() { _blendingComputed = false; }
 
   private:
-    bool _isSceneMaster{false};        //!< True if the root Scene is master
-    std::string _blendingMode{"none"}; //!< Can be "none", "once" or "continuous"
-    bool _computeBlending{false};      //!< If true, compute blending in the next render
-    bool _continuousBlending{false};   //!< If true, render does not reset _computeBlending
-    bool _blendingComputed{false};     //!< True if the blending has been computed
+    bool _isSceneMaster{false};            //!< True if the root Scene is master
+    std::string _blendingMode{"none"};     //!< Can be "none", "once" or "continuous"
+    std::string _blendingMethod{"vertex"}; //!< Can be "vertex" or "texture"
+    int _blendingMapResolution{1024};      //!< Resolution of the blending maps, when blending in texture space
+    bool _computeBlending{false};          //!< If true, compute blending in the next render
+    bool _continuousBlending{false};       //!< If true, render does not reset _computeBlending
+    bool _blendingComputed{false};         //!< True if the blending has been computed
+
+    // State of each camera at the last blending computation, to only update what changed
+    struct CameraBlendingState
+    {
+        std::vector<double> parameters{};   //!< Parameters the blending depends on
+        std::vector<std::string> objects{}; //!< Objects seen by the camera
+    };
+    std::unordered_map<std::string, CameraBlendingState> _cameraBlendingStates{};
+    std::unordered_map<std::string, std::vector<double>> _objectBlendingStates{}; //!< Parameters the blending depends on, for each object seen by a camera
 
     // Vertex blending variables
     std::mutex _vertexBlendingMutex;
     std::condition_variable _vertexBlendingCondition;
     std::atomic_bool _vertexBlendingReceptionStatus{false};
 
+    /**
+     * \brief Get the parameters of an object the blending depends on, namely its model matrix and its sideness
+     * \param object Object
+     * \return Return the parameters
+     */
+    static std::vector<double> getObjectBlendingParameters(const std::shared_ptr<Object>& object);
+
+    /**
+     * \brief Get the path to the blending cache directory
+     * \return Return the path, ending with a slash, or an empty string if the cache is disabled
+     */
+    static const std::string& getBlendingCachePath();
+
+    /**
+     * \brief Hash the given data, to summarize the meshes in the cache key and to check the cache files against filename collisions
+     * \param data Data to hash
+     * \param size Data size
+     * \param hash Hash to continue from
+     * \return Return the hash
+     */
+    static uint64_t hashCacheData(const char* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    /**
+     * \brief Get the key identifying a blending computation in the disk cache, from the meshes, the cameras and the objects
+     * \param objects Objects seen by the cameras
+     * \return Return the key, or an empty string if the cache is disabled or a mesh is not loaded yet
+     */
+    std::string getBlendingCacheKey(const std::vector<std::shared_ptr<Object>>& objects);
+
+    /**
+     * \brief Load the serialized geometries of a previous blending computation from the disk cache
+     * \param key Cache key
+     * \param buffers Serialized geometries, by geometry name
+     * \return Return true if the cache held a valid entry for the key
+     */
+    bool loadBlendingCache(const std::string& key, std::unordered_map<std::string, std::shared_ptr<SerializedObject>>& buffers);
+
+    /**
+     * \brief Save the serialized geometries resulting from the blending computation to the disk cache
+     * \param key Cache key
+     * \param buffers Serialized geometries, along with the geometry names
+     */
+    void saveBlendingCache(const std::string& key, const std::vector<std::pair<std::string, std::shared_ptr<SerializedObject>>>& buffers);
+
     /**
      * \brief Register new functors to modify attributes
      */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @dxt_compressor.h
+ * Real-time DXT compression of uncompressed images, on the CPU
+ */
+
+#ifndef SPLASH_DXT_COMPRESSOR_H
+#define SPLASH_DXT_COMPRESSOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "./imageBuffer.h"
+
+namespace Splash
+{
+
+/*************/
+class DxtCompressor
+{
+  public:
+    enum class Format
+    {
+        RGB_DXT1,
+        RGBA_DXT5,
+        YCoCg_DXT5
+    };
+
+    enum class Quality
+    {
+        Fast, //!< Endpoints are the bounding box of the block colors
+        High  //!< Endpoints are inset and follow the main diagonal of the block colors
+    };
+
+    /**
+     * \brief Get whether an image can be compressed
+     * \param spec Image spec
+     * \return Return true if the image is 8bpc RGB, BGR, RGBA, BGRA, YUYV or UYVY, with a size multiple of 4
+     */
+    static bool isSupported(const ImageBufferSpec& spec);
+
+    /**
+     * \brief Compress an image, the work being split among worker threads
+     * \param input Image to compress
+     * \param output Compressed image, reallocated if needed and stored as the Hap decoder does
+     * \param format Compression format
+     * \param quality Compression quality
+     * \return Return true if the image has been compressed
+     */
+    static bool compress(const ImageBuffer& input, ImageBuffer& output, Format format, Quality quality);
+
+    /**
+     * \brief Get the image format name of a compression format
+     * \param format Compression format
+     * \return Return the format name, as set in the image spec
+     */
+    static std::string getFormatName(Format format);
+
+  private:
+    enum class Layout
+    {
+        Unsupported,
+        RGB,
+        BGR,
+        RGBA,
+        BGRA,
+        YUYV,
+        UYVY
+    };
+
+    using Block = uint8_t[16][4];
+
+    static uint8_t toByte(int value) { return static_cast<uint8_t>(std::min(255, std::max(0, value))); }
+
+    /**
+     * \brief Get the pixel layout of an image
+     * \param spec Image spec
+     * \return Return the layout
+     */
+    static Layout getLayout(const ImageBufferSpec& spec);
+
+    /**
+     * \brief Read a 4x4 block of pixels, converted to RGBA
+     * \param layout Input pixel layout
+     * \param data Input data, starting at the first line of the block row
+     * \param stride Input line size, in bytes
+     * \param blockX Block column
+     * \param block Output block
+     */
+    static void fetchBlock(Layout layout, const uint8_t* data, int stride, int blockX, Block& block);
+
+    /**
+     * \brief Convert a block from RGBA to scaled CoCg_Y, as expected by the YCoCg shaders
+     * \param block Block to convert
+     */
+    static void convertToYCoCg(Block& block);
+
+    /**
+     * \brief Encode the color of a block, as a DXT1 block in four colors mode
+     * \param block Block
+     * \param quality Compression quality
+     * \param output Output, 8 bytes
+     */
+    static void encodeColorBlock(const Block& block, Quality quality, uint8_t* output);
+
+    /**
+     * \brief Encode the alpha of a block, as a DXT5 alpha block
+     * \param block Block
+     * \param output Output, 8 bytes
+     */
+    static void encodeAlphaBlock(const Block& block, uint8_t* output);
+};
+
+} // end of namespace
+
+#endif // SPLASH_DXT_COMPRESSOR_H
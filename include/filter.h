@@ -99,6 +99,12 @@ class Filter : public Texture
      */
     GLuint getTexId() const { return _fbo->getColorTexture()->getTexId(); }
 
+    /**
+     * \brief Get the timestamp of the last modification of the filter output
+     * \return Return the timestamp
+     */
+    int64_t getTimestamp() const override { return _timestamp; }
+
     /**
      * \brief Try to link the given BaseObject to this object
      * \param obj Shared pointer to the (wannabe) child object
@@ -123,6 +129,13 @@ class Filter : public Texture
      */
     void setSavable(bool savable) { _savable = true; }
 
+    /**
+     * \brief Forward the sampled size to the output texture
+     * \param width Width of the sampled area
+     * \param height Height of the sampled area
+     */
+    void setSampledSize(int width, int height) override { _fbo->getColorTexture()->setSampledSize(width, height); }
+
     /**
      * \brief Render the filter
      */
@@ -134,11 +147,15 @@ class Filter : public Texture
     void update() override {}
 
   private:
+    static const size_t _maxFusedFilters{8}; //!< Maximum number of upstream filters fused into a single pass
+
     std::vector<std::weak_ptr<Texture>> _inTextures;
 
     std::unique_ptr<Framebuffer> _fbo{nullptr};
     std::shared_ptr<Object> _screen;
     ImageBufferSpec _outTextureSpec;
+    int64_t _inputTimestamp{0};       //!< Timestamp of the input texture at the last render
+    uint64_t _updateCountAtRender{0}; //!< Update count of the filter at the last render
 
     // Filter parameters
     int _sizeOverride[2]{-1, -1};                            //!< If set to positive values, overrides the size given by input textures
@@ -153,6 +170,11 @@ class Filter : public Texture
     std::string _shaderSource{""};     //!< User defined fragment shader filter
     std::string _shaderSourceFile{""}; //!< User defined fragment shader filter source file
 
+    // Fusion of upstream filters into a single pass
+    std::vector<std::weak_ptr<Filter>> _fusedFilters{}; //!< Upstream filters applied by this filter, from the most upstream one
+    std::shared_ptr<Texture> _fusedInput{nullptr};      //!< Input of the most upstream fused filter, sampled instead of the filter input
+    std::weak_ptr<Filter> _fusedInto{};                 //!< Downstream filter applying this one, in which case this one is not rendered
+
     /**
      * \brief Init function called in constructors
      */
@@ -165,11 +187,30 @@ class Filter : public Texture
      */
     bool setFilterSource(const std::string& source);
 
+    /**
+     * \brief Check whether this filter can be applied by the downstream filter, in the same pass
+     * This is the case for a filter using the default shader with a single input, only consumed by the downstream filter,
+     * and which output does not need to be stored: no color curves, no size override and no automatic black level
+     * \return Return true if the filter can be fused
+     */
+    bool isFusable() const;
+
+    /**
+     * \brief Stop applying the upstream filters, and sample the filter input again
+     */
+    void resetFusion();
+
     /**
      * \brief Setup the output texture
      */
     void setOutput();
 
+    /**
+     * \brief Look for the chain of upstream filters which can be applied by this filter, and update the sampled texture and the shader accordingly
+     * \return Return true if the fused filters changed
+     */
+    bool updateFusedFilters();
+
     /**
      * \brief Updates the shader uniforms according to the textures and images the filter is connected to.
      */
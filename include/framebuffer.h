@@ -25,6 +25,7 @@
 #ifndef SPLASH_FBO_H
 #define SPLASH_FBO_H
 
+#include <functional>
 #include <memory>
 
 #include "./config.h"
@@ -89,6 +90,14 @@ class Framebuffer : public BaseObject
      */
     float getDepthAt(float x, float y);
 
+    /**
+     * \brief Get the depth at the given location asynchronously, without stalling the pipeline. See GlReadback
+     * \param x X position
+     * \param y Y position
+     * \param callback Function called with the depth, on a later frame
+     */
+    void getDepthAtAsync(float x, float y, std::function<void(float)> callback);
+
     /**
      * Get the GL FBO id
      * \return The FBO id
@@ -107,8 +116,9 @@ class Framebuffer : public BaseObject
      * \param sixteenbpc If true, set color depth to 16bpc
      * \param srgb If true, use sRGB color space (overrides 16bpc)
      * \param cubemap True if render to cubemap
+     * \param layers If not null, render to an array texture with this number of layers
      */
-    void setParameters(int multisample, bool sixteenbpc, bool srgb = false, bool cubemap = false);
+    void setParameters(int multisample, bool sixteenbpc, bool srgb = false, bool cubemap = false, int layers = 0);
 
     /**
      * Set whether this FBO should resize automatically
@@ -25,9 +25,12 @@
 #ifndef SPLASH_GEOMETRY_H
 #define SPLASH_GEOMETRY_H
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
 #include <map>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -38,6 +41,7 @@
 #include "./coretypes.h"
 #include "./gpuBuffer.h"
 #include "./mesh.h"
+#include "./texture_image.h"
 
 namespace Splash
 {
@@ -87,6 +91,32 @@ class Geometry : public BufferObject
      */
     void deactivateFeedback();
 
+    /**
+     * \brief Get the bounding box of the geometry, in object space
+     * \param min Minimum corner of the box
+     * \param max Maximum corner of the box
+     * \return Return false if the bounding box is unknown or outdated
+     */
+    bool getBoundingBox(glm::vec3& min, glm::vec3& max) const;
+
+    /**
+     * \brief Get the blending map, holding the blending of the geometry in texture space
+     * \return Return the blending map, or nullptr if blending is not done in texture space
+     */
+    std::shared_ptr<Texture_Image> getBlendingMap() const { return _blendingMap; }
+
+    /**
+     * \brief Get a count of the modifications of the GPU buffers, by compute shaders, feedback or data received from the World
+     * \return Return the modification count
+     */
+    uint64_t getBuffersUpdateCount() const { return _buffersUpdateCount; }
+
+    /**
+     * \brief Get the timestamp of the source mesh, which may differ from the timestamp of the geometry until it is updated
+     * \return Return the mesh timestamp
+     */
+    int64_t getMeshTimestamp() const;
+
     /**
      * \brief Get the number of vertices for this geometry
      * \return Return the vertice count
@@ -99,6 +129,12 @@ class Geometry : public BufferObject
      */
     std::shared_ptr<SerializedObject> serialize() const override;
 
+    /**
+     * \brief Get the geometry as serialized, asynchronously so as not to stall the pipeline. See GlReadback
+     * \param callback Function called with the serialized geometry on a later frame, or with nullptr if the readback failed
+     */
+    void serializeAsync(std::function<void(std::shared_ptr<SerializedObject>)> callback) const;
+
     /**
      * \brief Deserialize the geometry
      * \param obj Serialized object
@@ -106,6 +142,14 @@ class Geometry : public BufferObject
      */
     bool deserialize(const std::shared_ptr<SerializedObject>& obj) override;
 
+    /**
+     * \brief Check that a serialized geometry is consistent with its header
+     * \param data Serialized geometry
+     * \param size Size of the serialized geometry
+     * \return Return true if the sizes of the buffers and of the blending map match the size of the serialized geometry
+     */
+    static bool isSerializedGeometryValid(const char* data, size_t size);
+
     /**
      * \brief Get whether the alternative buffers have been resized during the last feedback call
      * \return Return true if the buffers have been resized
@@ -126,6 +170,12 @@ class Geometry : public BufferObject
      */
     float pickVertex(glm::dvec3 p, glm::dvec3& v);
 
+    /**
+     * \brief Create or resize the blending map, and clear it
+     * \param size Width and height of the map. If null, the map is removed
+     */
+    void resetBlendingMap(int size);
+
     /**
      * \brief Set the mesh for this object
      * \param mesh Mesh
@@ -142,6 +192,12 @@ class Geometry : public BufferObject
      */
     void update() override;
 
+    /**
+     * \brief Copy the last received serialized geometry to the staging buffers, to be called from the texture upload context.
+     * The staged buffers are swapped in by the next call to update()
+     */
+    void uploadSerializedMesh();
+
     /**
      * \brief Activate alternative buffers for draw
      * \param isActive If true, use alternative buffers
@@ -150,7 +206,6 @@ class Geometry : public BufferObject
 
   private:
     mutable std::mutex _mutex;
-    bool _onMasterScene{false};
 
     std::shared_ptr<Mesh> _defaultMesh;
     std::weak_ptr<Mesh> _mesh;
@@ -162,8 +217,25 @@ class Geometry : public BufferObject
     bool _buffersDirty{false};
     bool _buffersResized{false}; // Holds whether the alternative buffers have been resized in the previous feedback
     bool _useAlternativeBuffers{false};
-
-    SerializedObject _serializedMesh{};
+    std::atomic<uint64_t> _buffersUpdateCount{0};
+
+    // Bounding box of the mesh, updated along with the buffers
+    bool _boundingBoxValid{false};
+    glm::vec3 _boundingBoxMin{0.f};
+    glm::vec3 _boundingBoxMax{0.f};
+
+    std::mutex _serializedMeshMutex{};
+    SerializedObject _serializedMesh{}; //!< Last geometry received, waiting to be staged
+    SerializedObject _stagedMesh{};     //!< Geometry held by the staging buffers, read until it is swapped in
+    std::atomic_bool _serializedMeshPending{false}; //!< Set when a serialized geometry has been received and not yet staged
+    std::atomic_bool _serializedMeshStaged{false};  //!< Set when the staging buffers hold a geometry to be swapped in
+    std::vector<std::shared_ptr<GpuBuffer>> _glStagingBuffers{}; //!< Buffers filled from the serialized geometry, in the upload context
+    GLsync _serializedMeshFence{nullptr};
+    int _stagedVerticesNumber{0};
+    int _stagedMapSize{0};
+    bool _stagedMapUploaded{false};
+
+    std::shared_ptr<Texture_Image> _blendingMap{nullptr}; //!< Sum of the contributions of the cameras, and count of the cameras, in texture space
 
     int _verticesNumber{0};
     int _alternativeVerticesNumber{0};
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @gl_readback.h
+ * Asynchronous readback of GPU data, completed on a later frame
+ */
+
+#ifndef SPLASH_GL_READBACK_H
+#define SPLASH_GL_READBACK_H
+
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// clang-format off
+#include <glad/glad.h>
+// clang-format on
+
+namespace Splash
+{
+
+/*************/
+class GlReadback
+{
+  public:
+    using CopyFunction = std::function<void(GLuint)>;
+    using ReadyFunction = std::function<void(const char*, size_t)>;
+
+    /**
+     * \brief Get the singleton
+     * \return Return the GlReadback singleton
+     */
+    static GlReadback& get()
+    {
+        static auto instance = new GlReadback;
+        return *instance;
+    }
+
+    /**
+     * \brief Queue a readback. The copy is issued right away into a readback buffer, guarded by a fence, and the
+     * result is given to the callback by a later call to process(), once the GPU is done with it
+     * \param size Size of the data to read, in bytes
+     * \param copy Function issuing the GL commands which write the data to the readback buffer, given its name
+     * \param ready Function called with the data once available. The pointer is only valid during the call. It is always called,
+     * with a null pointer and a size of 0 if the data could not be read back
+     */
+    void read(size_t size, const CopyFunction& copy, ReadyFunction ready);
+
+    /**
+     * \brief Complete the readbacks which are ready, calling their callbacks. Must be called regularly from a context sharing its objects
+     * with the ones the readbacks have been queued from
+     * \param wait If true, wait for all pending readbacks to complete
+     */
+    void process(bool wait = false);
+
+  private:
+    struct Request
+    {
+        GLuint buffer{0};
+        size_t size{0};
+        GLsync fence{nullptr};
+        ReadyFunction ready{};
+    };
+
+    std::mutex _mutex{};
+    std::vector<Request> _requests{};
+    std::vector<std::pair<GLuint, size_t>> _freeBuffers{}; //!< Readback buffers kept for reuse, with their capacity
+
+    GlReadback() = default;
+    GlReadback(const GlReadback&) = delete;
+    GlReadback& operator=(const GlReadback&) = delete;
+
+    /**
+     * \brief Get a readback buffer of at least the given size
+     * \param size Size in bytes
+     * \return Return the buffer name and its capacity
+     */
+    std::pair<GLuint, size_t> getBuffer(size_t size);
+};
+
+} // end of namespace
+
+#endif // SPLASH_GL_READBACK_H
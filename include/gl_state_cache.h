@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @gl_state_cache.h
+ * Per-context cache of the OpenGL state, filtering redundant state changes
+ */
+
+#ifndef SPLASH_GL_STATE_CACHE_H
+#define SPLASH_GL_STATE_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// clang-format off
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+// clang-format on
+
+namespace Splash
+{
+
+/*************/
+class GlStateCache
+{
+  public:
+    /**
+     * \brief Get the singleton
+     * \return Return the GlStateCache singleton
+     */
+    static GlStateCache& get()
+    {
+        static auto instance = new GlStateCache;
+        return *instance;
+    }
+
+    /**
+     * \brief Get whether redundant state changes are filtered
+     * \return Return true if the cache is enabled
+     */
+    bool isEnabled() const { return _enabled; }
+
+    /**
+     * \brief Enable or disable the filtering of redundant state changes. When disabled, every call is forwarded to OpenGL.
+     * \param enabled If true, enable the cache
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * \brief Mark the state of all contexts as unknown
+     * Must be called after OpenGL state has been modified without going through the cache.
+     */
+    void invalidate() { _generation.fetch_add(1, std::memory_order_acq_rel); }
+
+    /**
+     * \brief Forget the state of a context which is about to be destroyed
+     * \param context Context to forget
+     */
+    void forgetContext(GLFWwindow* context);
+
+    /**
+     * \brief Forget any binding of the given texture in all contexts, to call before deleting it
+     * As textures are shared between contexts, the name may be reused while other contexts still have the deleted texture bound
+     * \param texture Texture name
+     */
+    void forgetTexture(GLuint texture);
+
+    /**
+     * \brief Forget any binding of the given framebuffer in all contexts, to call before deleting it
+     * \param fbo Framebuffer name
+     */
+    void forgetFramebuffer(GLuint fbo);
+
+    /**
+     * \brief Wrappers around the corresponding OpenGL calls
+     */
+    void useProgram(GLuint program);
+    void activeTexture(GLuint unit);
+    void bindTextureUnit(GLuint unit, GLuint texture);
+    void bindFramebuffer(GLenum target, GLuint fbo);
+    void enable(GLenum cap) { setCapability(cap, true); }
+    void disable(GLenum cap) { setCapability(cap, false); }
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    /**
+     * \brief Get the active texture unit, querying OpenGL only if it is not known
+     * \return Return the active texture unit, starting from 0
+     */
+    GLuint getActiveTexture();
+
+    /**
+     * \brief Get the framebuffer bound to the given target, querying OpenGL only if it is not known
+     * \param target GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER
+     * \return Return the framebuffer name
+     */
+    GLuint getFramebuffer(GLenum target);
+
+    /**
+     * \brief Publish the number of calls and of state changes since the last call as the "glCalls" and "glStateChanges" timers, and reset them
+     */
+    void publishCounters();
+
+  private:
+    static const size_t _textureUnitCount{32};
+
+    struct State
+    {
+        uint64_t generation{0};
+        uint64_t textureGeneration{0};
+        uint64_t framebufferGeneration{0};
+        GLint program{-1};
+        GLint activeTexture{-1};
+        std::array<GLint, _textureUnitCount> textures;
+        GLint drawFramebuffer{-1};
+        GLint readFramebuffer{-1};
+        std::array<GLint, 4> viewport;
+        bool viewportKnown{false};
+        std::unordered_map<GLenum, bool> capabilities{};
+
+        void reset(uint64_t gen);
+    };
+
+    std::atomic_bool _enabled{true};
+    std::atomic<uint64_t> _generation{1};
+    std::atomic<uint64_t> _textureGeneration{1};     //!< Incremented when a texture is forgotten, resetting the texture bindings of all contexts
+    std::atomic<uint64_t> _framebufferGeneration{1}; //!< Same for framebuffers
+    std::atomic_ullong _callCount{0};
+    std::atomic_ullong _changeCount{0};
+
+    std::mutex _statesMutex{};
+    std::unordered_map<GLFWwindow*, std::unique_ptr<State>> _states{};
+
+    GlStateCache() = default;
+    GlStateCache(const GlStateCache&) = delete;
+    GlStateCache& operator=(const GlStateCache&) = delete;
+
+    /**
+     * \brief Get the state of the current context
+     * \return Return a pointer to the state, or nullptr if the cache is disabled or no context is current
+     */
+    State* getState();
+
+    /**
+     * \brief Count a call, and whether it resulted in a state change
+     * \param changed True if the call was forwarded to OpenGL
+     */
+    void count(bool changed)
+    {
+        _callCount.fetch_add(1, std::memory_order_relaxed);
+        if (changed)
+            _changeCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Enable or disable a capability
+     * \param cap Capability
+     * \param enabled Desired value
+     */
+    void setCapability(GLenum cap, bool enabled);
+};
+
+} // end of namespace
+
+#endif // SPLASH_GL_STATE_CACHE_H
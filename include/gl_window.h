@@ -32,6 +32,8 @@
 #include <GLFW/glfw3.h>
 // clang-format on
 
+#include "./gl_state_cache.h"
+
 namespace Splash
 {
 
@@ -57,7 +59,10 @@ class GlWindow
     ~GlWindow()
     {
         if (_window != nullptr)
+        {
+            GlStateCache::get().forgetContext(_window);
             glfwDestroyWindow(_window);
+        }
     }
 
     /**
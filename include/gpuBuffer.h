@@ -26,6 +26,7 @@
 #define SPLASH_GPU_BUFFER_H
 
 #include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
 #include <map>
 #include <vector>
@@ -117,6 +118,13 @@ class GpuBuffer
      */
     std::vector<char> getBufferAsVector(size_t vertexNbr = 0);
 
+    /**
+     * \brief Get the content of the buffer asynchronously, without stalling the pipeline. See GlReadback
+     * \param vertexNbr Number of vertices to get, or 0 to get the whole buffer
+     * \param callback Function called with the content of the buffer, on a later frame
+     */
+    void getBufferAsVectorAsync(size_t vertexNbr, std::function<void(std::vector<char>&&)> callback);
+
     /**
      * \brief Get the component size
      * \return Return the component size
@@ -129,6 +137,14 @@ class GpuBuffer
      */
     inline size_t getElementSize() const { return _elementSize; }
 
+    /**
+     * \brief Map the buffer for writing, discarding its content. If the entry count changes, the storage is orphaned and
+     * reallocated, the GL id staying the same so that vertex arrays pointing to the buffer remain valid
+     * \param size Entry count
+     * \return Return a pointer to the mapped memory, or nullptr if mapping failed
+     */
+    void* mapForWriting(size_t size);
+
     /**
      * \brief Resize the GL buffer
      * \param size Entry count
@@ -141,6 +157,12 @@ class GpuBuffer
      */
     void setBufferFromVector(const std::vector<char>& buffer);
 
+    /**
+     * \brief Unmap the buffer, after a call to mapForWriting
+     * \return Return false if the content of the buffer was lost while it was mapped, and has to be written again
+     */
+    bool unmap();
+
   private:
     GLuint _glId{0};
     size_t _size{0};
@@ -25,14 +25,17 @@
 #ifndef SPLASH_IMAGE_H
 #define SPLASH_IMAGE_H
 
+#include <atomic>
 #include <chrono>
 #include <mutex>
+#include <vector>
 
 #include "config.h"
 
 #include "./attribute.h"
 #include "./buffer_object.h"
 #include "./coretypes.h"
+#include "./dxt_compressor.h"
 #include "./imageBuffer.h"
 #include "./root_object.h"
 
@@ -79,6 +82,19 @@ class Image : public BufferObject
      */
     ImageBuffer get() const;
 
+    /**
+     * \brief Get the regions of the current frame which changed since the previous one
+     * \param damage Changed regions
+     * \return Return false if the damage is unknown, the whole image being considered as changed
+     */
+    bool getDamage(std::vector<ImageRegion>& damage) const;
+
+    /**
+     * \brief Get the index of the current frame, incremented each time it is replaced by a new one
+     * \return Return the frame index
+     */
+    int64_t getFrameIndex() const { return _frameIndex; }
+
     /**
      * \brief Get the file path
      * \return Return the file path
@@ -155,6 +171,7 @@ class Image : public BufferObject
     bool _srgb{true};
     bool _benchmark{false};
     bool _worldObject{false};
+    int64_t _frameIndex{0};
 
     void createDefaultImage(); //< Create a default black image
     void createPattern();      //< Create a default pattern
@@ -180,6 +197,39 @@ class Image : public BufferObject
     // Deserialization is done in this buffer, to avoid realloc
     ImageBuffer _bufferDeserialize;
 
+    // Frames sent through the Link only hold the regions which changed since the last full frame of the same stream, so that
+    // each of them can be applied once this full frame has been received, even if the previous ones were dropped. A full
+    // frame is sent every SPLASH_IMAGE_KEYFRAME_INTERVAL frames, or when the changed regions grow too large
+    static std::atomic_int _streamCount;
+    int _streamId{_streamCount.fetch_add(1)};
+    mutable int64_t _lastSerializedFrame{-1};
+    mutable int64_t _lastKeyframe{-1};
+    mutable std::vector<ImageRegion> _damageSinceKeyframe{};
+    int _deserializedStream{-1};
+    int64_t _deserializedKeyframe{-1};
+    int64_t _deserializedFrame{-1};
+
+    // Full frame received the content of each buffer derives from, as a count of the received full frames, or -1 if unknown.
+    // Partial frames are written in place when _bufferDeserialize derives from the last full frame
+    int64_t _receivedKeyframes{0};
+    int64_t _bufferDeserializeKeyframe{-1};
+    int64_t _bufferImageKeyframe{-1};
+    int64_t _imageKeyframe{-1};
+
+    // Optional compression of the incoming frames
+    bool _compress{false};
+    DxtCompressor::Format _compressionFormat{DxtCompressor::Format::RGB_DXT1};
+    DxtCompressor::Quality _compressionQuality{DxtCompressor::Quality::Fast};
+    std::unique_ptr<ImageBuffer> _uncompressedImage{nullptr};
+    std::unique_ptr<ImageBuffer> _compressedImage{nullptr};
+    int64_t _compressionTime{0}; //!< Duration of the last compression, in us
+    bool _compressionWarned{false};
+
+    /**
+     * \brief Compress the last received frame and make it the current image. Frames which can not be compressed are used as is.
+     */
+    void compressImage();
+
     /**
      * Add more media info, to be implemented by derived classes
      */
@@ -28,6 +28,7 @@
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "config.h"
 
@@ -37,6 +38,15 @@
 namespace Splash
 {
 
+/*************/
+struct ImageRegion
+{
+    uint32_t x{0};
+    uint32_t y{0};
+    uint32_t width{0};
+    uint32_t height{0};
+};
+
 /*************/
 class ImageBufferSpec
 {
@@ -143,7 +153,7 @@ class ImageBufferSpec
      * \brief Get image size in bytes
      * \return Return image size
      */
-    int rawSize() const { return pixelBytes() * width * height; }
+    int rawSize() const { return static_cast<int>(static_cast<int64_t>(width) * height * bpp / 8); }
 };
 
 /*************/
@@ -201,9 +211,44 @@ class ImageBuffer
      */
     void setRawBuffer(ResizableArray<char>&& buffer) { _buffer = std::move(buffer); }
 
+    /**
+     * \brief Get the regions which changed since the previous frame of the same source
+     * \param damage Changed regions, empty if nothing changed
+     * \return Return false if the damage is unknown, in which case the whole image has to be considered as changed
+     */
+    bool getDamage(std::vector<ImageRegion>& damage) const;
+
+    /**
+     * \brief Set the regions which changed since the previous frame of the same source
+     * \param damage Changed regions. Past _maxDamageRegions, they are merged into their bounding box
+     */
+    void setDamage(const std::vector<ImageRegion>& damage);
+
+    /**
+     * \brief Mark the whole image as changed, which is the default
+     */
+    void resetDamage();
+
+    /**
+     * \brief Add the damage of a previous frame which has not been consumed, as when a frame is replaced by a newer one
+     * \param previous Previous frame
+     */
+    void mergeDamage(const ImageBuffer& previous);
+
+    /**
+     * \brief Add regions to a list of regions, skipping the ones already covered. Past _maxDamageRegions, they are merged into their bounding box
+     * \param regions Regions to add to
+     * \param added Regions to add
+     */
+    static void mergeRegions(std::vector<ImageRegion>& regions, const std::vector<ImageRegion>& added);
+
   private:
+    static constexpr size_t _maxDamageRegions{64};
+
     ImageBufferSpec _spec{};
     ResizableArray<char> _buffer;
+    bool _hasDamage{false}; //!< If false, the whole image changed
+    std::vector<ImageRegion> _damage{};
 
     /**
      * \brief Initialization
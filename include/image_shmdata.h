@@ -81,6 +81,26 @@ class Image_Shmdata : public Image
     // Hap specific attributes
     std::string _textureFormat{""};
 
+    // Damage detection, comparing a hash of each tile of the frame with the one of the previous frame
+    bool _detectDamage{false};
+    std::vector<uint64_t> _tileHashes{};
+
+    /**
+     * \brief Copy an uncompressed frame to the reader buffer, and set its damage from the tiles which changed
+     * \param data Frame data
+     * \param pixelBytes Bytes per pixel
+     */
+    void copyAndDetectDamage(const void* data, int pixelBytes);
+
+    /**
+     * \brief Hash a range of bytes, continuing from a previous hash
+     * \param data Data to hash
+     * \param size Size in bytes
+     * \param hash Previous hash value
+     * \return Return the new hash value
+     */
+    static uint64_t hashBytes(const char* data, size_t size, uint64_t hash);
+
     /**
      * Compute some LUT (currently only the YCbCr to RGB one)
      */
@@ -25,7 +25,9 @@
 #ifndef SPLASH_MESH_H
 #define SPLASH_MESH_H
 
+#include <array>
 #include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
 #include <memory>
 #include <mutex>
@@ -68,6 +70,31 @@ class Mesh : public BufferObject
      */
     bool operator==(Mesh& otherMesh) const;
 
+    /**
+     * \brief Copy the mesh into arrays laid out as the GPU buffers: vec4 for the vertices, vec2 for the texture coordinates,
+     * vec4 for the normals and the annexe. The annexe is filled with zeros if the mesh has none.
+     * The mesh is locked from the moment it is checked to be complete until the end of the copy, so that the arrays are only requested
+     * once the copy is sure to succeed
+     * \param getArrays Function giving the vertices, texture coordinates, normals and annexe arrays for the given number of vertices,
+     * returning false if they could not be obtained
+     * \return Return false if the mesh is empty or incomplete, or if the arrays could not be obtained
+     */
+    bool copyTo(const std::function<bool(size_t, std::array<float*, 4>&)>& getArrays) const;
+
+    /**
+     * \brief Get the bounding box of the mesh
+     * \param min Minimum corner of the box
+     * \param max Maximum corner of the box
+     * \return Return false if the mesh is empty
+     */
+    bool getBoundingBox(glm::vec3& min, glm::vec3& max) const;
+
+    /**
+     * \brief Get the number of vertices of the mesh
+     * \return Return the vertex count
+     */
+    size_t getVerticesNumber() const;
+
     /**
      * \brief Get a 1D vector of all points of the mesh, in normalized coordinates
      * \return Return a vector representing all points of the mesh
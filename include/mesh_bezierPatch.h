@@ -25,7 +25,9 @@
 #ifndef SPLASH_MESH_BEZIERPATCH_H
 #define SPLASH_MESH_BEZIERPATCH_H
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
 #include <memory>
 #include <mutex>
@@ -67,6 +69,13 @@ class Mesh_BezierPatch : public Mesh
      */
     std::vector<glm::vec2> getControlPoints() const { return _patch.vertices; }
 
+    /**
+     * \brief Get a count of the modifications of the patch, either of its control points or of its resolution.
+     * Unlike the timestamp, it does not change when switching between the bezier mesh and the control points
+     * \return Return the modification count
+     */
+    uint64_t getPatchUpdateCount() const { return _patchUpdateCount; }
+
     /**
      * \brief Select the bezier mesh or the control points as the mesh to output
      * \param control If true, selects the control points
@@ -91,12 +100,18 @@ class Mesh_BezierPatch : public Mesh
     std::mutex _patchMutex{};
 
     bool _patchUpdated{true};
+    std::atomic<uint64_t> _patchUpdateCount{0};
     MeshContainer _bezierControl;
     MeshContainer _bezierMesh;
 
-    std::vector<float> _binomialCoeffsX{};
-    std::vector<float> _binomialCoeffsY{};
-    glm::ivec2 _binomialDimensions{0, 0};
+    static const int _parallelRowThreshold{256}; //!< Below this number of rows, the patch is evaluated in the calling thread
+    static const int _patchThreads{4};
+
+    // Bernstein basis for each sample along each axis, stored sample after sample
+    std::vector<float> _bernsteinX{};
+    std::vector<float> _bernsteinY{};
+    glm::ivec2 _bernsteinDimensions{0, 0};
+    int _bernsteinResolution{0};
 
     // Factorial
     inline int32_t factorial(int32_t i) { return (i == 0 || i == 1) ? 1 : factorial(i - 1) * i; }
@@ -137,6 +152,21 @@ class Mesh_BezierPatch : public Mesh
      */
     void updatePatch();
 
+    /**
+     * \brief Evaluate the Bernstein basis along one axis
+     * \param controlPoints Control point count along the axis
+     * \param resolution Sample count along the axis
+     * \param basis Basis, filled with the weight of each control point for each sample
+     */
+    void updateBernsteinBasis(int controlPoints, int resolution, std::vector<float>& basis);
+
+    /**
+     * \brief Run the given function over ranges of rows, in parallel if there are enough of them
+     * \param rowCount Row count
+     * \param func Function called with the first and past-the-last rows of a range
+     */
+    void runOnRows(int rowCount, const std::function<void(int, int)>& func);
+
     /**
      * \brief Register new functors to modify attributes
      */
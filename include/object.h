@@ -33,6 +33,7 @@
 
 #include "attribute.h"
 #include "coretypes.h"
+#include "framebuffer.h"
 #include "geometry.h"
 #include "gpuBuffer.h"
 #include "shader.h"
@@ -63,8 +64,16 @@ class Object : public BaseObject
 
     /**
      * \brief Activate this object for rendering
+     * \param layered If true, and if the fill mode is "texture" or "primitiveId", render for all the cameras set with setLayeredViewProjectionMatrices at once, one per layer
      */
-    void activate();
+    void activate(bool layered = false);
+
+    /**
+     * \brief Append to the given signature values which change whenever the rendering of this object may change,
+     * i.e. when its parameters, geometries or textures are modified
+     * \param signature Signature to append to
+     */
+    void appendRenderSignature(std::vector<int64_t>& signature) const;
 
     /**
      * \brief Compute the visibility for the mvp specified with setViewProjectionMatrix, for blending purposes
@@ -74,6 +83,27 @@ class Object : public BaseObject
      */
     void computeCameraContribution(glm::dmat4 viewMatrix, glm::dmat4 projectionMatrix, float blendWidth);
 
+    /**
+     * \brief Compute the blending contribution of multiple cameras at once, from the visibility set by transferVisibilityFromLayersToAttr
+     * \param viewMatrices View matrices, one per camera
+     * \param projectionMatrices Projection matrices, one per camera
+     * \param blendWidths Widths of the blending zones, one per camera
+     */
+    void computeCamerasContribution(const std::vector<glm::dmat4>& viewMatrices, const std::vector<glm::dmat4>& projectionMatrices, const std::vector<float>& blendWidths);
+
+    /**
+     * \brief Add the blending contribution of multiple cameras to the blending maps of the geometries, in texture space
+     * The depth of the visibility rendering of the cameras, one per layer, must be bound to texture unit 0
+     * \param viewMatrices View matrices, one per camera
+     * \param projectionMatrices Projection matrices, one per camera
+     * \param blendWidths Widths of the blending zones, one per camera
+     * \param viewportSizes Sizes of the viewports used for the visibility rendering, one per camera
+     */
+    void computeCamerasContributionToMap(const std::vector<glm::dmat4>& viewMatrices,
+        const std::vector<glm::dmat4>& projectionMatrices,
+        const std::vector<float>& blendWidths,
+        const std::vector<glm::vec2>& viewportSizes);
+
     /**
      * \brief Deactivate this object for rendering
      */
@@ -114,6 +144,12 @@ class Object : public BaseObject
      */
     inline std::vector<glm::dvec3>& getCalibrationPoints() { return _calibrationPoints; }
 
+    /**
+     * \brief Get the fill mode
+     * \return Return the fill mode
+     */
+    inline std::string getFill() const { return _fill; }
+
     /**
      * \brief Get the model matrix
      * \return Return the model matrix
@@ -132,6 +168,14 @@ class Object : public BaseObject
      */
     int getVerticesNumber() const;
 
+    /**
+     * \brief Check whether the object may be visible with the given view and projection
+     * \param viewMatrix View matrix
+     * \param projectionMatrix Projection matrix
+     * \return Return false only if the bounding boxes of all the geometries of the object are known, and their union is fully outside the view frustum
+     */
+    bool isInFrustum(const glm::dmat4& viewMatrix, const glm::dmat4& projectionMatrix) const;
+
     /**
      * \brief Try to link the given BaseObject to this object
      * \param obj Shared pointer to the (wannabe) child object
@@ -164,6 +208,18 @@ class Object : public BaseObject
      */
     void removeTexture(const std::shared_ptr<Texture>& texture);
 
+    /**
+     * \brief Get whether the geometries have a blending map, i.e. if blending is done in texture space
+     * \return Return true if a blending map is set
+     */
+    bool hasBlendingMap() const;
+
+    /**
+     * \brief Reset the blending maps of the geometries
+     * \param size Width and height of the maps. If null, the maps are removed and blending is done through tessellation
+     */
+    void resetBlendingMap(int size);
+
     /**
      * \brief Reset tessellation of all linked objects
      */
@@ -186,6 +242,13 @@ class Object : public BaseObject
      */
     void setShader(const std::shared_ptr<Shader>& shader) { _shader = shader; }
 
+    /**
+     * \brief Notify the textures of this object of the size of the area they are sampled into
+     * \param width Width of the sampled area, 0 if unknown
+     * \param height Height of the sampled area, 0 if unknown
+     */
+    void setTexturesSampledSize(int width, int height);
+
     /**
      * \brief Set the view and projection matrices
      * \param mv View matrix
@@ -193,6 +256,14 @@ class Object : public BaseObject
      */
     void setViewProjectionMatrix(const glm::dmat4& mv, const glm::dmat4& mp);
 
+    /**
+     * \brief Set the view and projection matrices of each layer, for layered rendering
+     * \param mvs View matrices
+     * \param mps Projection matrices
+     * \param layerMask Bit mask of the layers this object is rendered to, only used by the "primitiveId" fill mode
+     */
+    void setLayeredViewProjectionMatrices(const std::vector<glm::dmat4>& mvs, const std::vector<glm::dmat4>& mps, int layerMask = -1);
+
     /**
      * \brief Set the model matrix. This overrides the position attribute
      * \param model Model matrix
@@ -219,6 +290,16 @@ class Object : public BaseObject
      */
     void transferVisibilityFromTexToAttr(int width, int height, int primitiveIdShift);
 
+    /**
+     * \brief This transfers the visibility of multiple cameras from the array texture active as GL_TEXTURE0 to the vertices attributes
+     * Each layer holds the primitive IDs seen by one camera, which visibility is stored as a bit mask
+     * \param width Width of the texture
+     * \param height Height of the texture
+     * \param layerCount Number of layers, at most Shader::maxCameraLayers
+     * \param primitiveIdShift Shift for the ID as rendered in the texture
+     */
+    void transferVisibilityFromLayersToAttr(int width, int height, int layerCount, int primitiveIdShift);
+
   private:
     mutable std::mutex _mutex;
 
@@ -227,7 +308,14 @@ class Object : public BaseObject
     std::shared_ptr<Shader> _computeShaderResetBlendingAttributes{};
     std::shared_ptr<Shader> _computeShaderComputeBlending{};
     std::shared_ptr<Shader> _computeShaderTransferVisibilityToAttr{};
+    std::shared_ptr<Shader> _computeShaderComputeCamerasBlending{};
+    std::shared_ptr<Shader> _computeShaderTransferVisibilityLayersToAttr{};
+    std::shared_ptr<Shader> _computeShaderComputeCamerasBlendingMap{};
     std::shared_ptr<Shader> _feedbackShaderSubdivideCamera{};
+    std::shared_ptr<Shader> _blendingPositionShader{};        //!< Renders the surface position in texture space
+    std::unique_ptr<Framebuffer> _blendingPositionFbo{nullptr}; //!< Holds the surface position in texture space
+    std::shared_ptr<Shader> _blendingNormalShader{};            //!< Renders the surface normal in texture space
+    std::unique_ptr<Framebuffer> _blendingNormalFbo{nullptr};   //!< Holds the surface normal in texture space
 
     // A map for previously used graphics shaders
     std::map<std::string, std::shared_ptr<Shader>> _graphicsShaders;
@@ -236,6 +324,7 @@ class Object : public BaseObject
     std::vector<std::shared_ptr<Geometry>> _geometries;
 
     bool _vertexBlendingActive{false};
+    bool _textureBlendingActive{false};
 
     glm::dvec3 _position{0.0, 0.0, 0.0};
     glm::dvec3 _rotation{0.0, 0.0, 0.0};
@@ -247,6 +336,7 @@ class Object : public BaseObject
     int _sideness{0};
     glm::dvec4 _color{0.0, 1.0, 0.0, 1.0};
     float _normalExponent{0.0};
+    int _atlasLayer{0}; //!< Layer to sample from, when the first texture is a texture atlas
 
     // A copy of all the cameras' calibration points,
     // for display purposes. These are not saved
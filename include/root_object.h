@@ -163,6 +163,7 @@ class RootObject : public BaseObject
     mutable std::recursive_mutex _objectsMutex{};                            //!< Used in registration and unregistration of objects
     std::atomic_bool _objectsCurrentlyUpdated{false};                        //!< Prevents modification of objects from multiple places at the same time
     std::unordered_map<std::string, std::shared_ptr<BaseObject>> _objects{}; //!< Map of all the objects
+    std::atomic_bool _objectsListUpdated{true};                              //!< Set whenever objects are added, removed, renamed or linked
 
     /**
      * \brief Wait for a BufferObject update. This does not prevent spurious wakeups.
@@ -45,9 +45,13 @@
 namespace Splash
 {
 
+class Camera;
 class ControllerObject;
+class Geometry;
 class Gui;
 class Scene;
+class Texture;
+class Window;
 
 /*************/
 //! Scene class, which does the rendering on a given GPU
@@ -251,6 +255,7 @@ class Scene : public RootObject
     bool _isInitialized{false};
     bool _status{false};  //!< Set to true if an error occured during rendering
     int _swapInterval{1}; //!< Global value for the swap interval, default for all windows
+    bool _layeredCameras{false}; //!< If true, cameras seeing the same objects are rendered in a single pass
     unsigned long long _targetFrameDuration{0}; //!< Duration in microseconds of a frame at the refresh rate of the
                                                 //!< primary monitor
 
@@ -269,6 +274,20 @@ class Scene : public RootObject
 
     static std::vector<std::string> _ghostableTypes;
 
+    // Render graph, cached between frames and rebuilt when the objects list or the priorities change
+    struct RenderGroup
+    {
+        Priority priority{Priority::NO_RENDER};
+        std::string type{}; //!< Type of the first object, used as the timer name
+        std::vector<std::weak_ptr<BaseObject>> objects{};
+    };
+    std::vector<std::weak_ptr<BaseObject>> _renderGraphObjects{}; //!< All objects, to run their tasks
+    std::vector<RenderGroup> _renderGraph{};                       //!< Rendered objects, sorted by priority
+    std::vector<std::weak_ptr<Window>> _renderGraphWindows{};
+    std::mutex _renderGraphTexturesMutex{};
+    std::vector<std::weak_ptr<Texture>> _renderGraphTextures{};     //!< Read by the texture upload loop
+    std::vector<std::weak_ptr<Geometry>> _renderGraphGeometries{}; //!< Read by the texture upload loop, to stage received geometries
+
     /**
      * \brief Find which OpenGL version is available (from a predefined list)
      * \return Return MAJOR and MINOR
@@ -314,6 +333,17 @@ class Scene : public RootObject
      */
     void textureUploadRun();
 
+    /**
+     * \brief Render the given cameras, rendering the compatible ones in a single pass as layers of a shared framebuffer
+     * \param cameras Cameras to render
+     */
+    void renderLayeredCameras(const std::vector<std::shared_ptr<Camera>>& cameras);
+
+    /**
+     * \brief Rebuild the render graph if the objects list has been updated. Objects should be locked.
+     */
+    void updateRenderGraph();
+
     /**
      * \brief Register new attributes
      */
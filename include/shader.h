@@ -28,6 +28,7 @@
 #include <atomic>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -68,16 +69,32 @@ class Shader : public BaseObject
         inverted
     };
 
+    enum UniformBlockBinding
+    {
+        bufferBlockBinding = 1, //!< Used by the uniform blocks owned by the shader
+        cameraBlockBinding      //!< Used by the CameraUniforms block, filled by the cameras
+    };
+
+    enum StorageBlockBinding
+    {
+        cameraLayersBinding = 4 //!< Used by the CameraLayers block, filled by the cameras rendered in a single pass. Lower bindings are used by compute shaders
+    };
+
+    static constexpr int maxCameraLayers{8}; //!< Maximum number of cameras rendered in a single pass
+
     enum Fill
     {
         texture = 0,
+        texture_layered,
         texture_rect,
         object_cubemap,
         cubemap_projection,
         color,
         filter,
         primitiveId,
+        primitiveId_layered,
         uv,
+        uvPosition,
         userDefined,
         warp,
         warpControl,
@@ -116,8 +133,9 @@ class Shader : public BaseObject
      * \brief Launch the compute shader, if present
      * \param numGroupsX Compute group count along X
      * \param numGroupsY Compute group count along Y
+     * \param numGroupsZ Compute group count along Z
      */
-    void doCompute(GLuint numGroupsX = 1, GLuint numGroupsY = 1);
+    void doCompute(GLuint numGroupsX = 1, GLuint numGroupsY = 1, GLuint numGroupsZ = 1);
 
     /**
      * \brief Set the sideness of the object
@@ -181,6 +199,14 @@ class Shader : public BaseObject
      */
     void setModelViewProjectionMatrix(const glm::dmat4& mv, const glm::dmat4& mp);
 
+    /**
+     * \brief Set the model view and projection matrices of each layer, for layered rendering
+     * \param mvs View matrices
+     * \param mps Projection matrices
+     * \param layerMask Bit mask of the layers to render to, if supported by the shader
+     */
+    void setLayeredModelViewProjectionMatrices(const std::vector<glm::dmat4>& mvs, const std::vector<glm::dmat4>& mps, int layerMask = -1);
+
     /**
      * \brief Set the currently queued uniforms updates
      */
@@ -193,6 +219,8 @@ class Shader : public BaseObject
 
     std::unordered_map<int, GLuint> _shaders;
     std::unordered_map<int, std::string> _shadersSource;
+    std::set<int> _shadersToCompile{}; //!< Shaders which compilation is deferred to the link step
+    std::vector<std::string> _feedbackVaryings{};
     GLuint _program{0};
     bool _isLinked = {false};
 
@@ -202,6 +230,7 @@ class Shader : public BaseObject
         Values values{};
         GLint glIndex{-1};
         GLuint glBuffer{0};
+        GLuint glBinding{bufferBlockBinding};
         bool glBufferReady{false};
     };
     std::map<std::string, Uniform> _uniforms;
@@ -222,16 +251,63 @@ class Shader : public BaseObject
     void compileProgram();
 
     /**
-     * \brief Link the shader program
+     * \brief Compile the stored source for the given shader type
+     * \param type Shader type
+     * \return Return true if the shader was compiled successfully
+     */
+    bool compileShader(const ShaderType type);
+
+    /**
+     * \brief Link the shader program, or load it from the program binary cache if available
      */
     bool linkProgram();
 
+    /**
+     * \brief Get the key identifying the current program in the binary cache
+     * \return Return the key, or an empty string if the cache is disabled
+     */
+    std::string getProgramCacheKey() const;
+
+    /**
+     * \brief Get the path to the program binary cache, creating it if needed.
+     * It is set by the SPLASH_SHADER_CACHE environment variable, and defaults to ~/.cache/splash/shaders
+     * \return Return the path, or an empty string if the cache is disabled
+     */
+    static const std::string& getProgramCachePath();
+
+    /**
+     * \brief Hash a program cache key, used to check the cache files content
+     * \param key Program cache key
+     * \return Return the hash
+     */
+    static uint64_t hashProgramCacheKey(const std::string& key);
+
+    /**
+     * \brief Load the program binary matching the given key from the cache
+     * \param key Program cache key
+     * \return Return true if the program has been loaded and accepted by the driver
+     */
+    bool loadProgramBinary(const std::string& key);
+
+    /**
+     * \brief Save the binary of the linked program to the cache
+     * \param key Program cache key
+     */
+    void saveProgramBinary(const std::string& key);
+
     /**
      * \brief Parses the shader to replace includes by the corresponding sources
      * \param src Shader source
      */
     void parseIncludes(std::string& src);
 
+    /**
+     * \brief Parse and store a shader source, its compilation being deferred to the link step
+     * \param src Shader string
+     * \param type Shader type
+     */
+    void storeSource(const std::string& src, const ShaderType type);
+
     /**
      * \brief Parses the shader to find uniforms
      */
@@ -58,6 +58,38 @@ struct ShaderSources
             }
         )"},
         //
+        // Uniforms shared by all objects rendered by a camera. Filled and bound by the Camera
+        {"cameraUniforms", R"(
+            layout(std140) uniform CameraUniforms
+            {
+                vec4 _wireframeColor;
+                vec4 _cameraAttributes; // blendWidth and brightness
+                vec4 _fovAndColorBalance; // fovX and fovY, r/g and b/g
+                ivec4 _cameraFlags; // showCameraCount and isColorLUT
+                mat3 _colorMixMatrix;
+                vec3 _colorLUT[256];
+            };
+        )"},
+        //
+        // Uniforms of the cameras rendered in a single pass, one per layer. Same layout as CameraUniforms,
+        // filled and bound by the Camera. The binding must match Shader::cameraLayersBinding
+        {"cameraLayers", R"(
+            struct CameraLayer
+            {
+                vec4 wireframeColor;
+                vec4 attributes; // blendWidth and brightness
+                vec4 fovAndColorBalance; // fovX and fovY, r/g and b/g
+                ivec4 flags; // showCameraCount and isColorLUT
+                mat3 colorMixMatrix;
+                vec3 colorLUT[256];
+            };
+
+            layout(std430, binding = 4) readonly buffer CameraLayers
+            {
+                CameraLayer _cameraLayers[];
+            };
+        )"},
+        //
         // Compute a normal vector from three points
         {"normalVector", R"(
             uniform int _sideness;
@@ -307,6 +339,49 @@ struct ShaderSources
         }
     )"};
 
+    /**
+     * Compute shader to transfer the visibility of multiple cameras, rendered in the layers of GL_TEXTURE0, to the vertices attributes
+     */
+    const std::string COMPUTE_SHADER_TRANSFER_VISIBILITY_LAYERS_TO_ATTR{R"(
+        #extension GL_ARB_compute_shader : enable
+        #extension GL_ARB_shader_storage_buffer_object : enable
+
+        layout(local_size_x = 32, local_size_y = 32) in;
+
+        layout(binding = 0) uniform sampler2DArray imgVisibility;
+        layout(std430, binding = 3) buffer annexeBuffer
+        {
+            uint annexe[]; // Accessed as integers to set the visibility bits atomically, four per vertex
+        };
+
+        uniform vec2 _texSize;
+        uniform int _idShift = 0;
+        uniform int _primitiveNbr = 0;
+
+        void main(void)
+        {
+            ivec3 pixCoords = ivec3(gl_GlobalInvocationID);
+            if (any(greaterThanEqual(vec2(pixCoords.xy), _texSize)))
+                return;
+
+            // Pixels not covered by any primitive are left transparent
+            vec4 texel = texelFetch(imgVisibility, pixCoords, 0);
+            if (texel.a == 0.0)
+                return;
+
+            ivec4 visibility = ivec4(round(texel * 255.0));
+            int primitiveID = visibility.r * 65025 + visibility.g * 255 + visibility.b - _idShift;
+            if (primitiveID < 0 || primitiveID >= _primitiveNbr)
+                return;
+
+            // The cameras seeing the primitive are stored as bits of the mantissa of 1.0,
+            // so that the z coordinate stays a non null float for visible primitives
+            uint cameraBit = floatBitsToUint(1.0) | (1u << uint(pixCoords.z));
+            for (int idx = primitiveID * 3; idx < primitiveID * 3 + 3; ++idx)
+                atomicOr(annexe[idx * 4 + 2], cameraBit);
+        }
+    )"};
+
     /**
      * Compute shader to compute the contribution of a specific camera
      */
@@ -375,6 +450,268 @@ struct ShaderSources
         }
     )"};
 
+    /**
+     * Compute shader to compute the contribution of multiple cameras at once, from the visibility set by COMPUTE_SHADER_TRANSFER_VISIBILITY_LAYERS_TO_ATTR
+     */
+    const std::string COMPUTE_SHADER_COMPUTE_CAMERAS_CONTRIBUTION{R"(
+        #extension GL_ARB_compute_shader : enable
+        #extension GL_ARB_shader_storage_buffer_object : enable
+
+        #include getSmoothBlendFromVertex
+        #include normalVector
+        #include projectAndCheckVisibility
+
+        layout(local_size_x = 128) in;
+
+        layout (std430, binding = 0) buffer vertexBuffer
+        {
+            vec4 vertex[];
+        };
+
+        layout (std430, binding = 3) buffer annexeBuffer
+        {
+            vec4 annexe[];
+        };
+
+        uniform int _vertexNbr;
+        uniform int _cameraCount = 0;
+        uniform vec4 _mvps[MAX_CAMERA_LAYERS * 4]; // Columns of the mvp matrix of each camera
+        uniform float _blendWidths[MAX_CAMERA_LAYERS];
+
+        void main(void)
+        {
+            int globalID = int(gl_GlobalInvocationID.x);
+            if (globalID >= _vertexNbr / 3)
+                return;
+
+            // Bits of the mantissa of the z coordinate are set for each camera seeing the primitive
+            uint visibility = floatBitsToUint(annexe[globalID * 3].z) & 0x7FFFFFu;
+            vec2 contribution[3] = vec2[3](vec2(0.0), vec2(0.0), vec2(0.0));
+
+            for (int camera = 0; camera < _cameraCount; ++camera)
+            {
+                if ((visibility & (1u << uint(camera))) == 0u)
+                    continue;
+
+                mat4 mvp = mat4(_mvps[camera * 4], _mvps[camera * 4 + 1], _mvps[camera * 4 + 2], _mvps[camera * 4 + 3]);
+                vec4 screenVertex[3];
+                bvec3 vertexVisible;
+                for (int idx = 0; idx < 3; ++idx)
+                {
+                    vec2 distToCenter;
+                    vec4 normalizedSpaceVertex = vertex[globalID * 3 + idx];
+                    vertexVisible[idx] = projectAndCheckVisibility(normalizedSpaceVertex, mvp, 0.005, distToCenter);
+                    screenVertex[idx] = normalizedSpaceVertex;
+                }
+
+                vec3 projectedNormal = normalVector(screenVertex[0].xyz, screenVertex[1].xyz, screenVertex[2].xyz);
+                if (all(vertexVisible) && projectedNormal.z >= 0.0)
+                {
+                    for (int idx = 0; idx < 3; ++idx)
+                        contribution[idx] += vec2(1.0, getSmoothBlendFromVertex(screenVertex[idx], _blendWidths[camera]));
+                }
+            }
+
+            for (int idx = 0; idx < 3; ++idx)
+            {
+                int vertexId = globalID * 3 + idx;
+                annexe[vertexId].xy += contribution[idx];
+                annexe[vertexId].z = visibility != 0u ? 1.0 : 0.0;
+            }
+        }
+    )"};
+
+    /**
+     * Compute shader to add the contribution of multiple cameras to a blending map, from the surface position and normal rendered in texture space
+     * and the depth of the visibility rendering of each camera
+     */
+    const std::string COMPUTE_SHADER_COMPUTE_CAMERAS_CONTRIBUTION_TO_MAP{R"(
+        #extension GL_ARB_compute_shader : enable
+        #extension GL_ARB_shader_image_load_store : enable
+
+        #include getSmoothBlendFromVertex
+        #include normalVector
+
+        layout(local_size_x = 32, local_size_y = 32) in;
+
+        layout(binding = 0) uniform sampler2DArray imgVisibilityDepth;
+        layout(binding = 1) uniform sampler2D imgPosition;
+        layout(binding = 2) uniform sampler2D imgNormal;
+        layout(rg32f, binding = 0) uniform image2D imgBlending; // Holds the blending sum and the camera count
+
+        uniform vec3 _boundingBoxMin = vec3(0.0);
+        uniform vec3 _boundingBoxSize = vec3(1.0);
+        uniform int _cameraCount = 0;
+        uniform vec4 _mvps[MAX_CAMERA_LAYERS * 4]; // Columns of the mvp matrix of each camera
+        uniform float _blendWidths[MAX_CAMERA_LAYERS];
+        uniform vec2 _viewportSizes[MAX_CAMERA_LAYERS];
+        uniform float _depthBias = 0.0005;
+
+        void main(void)
+        {
+            ivec2 texCoords = ivec2(gl_GlobalInvocationID.xy);
+            ivec2 mapSize = imageSize(imgBlending);
+            if (any(greaterThanEqual(texCoords, mapSize)))
+                return;
+
+            // Texels not covered by the surface take the position of a covered neighbour, so that
+            // filtering along the edges of the texture islands does not fetch empty texels
+            ivec2 surfaceCoords = texCoords;
+            vec4 position = texelFetch(imgPosition, surfaceCoords, 0);
+            for (int i = 0; i < 9 && position.a == 0.0; ++i)
+            {
+                surfaceCoords = clamp(texCoords + ivec2(i % 3 - 1, i / 3 - 1), ivec2(0), mapSize - 1);
+                position = texelFetch(imgPosition, surfaceCoords, 0);
+            }
+            if (position.a == 0.0)
+                return;
+
+            vec4 vertex = vec4(_boundingBoxMin + position.xyz * _boundingBoxSize, 1.0);
+            vec2 blending = imageLoad(imgBlending, texCoords).rg;
+
+            // The texel is turned into a small triangle with the orientation of the surface, to test its facing the same way as vertex blending
+            vec4 normal = texelFetch(imgNormal, surfaceCoords, 0);
+            bool hasNormal = normal.a != 0.0;
+            vec3 surfaceNormal = normal.xyz * 2.0 - 1.0;
+            vec3 tangent = normalize(cross(surfaceNormal, abs(surfaceNormal.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0)));
+            float tangentLength = 0.001 * length(_boundingBoxSize);
+            vec4 tangentVertices[2] = vec4[2](vertex + vec4(tangent * tangentLength, 0.0), vertex + vec4(cross(surfaceNormal, tangent) * tangentLength, 0.0));
+
+            for (int camera = 0; camera < _cameraCount; ++camera)
+            {
+                mat4 mvp = mat4(_mvps[camera * 4], _mvps[camera * 4 + 1], _mvps[camera * 4 + 2], _mvps[camera * 4 + 3]);
+                vec4 projected = mvp * vertex;
+                if (projected.w <= 0.0)
+                    continue;
+                projected /= projected.w;
+                if (any(greaterThan(abs(projected.xyz), vec3(1.0))))
+                    continue;
+
+                if (hasNormal)
+                {
+                    vec4 projectedTangents[2] = vec4[2](mvp * tangentVertices[0], mvp * tangentVertices[1]);
+                    vec3 projectedNormal = normalVector(projected.xyz, projectedTangents[0].xyz / projectedTangents[0].w, projectedTangents[1].xyz / projectedTangents[1].w);
+                    if (projectedNormal.z < 0.0)
+                        continue;
+                }
+
+                // The texel is seen by the camera if it is not behind the nearest surface rendered around its projection
+                ivec2 pixel = ivec2((projected.xy * 0.5 + 0.5) * _viewportSizes[camera]);
+                ivec2 maxPixel = ivec2(_viewportSizes[camera]) - 1;
+                float visibleDepth = 0.0;
+                for (int i = 0; i < 9; ++i)
+                    visibleDepth = max(visibleDepth, texelFetch(imgVisibilityDepth, ivec3(clamp(pixel + ivec2(i % 3 - 1, i / 3 - 1), ivec2(0), maxPixel), camera), 0).r);
+                if (projected.z * 0.5 + 0.5 > visibleDepth + _depthBias)
+                    continue;
+
+                blending += vec2(getSmoothBlendFromVertex(projected, _blendWidths[camera]), 1.0);
+            }
+
+            imageStore(imgBlending, texCoords, vec4(blending, 0.0, 0.0));
+        }
+    )"};
+
+    /**
+     * Compute shader converting GL_TEXTURE0 to planar YUV (YUV420 or YUV422 must be defined), resized to _outputSize, into a shader storage buffer.
+     * Each invocation converts a block of 8x2 pixels, so that all the writes are whole words. _outputSize must be a multiple of this block size
+     */
+    const std::string COMPUTE_SHADER_YUV_CONVERSION{R"(
+        #extension GL_ARB_compute_shader : enable
+        #extension GL_ARB_shader_storage_buffer_object : enable
+
+        layout(local_size_x = 8, local_size_y = 8) in;
+
+        layout(binding = 0) uniform sampler2D imgInput;
+        layout(std430, binding = 0) buffer planesBuffer
+        {
+            uint planes[];
+        };
+
+        uniform ivec2 _outputSize;
+        uniform int _srgb = 0;
+
+        // BT.601, limited range, as expected by most encoders
+        vec3 rgbToYuv(vec3 rgb)
+        {
+            return vec3(dot(vec3(0.257, 0.504, 0.098), rgb) + 16.0 / 255.0,
+                        dot(vec3(-0.148, -0.291, 0.439), rgb) + 128.0 / 255.0,
+                        dot(vec3(0.439, -0.368, -0.071), rgb) + 128.0 / 255.0);
+        }
+
+        vec3 linearToSrgb(vec3 color)
+        {
+            return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), color));
+        }
+
+        // Four bilinear taps over the footprint of the output pixel, to limit aliasing when downscaling
+        vec3 samplePixel(ivec2 pixel)
+        {
+            vec2 footprint = 1.0 / vec2(_outputSize);
+            vec2 center = (vec2(pixel) + 0.5) * footprint;
+            vec3 color = vec3(0.0);
+            for (int i = 0; i < 4; ++i)
+                color += texture(imgInput, center + (vec2(i % 2, i / 2) - 0.5) * footprint * 0.5).rgb;
+            color *= 0.25;
+
+            if (_srgb != 0)
+                color = linearToSrgb(color);
+            return rgbToYuv(clamp(color, 0.0, 1.0));
+        }
+
+        uint packBytes(vec4 values)
+        {
+            uvec4 bytes = uvec4(round(clamp(values, 0.0, 1.0) * 255.0));
+            return bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24);
+        }
+
+        void main(void)
+        {
+            ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+            if (any(greaterThanEqual(block, _outputSize / ivec2(8, 2))))
+                return;
+
+            vec3 yuv[16];
+            for (int i = 0; i < 16; ++i)
+                yuv[i] = samplePixel(block * ivec2(8, 2) + ivec2(i % 8, i / 8));
+
+            int width = _outputSize.x;
+            int height = _outputSize.y;
+            for (int y = 0; y < 2; ++y)
+            {
+                int wordIndex = ((block.y * 2 + y) * width + block.x * 8) / 4;
+                for (int w = 0; w < 2; ++w)
+                {
+                    int i = y * 8 + w * 4;
+                    planes[wordIndex + w] = packBytes(vec4(yuv[i].x, yuv[i + 1].x, yuv[i + 2].x, yuv[i + 3].x));
+                }
+            }
+
+            int chromaWidth = width / 2;
+#if defined(YUV420)
+            int chromaSize = chromaWidth * height / 2;
+            vec2 chroma[4];
+            for (int c = 0; c < 4; ++c)
+                chroma[c] = (yuv[c * 2].yz + yuv[c * 2 + 1].yz + yuv[c * 2 + 8].yz + yuv[c * 2 + 9].yz) * 0.25;
+
+            int chromaIndex = block.y * chromaWidth + block.x * 4;
+            planes[(width * height + chromaIndex) / 4] = packBytes(vec4(chroma[0].x, chroma[1].x, chroma[2].x, chroma[3].x));
+            planes[(width * height + chromaSize + chromaIndex) / 4] = packBytes(vec4(chroma[0].y, chroma[1].y, chroma[2].y, chroma[3].y));
+#else
+            int chromaSize = chromaWidth * height;
+            for (int y = 0; y < 2; ++y)
+            {
+                vec2 chroma[4];
+                for (int c = 0; c < 4; ++c)
+                    chroma[c] = (yuv[y * 8 + c * 2].yz + yuv[y * 8 + c * 2 + 1].yz) * 0.5;
+
+                int chromaIndex = (block.y * 2 + y) * chromaWidth + block.x * 4;
+                planes[(width * height + chromaIndex) / 4] = packBytes(vec4(chroma[0].x, chroma[1].x, chroma[2].x, chroma[3].x));
+                planes[(width * height + chromaSize + chromaIndex) / 4] = packBytes(vec4(chroma[0].y, chroma[1].y, chroma[2].y, chroma[3].y));
+            }
+#endif
+        }
+    )"};
+
     /**************************/
     // FEEDBACK
     /**************************/
@@ -774,14 +1111,68 @@ struct ShaderSources
         void main(void)
         {
             vertexOut.position = vec4(_vertex.xyz, 1.0);
+        #ifdef LAYERED
+            // Projection is done for each layer by the geometry shader
+            vertexOut.normal = _normal;
+        #else
             vertexOut.position = _modelViewProjectionMatrix * vertexOut.position;
-            gl_Position = vertexOut.position;
             vertexOut.normal = normalize(_normalMatrix * _normal);
+        #endif
+            gl_Position = vertexOut.position;
             vertexOut.texCoord = _texcoord;
             vertexOut.annexe = _annexe;
         }
     )"};
 
+    /**
+     * Default geometry shader for rendering into multiple layers, each with its own projection and viewport
+     */
+    const std::string GEOMETRY_SHADER_DEFAULT_LAYERED{R"(
+        layout(triangles, invocations = MAX_CAMERA_LAYERS) in;
+        layout(triangle_strip, max_vertices = 3) out;
+
+        uniform int _layerCount = 0;
+        uniform int _layerMask = -1;
+        uniform mat4 _layerModelViewProjectionMatrix[MAX_CAMERA_LAYERS];
+        uniform mat4 _layerNormalMatrix[MAX_CAMERA_LAYERS];
+
+        in VertexData
+        {
+            vec4 position;
+            vec2 texCoord;
+            vec4 normal;
+            vec4 annexe;
+        } vertexIn[];
+
+        out VertexData
+        {
+            vec4 position;
+            vec2 texCoord;
+            vec4 normal;
+            vec4 annexe;
+        } vertexOut;
+
+        void main()
+        {
+            int layer = gl_InvocationID;
+            if (layer >= _layerCount || (_layerMask & (1 << layer)) == 0)
+                return;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                gl_Layer = layer;
+                gl_ViewportIndex = layer;
+                vertexOut.position = _layerModelViewProjectionMatrix[layer] * vertexIn[i].position;
+                gl_Position = vertexOut.position;
+                vertexOut.normal = normalize(_layerNormalMatrix[layer] * vertexIn[i].normal);
+                vertexOut.texCoord = vertexIn[i].texCoord;
+                vertexOut.annexe = vertexIn[i].annexe;
+                EmitVertex();
+            }
+            EndPrimitive();
+        }
+    )"};
+
     /**
      * Filter vertex shader
      */
@@ -835,6 +1226,16 @@ struct ShaderSources
         uniform int _invertChannels = 0;
         uniform vec2 _colorBalance = vec2(1.f, 1.f);
 
+    #ifdef FUSED_FILTER_COUNT
+        // Parameters of the upstream filters fused into this one, set by Filter::updateUniforms
+        uniform float _fusedBlackLevel[FUSED_FILTER_COUNT];
+        uniform float _fusedBrightness[FUSED_FILTER_COUNT];
+        uniform float _fusedContrast[FUSED_FILTER_COUNT];
+        uniform float _fusedSaturation[FUSED_FILTER_COUNT];
+        uniform int _fusedInvertChannels[FUSED_FILTER_COUNT];
+        uniform vec2 _fusedColorBalance[FUSED_FILTER_COUNT];
+    #endif
+
     #ifdef COLOR_CURVE_COUNT
         // This is set if Filter::_colorCurves is not empty, by Filter::updateShaderParameters
         uniform vec3 _colorCurves[COLOR_CURVE_COUNT];
@@ -857,6 +1258,41 @@ struct ShaderSources
             return float(factorial(n) / (factorial(i) * factorial(n - i)));
         }
 
+        vec4 correctColor(vec4 color, int invertChannels, vec2 colorBalance, float brightness, float saturation, float contrast, float blackLevel)
+        {
+            // Invert channels
+            if (invertChannels == 1)
+                color.rgb = color.bgr;
+
+            // Color balance
+            float maxBalanceRatio = max(colorBalance.r, colorBalance.g);
+            color.r *= colorBalance.r / maxBalanceRatio;
+            color.g *= 1.0 / maxBalanceRatio;
+            color.b *= colorBalance.g / maxBalanceRatio;
+
+            if (brightness != 1.f || saturation != 1.f || contrast != 1.f)
+            {
+                vec3 hsv = rgb2hsv(color.rgb);
+                // Brightness correction
+                hsv.z *= brightness;
+                // Saturation
+                hsv.y = min(1.0, hsv.y * saturation);
+                // Contrast correction
+                hsv.z = (hsv.z - 0.5f) * contrast + 0.5f;
+                hsv.z = min(1.0, hsv.z);
+                color.rgb = hsv2rgb(hsv);
+            }
+
+            // Black level
+            if (blackLevel != 0.0)
+            {
+                float blackCorrection = clamp(blackLevel, 0.0, 1.0);
+                color.rgb = color.rgb * (1.0 - blackLevel) + blackLevel;
+            }
+
+            return color;
+        }
+
         void main(void)
         {
             // Compute the real texture coordinates, according to flip / flop
@@ -904,36 +1340,17 @@ struct ShaderSources
                 else // Odd pixel
                     color.rgb = yuv2rgb(yuyv.bga);
             }
-            
-            // Invert channels
-            if (_invertChannels == 1)
-                color.rgb = color.bgr;
-
-            // Color balance
-            float maxBalanceRatio = max(_colorBalance.r, _colorBalance.g);
-            color.r *= _colorBalance.r / maxBalanceRatio;
-            color.g *= 1.0 / maxBalanceRatio;
-            color.b *= _colorBalance.g / maxBalanceRatio;
 
-            if (_brightness != 1.f || _saturation != 1.f || _contrast != 1.f)
+    #ifdef FUSED_FILTER_COUNT
+            // Apply the corrections of the fused filters first, clamping as their framebuffers would
+            for (int i = 0; i < FUSED_FILTER_COUNT; ++i)
             {
-                vec3 hsv = rgb2hsv(color.rgb);
-                // Brightness correction
-                hsv.z *= _brightness;
-                // Saturation
-                hsv.y = min(1.0, hsv.y * _saturation);
-                // Contrast correction
-                hsv.z = (hsv.z - 0.5f) * _contrast + 0.5f;
-                hsv.z = min(1.0, hsv.z);
-                color.rgb = hsv2rgb(hsv);
+                color = correctColor(color, _fusedInvertChannels[i], _fusedColorBalance[i], _fusedBrightness[i], _fusedSaturation[i], _fusedContrast[i], _fusedBlackLevel[i]);
+                color = clamp(color, vec4(0.0), vec4(1.0));
             }
+    #endif
 
-            // Black level
-            if (_blackLevel != 0.0)
-            {
-                float blackCorrection = clamp(_blackLevel, 0.0, 1.0);
-                color.rgb = color.rgb * (1.0 - _blackLevel) + _blackLevel;
-            }
+            color = correctColor(color, _invertChannels, _colorBalance, _brightness, _saturation, _contrast, _blackLevel);
 
             // Color curves
     #ifdef COLOR_CURVE_COUNT
@@ -973,6 +1390,8 @@ struct ShaderSources
 
     /**
      * Fragment shader for warp
+     * With WARP_BAKE defined, the source coordinates of the warped mesh are output instead of its color
+     * With WARP_MAP defined, the source coordinates are read from the map baked this way, bound as _tex1
      */
     const std::string FRAGMENT_SHADER_WARP{R"(
 
@@ -984,6 +1403,10 @@ struct ShaderSources
         uniform sampler2D _tex0;
     #endif
 
+    #ifdef WARP_MAP
+        uniform sampler2D _tex1;
+    #endif
+
         in vec2 texCoord;
         out vec4 fragColor;
 
@@ -996,16 +1419,35 @@ struct ShaderSources
 
         void main(void)
         {
+    #ifdef WARP_BAKE
+            // The alpha channel marks the area covered by the warped mesh
+            fragColor = vec4(texCoord, 0.0, 1.0);
+            return;
+    #endif
+
+    #ifdef WARP_MAP
+            // The map has the size of the output, so it is read without filtering
+            vec4 displacement = texelFetch(_tex1, ivec2(gl_FragCoord.xy), 0);
+            if (displacement.a < 0.5)
+            {
+                fragColor = vec4(0.0);
+                return;
+            }
+            vec2 sourceCoords = displacement.xy;
+    #else
+            vec2 sourceCoords = texCoord;
+    #endif
+
             // Compute the real texture coordinates, according to flip / flop
             vec2 realCoords;
             if (_tex0_flip == 1 && _tex0_flop == 0)
-                realCoords = vec2(texCoord.x, 1.0 - texCoord.y);
+                realCoords = vec2(sourceCoords.x, 1.0 - sourceCoords.y);
             else if (_tex0_flip == 0 && _tex0_flop == 1)
-                realCoords = vec2(1.0 - texCoord.x, texCoord.y);
+                realCoords = vec2(1.0 - sourceCoords.x, sourceCoords.y);
             else if (_tex0_flip == 1 && _tex0_flop == 1)
-                realCoords = vec2(1.0 - texCoord.x, 1.0 - texCoord.y);
+                realCoords = vec2(1.0 - sourceCoords.x, 1.0 - sourceCoords.y);
             else
-                realCoords = texCoord;
+                realCoords = sourceCoords;
 
     #ifdef TEXTURE_RECT
             vec4 color = texture(_tex0, realCoords * _tex0_size);
@@ -1055,8 +1497,8 @@ struct ShaderSources
     )"};
 
     const std::string GEOMETRY_SHADER_OBJECT_CUBEMAP{R"(
-        layout(triangles) in;
-        layout(triangle_strip, max_vertices = 18) out;
+        layout(triangles, invocations = 6) in;
+        layout(triangle_strip, max_vertices = 3) out;
 
         in VertexData
         {
@@ -1071,6 +1513,7 @@ struct ShaderSources
         } vertexOut;
 
         uniform mat4 _projectionMatrix;
+        uniform int _cubemapFaces = 63; // Bitmask of the faces to render
 
         const mat4 cubemapMat[6] = mat4[](
             mat4(1.0, 0.0, 0.0, 0.0,
@@ -1099,21 +1542,35 @@ struct ShaderSources
                  0.0, 0.0, 0.0, 1.0)
             );
 
-        void main() 
+        void main()
         {
-            for (int face = 0; face < 6; ++face)
+            // Each invocation renders the triangle to a single face
+            int face = gl_InvocationID;
+            if ((_cubemapFaces & (1 << face)) == 0)
+                return;
+
+            vec4 projected[3];
+            for (int i = 0; i < 3; ++i)
+                projected[i] = _projectionMatrix * cubemapMat[face] * vertexIn[i].position;
+
+            // Skip the triangles entirely outside of the frustum of this face
+            for (int axis = 0; axis < 3; ++axis)
             {
-                gl_Layer = face;
+                if (projected[0][axis] > projected[0].w && projected[1][axis] > projected[1].w && projected[2][axis] > projected[2].w)
+                    return;
+                if (projected[0][axis] < -projected[0].w && projected[1][axis] < -projected[1].w && projected[2][axis] < -projected[2].w)
+                    return;
+            }
 
-                for (int i = 0; i < 3; ++i)
-                {
-                    vertexOut.position = _projectionMatrix * cubemapMat[face] * vertexIn[i].position;
-                    gl_Position = vertexOut.position;
-                    vertexOut.texCoord = vertexIn[i].texCoord;
-                    EmitVertex();
-                }
-                EndPrimitive();
+            for (int i = 0; i < 3; ++i)
+            {
+                gl_Layer = face;
+                vertexOut.position = projected[i];
+                gl_Position = vertexOut.position;
+                vertexOut.texCoord = vertexIn[i].texCoord;
+                EmitVertex();
             }
+            EndPrimitive();
         }
     )"};
 
@@ -1151,6 +1608,7 @@ struct ShaderSources
      */
     const std::string VERTEX_SHADER_TEXTURE{R"(
         #include getSmoothBlendFromVertex
+        #include cameraUniforms
 
         layout(location = 0) in vec4 _vertex;
         layout(location = 1) in vec2 _texcoord;
@@ -1159,7 +1617,6 @@ struct ShaderSources
 
         uniform mat4 _modelViewProjectionMatrix;
         uniform mat4 _normalMatrix;
-        uniform vec2 _cameraAttributes = vec2(0.05, 1.0); // blendWidth and brightness
 
         out VertexData
         {
@@ -1173,12 +1630,16 @@ struct ShaderSources
         void main(void)
         {
             vertexOut.position = vec4(_vertex.xyz, 1.0);
-            vertexOut.position = _modelViewProjectionMatrix * vertexOut.position;
-            gl_Position = vertexOut.position;
-            vertexOut.normal = normalize(_normalMatrix * _normal);
             vertexOut.texCoord = _texcoord;
             vertexOut.annexe = _annexe;
 
+        #ifdef LAYERED
+            // Projection and blending are computed for each layer by the geometry shader
+            vertexOut.normal = _normal;
+        #else
+            vertexOut.position = _modelViewProjectionMatrix * vertexOut.position;
+            vertexOut.normal = normalize(_normalMatrix * _normal);
+
             vec4 projectedVertex = vertexOut.position / vertexOut.position.w;
             if (projectedVertex.z >= 0.0)
             {
@@ -1187,6 +1648,86 @@ struct ShaderSources
                 else
                     vertexOut.blendingValue = min(1.0, getSmoothBlendFromVertex(projectedVertex, _cameraAttributes.x) / _annexe.y);
             }
+        #endif
+
+            gl_Position = vertexOut.position;
+        }
+    )"};
+
+    /**
+     * Geometry shader for textured rendering of multiple cameras in a single pass, one camera per layer
+     */
+    const std::string GEOMETRY_SHADER_TEXTURE_LAYERED{R"(
+        #include getSmoothBlendFromVertex
+        #include cameraLayers
+
+        layout(triangles, invocations = MAX_CAMERA_LAYERS) in;
+        layout(triangle_strip, max_vertices = 3) out;
+
+        uniform int _layerCount = 0;
+        uniform mat4 _layerModelViewProjectionMatrix[MAX_CAMERA_LAYERS];
+        uniform mat4 _layerNormalMatrix[MAX_CAMERA_LAYERS];
+
+        in VertexData
+        {
+            vec4 position;
+            vec2 texCoord;
+            vec4 normal;
+            vec4 annexe;
+            float blendingValue;
+        } vertexIn[];
+
+        out VertexData
+        {
+            vec4 position;
+            vec2 texCoord;
+            vec4 normal;
+            vec4 annexe;
+            float blendingValue;
+            flat int layer;
+        } vertexOut;
+
+        void main()
+        {
+            int layer = gl_InvocationID;
+            if (layer >= _layerCount)
+                return;
+
+            vec4 projected[3];
+            for (int i = 0; i < 3; ++i)
+                projected[i] = _layerModelViewProjectionMatrix[layer] * vertexIn[i].position;
+
+            // Skip the triangles entirely outside of the frustum of this layer
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (projected[0][axis] > projected[0].w && projected[1][axis] > projected[1].w && projected[2][axis] > projected[2].w)
+                    return;
+                if (projected[0][axis] < -projected[0].w && projected[1][axis] < -projected[1].w && projected[2][axis] < -projected[2].w)
+                    return;
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                gl_Layer = layer;
+                gl_Position = projected[i];
+                vertexOut.position = projected[i];
+                vertexOut.normal = normalize(_layerNormalMatrix[layer] * vertexIn[i].normal);
+                vertexOut.texCoord = vertexIn[i].texCoord;
+                vertexOut.annexe = vertexIn[i].annexe;
+                vertexOut.layer = layer;
+
+                vec4 projectedVertex = projected[i] / projected[i].w;
+                if (projectedVertex.z >= 0.0)
+                {
+                    if (vertexIn[i].annexe.y == 0.0)
+                        vertexOut.blendingValue = 1.0;
+                    else
+                        vertexOut.blendingValue = min(1.0, getSmoothBlendFromVertex(projectedVertex, _cameraLayers[layer].attributes.x) / vertexIn[i].annexe.y);
+                }
+
+                EmitVertex();
+            }
+            EndPrimitive();
         }
     )"};
 
@@ -1198,6 +1739,9 @@ struct ShaderSources
 
     #ifdef TEXTURE_RECT
         uniform sampler2DRect _tex0;
+    #elif defined(TEXTURE_ARRAY)
+        uniform sampler2DArray _tex0;
+        uniform int _tex0_layer = 0; // Layer of the texture atlas to sample from
     #else
         uniform sampler2D _tex0;
     #endif
@@ -1206,19 +1750,22 @@ struct ShaderSources
         uniform sampler2D _tex1;
     #endif
 
+    #ifdef TEXTUREBLENDING
+        #include getSmoothBlendFromVertex
+        uniform sampler2D _blendingMap; // Holds the blending sum and the camera count
+    #endif
+
         uniform vec2 _tex0_size = vec2(1.0);
         uniform vec2 _tex1_size = vec2(1.0);
 
-        uniform int _showCameraCount = 0;
+    #ifdef LAYERED
+        #include cameraLayers
+    #else
+        #include cameraUniforms
+    #endif
+
         uniform int _sideness = 0;
         uniform int _textureNbr = 0;
-        uniform vec2 _cameraAttributes = vec2(0.05, 1.0); // blendWidth and brightness
-        uniform vec4 _fovAndColorBalance = vec4(0.0, 0.0, 1.0, 1.0); // fovX and fovY, r/g and b/g
-        uniform int _isColorLUT = 0;
-        uniform vec3 _colorLUT[256];
-        uniform mat3 _colorMixMatrix = mat3(1.0, 0.0, 0.0,
-                                            0.0, 1.0, 0.0,
-                                            0.0, 0.0, 1.0);
         uniform float _normalExp = 0.0;
 
         in VertexData
@@ -1228,8 +1775,19 @@ struct ShaderSources
             vec4 normal;
             vec4 annexe;
             float blendingValue;
+    #ifdef LAYERED
+            flat int layer;
+    #endif
         } vertexIn;
 
+    #ifdef LAYERED
+        // Camera uniforms are read from the layer being rendered
+        #define _cameraAttributes _cameraLayers[vertexIn.layer].attributes
+        #define _fovAndColorBalance _cameraLayers[vertexIn.layer].fovAndColorBalance
+        #define _cameraFlags _cameraLayers[vertexIn.layer].flags
+        #define _colorLUT _cameraLayers[vertexIn.layer].colorLUT
+    #endif
+
         out vec4 fragColor;
 
         void main(void)
@@ -1245,6 +1803,8 @@ struct ShaderSources
 
         #ifdef TEXTURE_RECT
             vec4 color = texture(_tex0, texCoord * _tex0_size);
+        #elif defined(TEXTURE_ARRAY)
+            vec4 color = texture(_tex0, vec3(texCoord, float(_tex0_layer)));
         #else
             vec4 color = texture(_tex0, texCoord);
         #endif
@@ -1263,15 +1823,22 @@ struct ShaderSources
             color.g *= 1.0 / maxBalanceRatio;
             color.b *= _fovAndColorBalance.w / maxBalanceRatio;
 
+            float cameraCount = vertexIn.annexe.x;
         #ifdef VERTEXBLENDING
             color.rgb = color.rgb * vertexIn.blendingValue;
+        #elif defined(TEXTUREBLENDING)
+            // Blending computed per fragment, from the sum of the contributions of all cameras stored in texture space
+            vec2 blending = texture(_blendingMap, texCoord).rg;
+            if (blending.r > 0.0)
+                color.rgb = color.rgb * min(1.0, getSmoothBlendFromVertex(vec4(screenPos, 0.0, 1.0), blendWidth) / blending.r);
+            cameraCount = blending.g;
         #endif
 
             // Brightness correction
             color.rgb = color.rgb * brightness;
 
             // Color correction through a LUT
-            if (_isColorLUT != 0)
+            if (_cameraFlags.y != 0)
             {
                 ivec3 icolor = ivec3(round(color.rgb * 255.f));
                 color.rgb = vec3(_colorLUT[icolor.r].r, _colorLUT[icolor.g].g, _colorLUT[icolor.b].b);
@@ -1288,9 +1855,9 @@ struct ShaderSources
             
             fragColor.a = 1.0;
 
-            if (_showCameraCount > 0)
+            if (_cameraFlags.x > 0)
             {
-                int count = int(round(vertexIn.annexe.x));
+                int count = int(round(cameraCount));
                 int r = count - (count / 2) * 2;
                 count -= r;
                 int g = count - (count / 4) * 4;
@@ -1366,6 +1933,59 @@ struct ShaderSources
         }
     )"};
 
+    /**
+     * Vertex shader unwrapping the surface in texture space, to render its position or its normal (if NORMAL is defined) in each texel
+     */
+    const std::string VERTEX_SHADER_UV_POSITION{R"(
+        layout(location = 0) in vec4 _vertex;
+        layout(location = 1) in vec2 _texcoord;
+
+        uniform vec3 _boundingBoxMin = vec3(0.0);
+        uniform vec3 _boundingBoxSize = vec3(1.0);
+
+        out VertexData
+        {
+            vec3 position;
+            vec3 objectPosition;
+        } vertexOut;
+
+        void main(void)
+        {
+            // The position is normalized in the bounding box to fit in a 16bpc framebuffer
+            vertexOut.position = (_vertex.xyz - _boundingBoxMin) / max(_boundingBoxSize, vec3(1e-6));
+            vertexOut.objectPosition = _vertex.xyz;
+            gl_Position = vec4(_texcoord * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )"};
+
+    /**
+     * Fragment shader writing the position or the normal of the surface in texture space, the alpha marking the covered texels
+     */
+    const std::string FRAGMENT_SHADER_UV_POSITION{R"(
+        in VertexData
+        {
+            vec3 position;
+            vec3 objectPosition;
+        } vertexIn;
+
+        out vec4 fragColor;
+
+        void main(void)
+        {
+        #ifdef NORMAL
+            // Normal of the triangle following its winding, as computed by normalVector. The winding in texture space
+            // is given by gl_FrontFacing, so that mirrored texture coordinates do not flip it
+            vec3 normal = cross(dFdx(vertexIn.objectPosition), dFdy(vertexIn.objectPosition));
+            if (length(normal) == 0.0)
+                discard;
+            normal = normalize(normal) * (gl_FrontFacing ? 1.0 : -1.0);
+            fragColor = vec4(normal * 0.5 + 0.5, 1.0);
+        #else
+            fragColor = vec4(vertexIn.position, 1.0);
+        #endif
+        }
+    )"};
+
     /**
      * Draws the primitive ID
      * This shader has to be used after a pass of COMPUTE_SHADER_RESET_VISIBILITY
@@ -1471,9 +2091,9 @@ struct ShaderSources
             vec4 position;
         } vertexIn;
 
-        uniform vec4 _wireframeColor = vec4(1.0, 0.0, 0.0, 1.0);
+        #include cameraUniforms
+
         uniform int _sideness = 0;
-        uniform vec4 _fovAndColorBalance = vec4(0.0, 0.0, 1.0, 1.0); // fovX and fovY, r/g and b/g
         out vec4 fragColor;
 
         float edgeFactor()
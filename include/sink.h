@@ -25,9 +25,13 @@
 #ifndef SPLASH_SINK_H
 #define SPLASH_SINK_H
 
+#include <condition_variable>
+#include <deque>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "./config.h"
 
@@ -35,6 +39,7 @@
 #include "./attribute.h"
 #include "./coretypes.h"
 #include "./resizable_array.h"
+#include "./shader.h"
 #include "./texture.h"
 
 namespace Splash
@@ -57,7 +62,11 @@ class Sink : public BaseObject
      * Get the current buffer as a resizable array
      * \return Return the buffer
      */
-    ResizableArray<uint8_t> getBuffer() const { return _buffer; };
+    ResizableArray<uint8_t> getBuffer() const
+    {
+        std::lock_guard<std::mutex> lock(_lockPixels);
+        return _buffer;
+    }
 
     /**
      * Generate a caps from the input texture spec
@@ -78,50 +87,140 @@ class Sink : public BaseObject
     void unlinkFrom(const std::shared_ptr<BaseObject>& obj);
 
     /**
-     * Update the inner buffer of the sink
+     * Recycle the buffers handled by the sink output, and start reading back the input texture
      */
     void update() override;
 
     /**
-     * Send the inner buffer to the sink's output
+     * Hand the buffers which have been read back to the sink output, which runs in its own thread
      */
     void render() override;
 
   protected:
+    enum class DropPolicy
+    {
+        DropOldest,
+        DropNewest
+    };
+
     uint32_t _framerate{30}; //!< Maximum framerate
 
+    /**
+     * \brief Get the frame to drop when a queue is full, which derived classes may also apply to their own queues
+     * \return Return the drop policy
+     */
+    DropPolicy getDropPolicy() const
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        return _dropPolicy;
+    }
+
     /**
      * \brief Register new functors to modify attributes
      */
     void registerAttributes();
 
+    /**
+     * \brief Stop the thread calling handlePixels. Must be called by derived classes destructors, before their members used by handlePixels are freed
+     */
+    void stopHandlerThread();
+
   private:
+    enum class SlotState
+    {
+        Free,       //!< Available for a new readback
+        InFlight,   //!< Readback issued, waiting for its fence
+        Mapped,     //!< Mapped, waiting in the queue or being handled
+        Handled     //!< Handled or dropped, to be unmapped
+    };
+
+    struct ReadbackSlot
+    {
+        GLuint pbo{0};
+        GLsync fence{nullptr};
+        const char* pixels{nullptr};
+        ImageBufferSpec spec{};
+        int64_t captureTime{0};
+        SlotState state{SlotState::Free};
+    };
+
     std::shared_ptr<Texture> _inputTexture{nullptr};
-    ImageBufferSpec _spec{};
-    ImageBuffer _image{};
-    std::mutex _lockPixels{};
+    ImageBufferSpec _spec{}; //!< Spec of the buffers read back, which differs from the input texture spec when converting to YUV
+    mutable std::mutex _lockPixels{};
     ResizableArray<uint8_t> _buffer{};
 
     bool _opened{false}; //!< If true, the sink lets frames through
 
     uint64_t _lastFrameTiming{0};
     uint32_t _pboCount{3};
-    std::vector<GLuint> _pbos{};
-    int _pboWriteIndex{0};
-    GLubyte* _mappedPixels{nullptr};
+
+    // Conversion to planar YUV on the GPU, before the readback
+    std::string _outputFormat{"native"}; //!< Either "native" for a plain readback, "I420" or "Y42B"
+    int _outputWidth{0};                 //!< Output size when converting, 0 meaning the input size
+    int _outputHeight{0};
+    std::shared_ptr<Shader> _conversionShader{nullptr};
+    std::string _conversionShaderFormat{};
+    bool _conversionWarned{false};
+
+    // Readback ring, the slots being owned by the render thread except for the ones in the Mapped state
+    std::vector<ReadbackSlot> _slots{};
+    std::deque<int> _inFlightSlots{}; //!< Slots waiting for their fence, by capture order. Only used from the render thread
+
+    // Queue of the slots to handle, consumed by the handler thread
+    mutable std::mutex _queueMutex{};
+    std::condition_variable _queueCondition{};
+    std::deque<int> _queuedSlots{};
+    uint32_t _queueSize{1};
+    DropPolicy _dropPolicy{DropPolicy::DropOldest};
+    bool _handlerRunning{true};
+    bool _handlingSlot{false};
+    std::thread _handlerThread{};
+
+    // Statistics
+    int64_t _latency{0};        //!< Duration from the readback to the end of the handling of the last frame, in us
+    uint64_t _droppedFrames{0}; //!< Frames dropped because the ring or the queue was full
 
     /**
-     * Class to be implemented to copy the _mappedPixels somewhere
+     * Class to be implemented to copy the mapped pixels somewhere. Called from the handler thread
+     * \param pixels Pixels
+     * \param spec Pixels specifications
      */
     virtual void handlePixels(const char* pixels, const ImageBufferSpec& spec);
 
     /**
-     * \brief Update the pbos according to the parameters
-     * \param width Width
-     * \param height Height
-     * \param bytes Bytes per pixel
+     * \brief Get the spec of the buffers read back for the given input texture spec, according to the output format and size
+     * \param textureSpec Input texture spec
+     * \return Return the readback spec
+     */
+    ImageBufferSpec getReadbackSpec(const ImageBufferSpec& textureSpec);
+
+    /**
+     * \brief Convert the input texture to planar YUV into the given buffer, with a compute shader
+     * \param pbo Destination buffer
+     */
+    void convertToYUV(GLuint pbo);
+
+    /**
+     * \brief Handle the queued slots until the thread is stopped
+     */
+    void handlerLoop();
+
+    /**
+     * \brief Queue a mapped slot, dropping a frame according to the drop policy if the queue is full. Queue must be locked
+     * \param index Slot index
+     */
+    void queueSlot(int index);
+
+    /**
+     * \brief Unmap the slots which have been handled, making them available
+     */
+    void recycleSlots();
+
+    /**
+     * \brief Recreate the readback ring, after the handler is done with the slots it uses
+     * \param size Size of each buffer in bytes
      */
-    void updatePbos(int width, int height, int bytes);
+    void resetSlots(int size);
 };
 
 } // end of namespace
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @sink_file.h
+ * The Sink_File class, recording the connected texture to video files
+ */
+
+#ifndef SPLASH_SINK_FILE_H
+#define SPLASH_SINK_FILE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "./sink.h"
+
+namespace Splash
+{
+
+class Sink_File : public Sink
+{
+  public:
+    /**
+     * Constructor
+     */
+    Sink_File(RootObject* root);
+
+    /**
+     * Destructor
+     */
+    ~Sink_File() final;
+
+    /**
+     * Update the sink, closing it if the recording stopped on an error
+     */
+    void update() final;
+
+  private:
+    struct WriteBlock
+    {
+        uint8_t* data{nullptr};
+        size_t size{0};
+        int64_t offset{0};
+        int fd{-1};
+        bool closeFile{false}; //!< If true, the file is closed once the block is written
+    };
+
+    static constexpr size_t _blockSize{4 << 20};   //!< Size of the writes, except for the last block before a seek
+    static constexpr size_t _blockAlignment{4096}; //!< Alignment of the write buffers
+    static constexpr int _ioBufferSize{1 << 16};   //!< Size of the FFmpeg IO buffer, flushed into the write blocks
+
+    // Recording parameters
+    std::string _path{"/tmp/splash_record.mov"};
+    std::string _codecName{"hap"};
+    int _segmentDuration{0}; //!< Duration of each file in seconds, 0 meaning a single file
+    std::atomic_bool _recording{false};       //!< Written with the muxer locked, read without it by the attribute getter
+    std::atomic_bool _recordingFailed{false}; //!< Set by the handler thread when a file could not be opened, the sink being closed by update()
+
+    // Muxing objects, used from the handler thread, and when the recording stops
+    std::mutex _muxerMutex{};
+    AVFormatContext* _formatContext{nullptr};
+    AVCodecContext* _context{nullptr};
+    AVStream* _stream{nullptr};
+    AVIOContext* _ioContext{nullptr};
+    SwsContext* _swsContext{nullptr};
+    AVFrame* _frame{nullptr};
+    ImageBufferSpec _recordSpec{};
+    int64_t _segmentStart{0};
+    int64_t _lastPts{-1};
+    int _segmentIndex{0}; //!< Index of the next file, appended to its name when segmenting and for all takes but the first
+
+    // File being written, as seen by the muxer
+    int _fd{-1};
+    int64_t _position{0};
+    int64_t _fileSize{0};
+    WriteBlock _currentBlock{}; //!< Block being filled by the muxer
+
+    // Write queue, consumed by the writer thread
+    std::mutex _writeMutex{};
+    std::condition_variable _writeCondition{};
+    std::deque<WriteBlock> _writeQueue{};
+    std::vector<uint8_t*> _freeBlocks{};
+    size_t _queuedBytes{0};
+    size_t _maxQueuedBytes{256 << 20};
+    bool _writerRunning{true};
+    std::atomic_bool _writeError{false}; //!< Set by the writer thread, reset for each new file
+    std::thread _writerThread{};
+
+    // Statistics
+    std::atomic<uint64_t> _recordDroppedFrames{0}; //!< Frames dropped because the write backlog was full
+
+    /**
+     * Encode and mux a frame, or flush the encoder if frame is null
+     * \param frame Frame to encode
+     */
+    void encodeFrame(AVFrame* frame);
+
+    /**
+     * Get the encoder settings for the current codec
+     * \param encoderName Set to the FFmpeg encoder name
+     * \param pixelFormat Set to the pixel format given to the encoder
+     * \param hapFormat Set to the Hap variant if the codec is Hap, empty otherwise
+     * \return Return false if the codec is not supported
+     */
+    bool getEncoderSettings(std::string& encoderName, AVPixelFormat& pixelFormat, std::string& hapFormat) const;
+
+    /**
+     * Get the FFmpeg pixel format matching the given spec
+     * \param spec Image spec
+     * \return Return the pixel format, or AV_PIX_FMT_NONE if not supported
+     */
+    static AVPixelFormat getInputPixelFormat(const ImageBufferSpec& spec);
+
+    /**
+     * Get the path of the current segment, or of the current take when not segmenting
+     * \return Return the path
+     */
+    std::string getSegmentPath() const;
+
+    /**
+     * Save the pixels read back to the current file. Called from the handler thread
+     * \param pixels Pixels
+     * \param spec Pixels specifications
+     */
+    void handlePixels(const char* pixels, const ImageBufferSpec& spec) final;
+
+    /**
+     * Open a new file and its encoder, for the given input spec. Muxer must be locked
+     * \param spec Input spec
+     * \return Return true if all went well
+     */
+    bool openSegment(const ImageBufferSpec& spec);
+
+    /**
+     * Flush the encoder, write the trailer and free the muxing objects. The file is closed by the writer thread. Muxer must be locked
+     */
+    void closeSegment();
+
+    /**
+     * Append muxed data to the current block, queueing it once full
+     * \param buffer Data
+     * \param size Data size
+     */
+    void appendToBlock(const uint8_t* buffer, int size);
+
+    /**
+     * Queue the current block for writing
+     * \param closeFile If true, the file is closed after this block
+     */
+    void queueBlock(bool closeFile = false);
+
+    /**
+     * Write the queued blocks until the thread is stopped, the remaining blocks being written before it exits
+     */
+    void writerLoop();
+
+    /**
+     * Stop the writer thread, after the queued blocks have been written
+     */
+    void stopWriterThread();
+
+    /**
+     * FFmpeg IO callbacks, redirected to the muxer of the given sink
+     */
+    static int writePacket(void* opaque, uint8_t* buffer, int size);
+    static int64_t seekPacket(void* opaque, int64_t offset, int whence);
+
+    /**
+     * Register new functors to modify attributes
+     */
+    void registerAttributes();
+};
+
+} // end of namespace
+
+#endif
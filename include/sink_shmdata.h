@@ -41,6 +41,11 @@ class Sink_Shmdata : public Sink
      */
     Sink_Shmdata(RootObject* root);
 
+    /**
+     * Destructor
+     */
+    ~Sink_Shmdata() final;
+
   private:
     std::string _path{"/tmp/splash_sink"};
     std::string _caps{"application/x-raw"};
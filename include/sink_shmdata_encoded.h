@@ -25,7 +25,13 @@
 #ifndef SPLASH_SINK_SHMDATA_ENCODED_H
 #define SPLASH_SINK_SHMDATA_ENCODED_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <shmdata/writer.hpp>
 
@@ -63,22 +69,50 @@ class Sink_Shmdata_Encoded : public Sink
     std::unique_ptr<shmdata::Writer> _writer{nullptr};
     ImageBufferSpec _previousSpec{};
     uint32_t _previousFramerate{0};
-    bool _resetEncoding{false};
+    std::atomic_bool _resetEncoding{false};
 
     // FFmpeg objects
     AVCodec* _codec{nullptr};
     AVCodecContext* _context{nullptr};
-    AVFrame *_frame{nullptr}, *_yuvFrame{nullptr};
+    AVFrame* _frame{nullptr}; //!< Wraps the RGB pixels given to swscale
     SwsContext* _swsContext{nullptr};
     AVPacket _packet;
 
+    // Encoder thread, fed with converted frames so that the readback buffers are released before encoding
+    struct EncoderFrame
+    {
+        AVFrame* frame{nullptr};
+        int64_t queueTime{0};
+    };
+
+    std::mutex _encoderMutex{};
+    std::condition_variable _encoderCondition{};
+    std::vector<AVFrame*> _freeFrames{};      //!< Frames available for conversion, the pool holding one frame more than the queue
+    std::deque<EncoderFrame> _encoderQueue{}; //!< Frames waiting to be encoded
+    uint32_t _encoderQueueSize{2};
+    bool _encoderRunning{true};
+    bool _encoding{false};
+    std::thread _encoderThread{};
+    int _framesSinceKeyframe{0};  //!< Only used from the encoder thread
+    int _packetsSinceKeyframe{0}; //!< Only used from the encoder thread, to check that forced keyframes are emitted
+    std::atomic_bool _forcedKeyframesIgnored{false}; //!< Set if the encoder did not emit the forced keyframes, the GOP size being used instead
+
     // Codec parameters
+    static constexpr int _maxGopSize{1 << 16};   //!< GOP size given to the encoder, keyframes being forced more often than that
+    static constexpr int _maxEncoderDelay{32}; //!< Frames an encoder may hold back, allowed on top of the keyframe interval before checking for keyframes
     int64_t _startTime{0ll};
     std::string _codecName{"h264"};
-    int _bitRate{4000000};
+    std::atomic_int _bitRate{4000000};       //!< Updated in place in the codec context, for encoders which support it
+    std::atomic_int _keyframeInterval{12};   //!< Keyframes are forced by the sink, so that the interval can change while encoding
+    int _encoderThreads{0};                  //!< Encoder thread count, 0 letting FFmpeg decide
+    std::string _encoderThreadType{"slice"}; //!< Either "frame", "slice" or "auto" for both
     double _framerate{30.0};
     std::string _options{"profile=baseline"};
 
+    // Statistics
+    int64_t _encodeLatency{0};        //!< Duration from the queueing of the last frame to the end of its encoding, in us
+    uint64_t _encodeDroppedFrames{0}; //!< Frames dropped because the encoder queue was full
+
     /**
      * Find an encoder base on its name
      * \param encoderName Codec name
@@ -98,6 +132,41 @@ class Sink_Shmdata_Encoded : public Sink
      */
     void freeFFmpegObjects();
 
+    /**
+     * Get the pixel format given to the encoder for the given input spec
+     * \param spec Input image specifications
+     * \return Return the pixel format
+     */
+    static AVPixelFormat getPixelFormat(const ImageBufferSpec& spec);
+
+    /**
+     * Check whether the input has been converted to planar YUV before its readback
+     * \param spec Input image specifications
+     * \return Return true if the input is planar YUV
+     */
+    static bool isPlanarYUV(const ImageBufferSpec& spec);
+
+    /**
+     * Encode the given frame and send the resulting packets through shmdata. Called from the encoder thread
+     * \param frame Frame to encode
+     */
+    void encodeFrame(AVFrame* frame);
+
+    /**
+     * Encode the queued frames until the thread is stopped
+     */
+    void encoderLoop();
+
+    /**
+     * Drop the frames waiting to be encoded, and wait for the one being encoded
+     */
+    void flushEncoderQueue();
+
+    /**
+     * Stop the encoder thread
+     */
+    void stopEncoderThread();
+
     /**
      * Generate the caps from the spec, the context and the options
      * \param spec Input image specifications
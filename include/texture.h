@@ -28,6 +28,7 @@
 #include <chrono>
 #include <glm/glm.hpp>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "config.h"
@@ -93,6 +94,12 @@ class Texture : public BaseObject
      */
     virtual std::string getPrefix() const { return "_tex"; }
 
+    /**
+     * \brief Get the timestamp of the last modification of the texture content
+     * \return Return the timestamp, or the current time if it can not be known
+     */
+    virtual int64_t getTimestamp() const { return Timer::getTime(); }
+
     /**
      * \brief Try to link the given BaseObject to this object
      * \param obj Shared pointer to the (wannabe) child object
@@ -115,6 +122,14 @@ class Texture : public BaseObject
      */
     void setResizable(bool resizable) { _resizable = resizable; }
 
+    /**
+     * \brief Notify the texture of the size of the area it is sampled into, for the current frame.
+     * This is used to decide whether mipmaps are needed. A size of 0 means the footprint is unknown.
+     * \param width Width of the sampled area
+     * \param height Height of the sampled area
+     */
+    virtual void setSampledSize(int width, int height);
+
     /**
      * \brief Update the texture according to the owned Image
      */
@@ -129,6 +144,16 @@ class Texture : public BaseObject
 
     int64_t _timestamp;
 
+    // Smallest area this texture has been sampled into since the last query. -1 if not sampled, 0 if unknown
+    std::mutex _sampledSizeMutex{};
+    glm::ivec2 _sampledSize{-1, -1};
+
+    /**
+     * \brief Get the smallest sampled size notified since the last call, and reset it
+     * \return Return the sampled size. -1 if the texture has not been sampled, 0 if the footprint is unknown
+     */
+    glm::ivec2 consumeSampledSize();
+
     /**
      * \brief Register new functors to modify attributes
      */
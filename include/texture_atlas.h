@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @texture_atlas.h
+ * The Texture_Atlas class, packing many images of the same size and format into a texture array
+ */
+
+#ifndef SPLASH_TEXTURE_ATLAS_H
+#define SPLASH_TEXTURE_ATLAS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./config.h"
+
+#include "./attribute.h"
+#include "./coretypes.h"
+#include "./image.h"
+#include "./texture.h"
+
+namespace Splash
+{
+
+/*************/
+class Texture_Atlas : public Texture
+{
+  public:
+    /**
+     * \brief Constructor
+     * \param root Root object
+     */
+    Texture_Atlas(RootObject* root);
+
+    /**
+     * \brief Destructor
+     */
+    ~Texture_Atlas() final;
+
+    /**
+     * No copy constructor
+     */
+    Texture_Atlas(const Texture_Atlas&) = delete;
+    Texture_Atlas& operator=(const Texture_Atlas&) = delete;
+
+    /**
+     * \brief Bind this texture
+     */
+    void bind() final;
+
+    /**
+     * \brief Unbind this texture
+     */
+    void unbind() final;
+
+    /**
+     * \brief Get the shader parameters related to this texture. Texture should be locked first.
+     * \return Return the shader uniforms
+     */
+    std::unordered_map<std::string, Values> getShaderUniforms() const final { return _shaderUniforms; }
+
+    /**
+     * \brief Get spec of a layer of the texture
+     * \return Return the texture spec
+     */
+    ImageBufferSpec getSpec() const final { return _spec; }
+
+    /**
+     * \brief Get the id of the GL texture array
+     * \return Return the texture id
+     */
+    GLuint getTexId() const final { return _glTex; }
+
+    /**
+     * \brief Get the timestamp of the last layer update
+     * \return Return the timestamp
+     */
+    int64_t getTimestamp() const final { return _timestamp; }
+
+    /**
+     * \brief Get the layer an image is stored into
+     * \param name Image name
+     * \return Return the layer index, or -1 if the image is not in the atlas
+     */
+    int getLayer(const std::string& name) const;
+
+    /**
+     * \brief Try to link the given BaseObject to this object
+     * \param obj Shared pointer to the (wannabe) child object
+     */
+    bool linkTo(const std::shared_ptr<BaseObject>& obj) final;
+
+    /**
+     * \brief Try to unlink the given BaseObject from this object
+     * \param obj Shared pointer to the (supposed) child object
+     */
+    void unlinkFrom(const std::shared_ptr<BaseObject>& obj) final;
+
+    /**
+     * \brief Upload the layers whose image changed
+     */
+    void update() final;
+
+  private:
+    struct Layer
+    {
+        std::weak_ptr<Image> image{};
+        int64_t timestamp{0};
+    };
+
+    static constexpr int _texLevels{4};
+
+    GLuint _glTex{0};
+    GLuint _activeTexture{0};
+    GLenum _glChannelOrder{GL_RGBA};
+    GLenum _glDataFormat{GL_UNSIGNED_BYTE};
+    int _allocatedLayers{0};
+    bool _filtering{true};
+    bool _srgb{true};
+
+    std::vector<Layer> _layers{}; //!< Layers keep their index when an image is unlinked, empty layers being reused first
+    std::unordered_map<std::string, Values> _shaderUniforms{};
+    bool _specWarned{false};
+
+    /**
+     * \brief Init function called in constructors
+     */
+    void init();
+
+    /**
+     * \brief Create the texture array storage, for the given spec and layer count
+     * \param spec Spec of each layer
+     * \param layerCount Layer count
+     * \param srgb If true, the layers are stored in sRGB
+     * \return Return true if the spec is supported
+     */
+    bool allocate(const ImageBufferSpec& spec, int layerCount, bool srgb);
+
+    /**
+     * \brief Register new functors to modify attributes
+     */
+    void registerAttributes();
+};
+
+} // end of namespace
+
+#endif // SPLASH_TEXTURE_ATLAS_H
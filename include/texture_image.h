@@ -50,7 +50,7 @@ class Texture_Image : public Texture
      * \param root Root object
      * \param width Width
      * \param height Height
-     * \param pixelFormat String describing the pixel format. Accepted values are RGB, RGBA, sRGBA, RGBA16, R16, YUYV, UYVY, D
+     * \param pixelFormat String describing the pixel format. Accepted values are RGB, RGBA, sRGBA, RGBA16, R16, RG32F, YUYV, UYVY, D
      * \param data Pointer to data to use to initialize the texture
      * \param multisample Sample count for MSAA
      * \param cubemap True to request a cubemap
@@ -95,6 +95,13 @@ class Texture_Image : public Texture
      */
     void generateMipmap() const;
 
+    /**
+     * \brief Generate the mipmaps for the texture if they may be sampled, according to the mipmap mode
+     * and to the sampled size notified since the last call
+     * \return Return true if the mipmaps have been generated
+     */
+    bool updateMipmap();
+
     /**
      * Computed the mean value for the image
      * \return Return the mean RGB value
@@ -119,6 +126,12 @@ class Texture_Image : public Texture
      */
     ImageBufferSpec getSpec() const { return _spec; }
 
+    /**
+     * \brief Get the timestamp of the last modification of the texture content
+     * \return Return the timestamp of the source image, or the current time if the texture is not set from an image
+     */
+    int64_t getTimestamp() const override { return _img.expired() ? Timer::getTime() : _timestamp; }
+
     /**
      * \brief Try to link the given BaseObject to this object
      * \param obj Shared pointer to the (wannabe) child object
@@ -140,12 +153,13 @@ class Texture_Image : public Texture
      * Set the buffer size / type / internal format
      * \param width Width
      * \param height Height
-     * \param pixelFormat String describing the pixel format. Accepted values are RGB, RGBA, sRGBA, RGBA16, R16, YUYV, UYVY, D
+     * \param pixelFormat String describing the pixel format. Accepted values are RGB, RGBA, sRGBA, RGBA16, R16, RG32F, YUYV, UYVY, D
      * \param data Pointer to data to use to initialize the texture
      * \param multisample Sample count for MSAA
      * \param cubemap True to request a cubemap
+     * \param layers If not null, request an array texture with this number of layers
      */
-    void reset(int width, int height, const std::string& pixelFormat, const GLvoid* data, int multisampled = 0, bool cubemap = false);
+    void reset(int width, int height, const std::string& pixelFormat, const GLvoid* data, int multisampled = 0, bool cubemap = false, int layers = 0);
 
     /**
      * \brief Modify the size of the texture
@@ -171,16 +185,27 @@ class Texture_Image : public Texture
     void update() final;
 
   private:
+    enum class MipmapMode
+    {
+        Always,
+        Auto
+    };
+
     GLuint _glTex{0};
     GLuint _pbos[2];
     int _multisample{0};
     bool _cubemap{false};
+    int _layers{0};
     int _pboReadIndex{0};
     std::vector<std::future<void>> _pboCopyThreads;
+    bool _pboUpToDate{false};      //!< True if the PBO to read from holds the last frame of the image
+    bool _textureBehindPbo{false}; //!< True if the texture has not been updated from the PBO holding the last frame yet
+    int64_t _imageFrameIndex{-1};  //!< Index of the last image frame given to the texture
 
     // Store some texture parameters
     static constexpr int _texLevels{4};
     bool _filtering{false};
+    MipmapMode _mipmapMode{MipmapMode::Auto};
     GLenum _texFormat{GL_RGB}, _texType{GL_UNSIGNED_BYTE};
     std::string _pixelFormat{"RGBA"};
     GLint _texInternalFormat{GL_RGBA};
@@ -206,6 +231,13 @@ class Texture_Image : public Texture
      */
     GLenum getChannelOrder(const ImageBufferSpec& spec);
 
+    /**
+     * \brief Get the pixel count of damaged regions
+     * \param damage Damaged regions
+     * \return Return the pixel count
+     */
+    static uint32_t getDamageSize(const std::vector<ImageRegion>& damage);
+
     /**
      * \brief Update the pbos according to the parameters
      * \param width Width
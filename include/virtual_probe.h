@@ -155,6 +155,13 @@ class VirtualProbe : public Texture
 
     ProjectionType _projectionType{ProjectionType::Equirectangular};
     float _sphericalFov{180.f};
+    bool _skipHiddenFaces{true};
+
+    /**
+     * \brief Compute which cubemap faces are seen by the projection
+     * \return Return a bitmask of the faces, in the order of the cubemap layers
+     */
+    int computeVisibleFaces() const;
 
     /**
      * \brief Register new functors to modify attributes
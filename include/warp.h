@@ -125,6 +125,13 @@ class Warp : public Texture
      */
     void setSavable(bool savable) { _savable = true; }
 
+    /**
+     * \brief Forward the sampled size to the output texture
+     * \param width Width of the sampled area
+     * \param height Height of the sampled area
+     */
+    void setSampledSize(int width, int height) final { _fbo->getColorTexture()->setSampledSize(width, height); }
+
     /**
      * \brief Update the warp
      */
@@ -143,6 +150,11 @@ class Warp : public Texture
     std::shared_ptr<Object> _screen{nullptr};
     ImageBufferSpec _outTextureSpec;
 
+    // The Bezier patch is only rendered when it changes, to bake the source coordinates of every output pixel
+    std::unique_ptr<Framebuffer> _displacementFbo{nullptr};
+    std::shared_ptr<Object> _warpedScreen{nullptr}; //!< Full screen quad applying the displacement map to the input
+    int64_t _displacementPatchUpdateCount{-1};      //!< Update count of the patch when the displacement map was baked, -1 if not baked
+
     // Some default models use in various situations
     std::list<std::shared_ptr<Mesh>> _modelMeshes;
     std::list<std::shared_ptr<Geometry>> _modelGeometries;
@@ -152,6 +164,11 @@ class Warp : public Texture
     bool _showControlPoints{false};
     int _selectedControlPointIndex{-1};
 
+    /**
+     * \brief Render the Bezier patch to the displacement map
+     */
+    void bakeDisplacementMap();
+
     /**
      * \brief Init function called in constructors
      */
@@ -79,6 +79,17 @@ class GuiGlobalView : public GuiWidget
     // Previous point added
     Values _previousPointAdded;
 
+    // Picking is done asynchronously, its result being available on a later frame
+    struct PickingResult
+    {
+        std::string cameraName{};
+        Values position{};
+        float depth{0.f};
+        bool ready{false};
+    };
+    std::shared_ptr<PickingResult> _calibrationPointPicking{nullptr};
+    std::shared_ptr<PickingResult> _targetPicking{nullptr};
+
     /**
      * \brief Capture joystick
      */
@@ -92,6 +103,7 @@ class GuiGlobalView : public GuiWidget
     void processJoystickState();
     void processKeyEvents();
     void processMouseEvents();
+    void processPickingResults();
 
     // Actions
     /**
@@ -115,6 +115,8 @@ bool BaseObject::setAttribute(const string& attrib, const Values& args)
     if (!attribFunction->second.isDefault())
         _updatedParams = true;
     bool attribResult = attribFunction->second(forward<const Values&>(args));
+    if (!attribFunction->second.isDefault())
+        ++_updateCount;
 
     return attribResult && attribNotPresent;
 }
@@ -1,5 +1,7 @@
 #include "./camera.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <future>
 #include <limits>
@@ -83,6 +85,9 @@ Camera::Camera(RootObject* root)
     _msFbo->setParameters(_multisample, _render16bits, false);
     _outFbo->setParameters(false, _render16bits, false);
 
+    glCreateBuffers(1, &_uniformBuffer);
+    glNamedBufferData(_uniformBuffer, sizeof(UniformBlock), nullptr, GL_DYNAMIC_DRAW);
+
     // Load some models
     loadDefaultModels();
 }
@@ -90,9 +95,17 @@ Camera::Camera(RootObject* root)
 /*************/
 Camera::~Camera()
 {
+    if (!_root)
+        return;
+
 #ifdef DEBUG
     Log::get() << Log::DEBUGGING << "Camera::~Camera - Destructor" << Log::endl;
 #endif
+
+    glDeleteBuffers(1, &_uniformBuffer);
+    glDeleteBuffers(1, &_layersBuffer);
+    GlStateCache::get().forgetFramebuffer(_layerReadFbo);
+    glDeleteFramebuffers(1, &_layerReadFbo);
 }
 
 /*************/
@@ -129,10 +142,13 @@ void Camera::computeVertexVisibility()
     }
 
     // Render with the current texture, with no marker or frame
+    // The output framebuffer is overwritten, so the next render can not be skipped
     bool drawFrame = _drawFrame;
     bool displayCalibration = _displayCalibration;
     _drawFrame = _displayCalibration = false;
+    _renderSignature.clear();
     render();
+    _renderSignature.clear();
     _drawFrame = drawFrame;
     _displayCalibration = displayCalibration;
 
@@ -149,7 +165,7 @@ void Camera::computeVertexVisibility()
     }
 
     // Update the vertices visibility based on the result
-    glActiveTexture(GL_TEXTURE0);
+    GlStateCache::get().activeTexture(0);
     _outFbo->getColorTexture()->bind();
     primitiveIdShift = 0;
     for (auto& o : _objects)
@@ -165,13 +181,135 @@ void Camera::computeVertexVisibility()
 }
 
 /*************/
-void Camera::blendingTessellateForCurrentCamera()
+void Camera::computeBlendingContributions(const vector<shared_ptr<Camera>>& cameras, const vector<shared_ptr<Object>>& onlyObjects)
+{
+    if (!_visibilityFbo)
+        _visibilityFbo = make_unique<Framebuffer>(_root);
+
+    for (size_t first = 0; first < cameras.size(); first += Shader::maxCameraLayers)
+    {
+        auto last = std::min(cameras.size(), first + static_cast<size_t>(Shader::maxCameraLayers));
+        vector<shared_ptr<Camera>> batch(cameras.begin() + first, cameras.begin() + last);
+        int layerCount = batch.size();
+
+        // Gather the objects seen by the cameras of this batch, along with which cameras see them
+        vector<shared_ptr<Object>> objects;
+        vector<int> layerMasks;
+        for (int layer = 0; layer < layerCount; ++layer)
+        {
+            for (auto& o : batch[layer]->_objects)
+            {
+                auto obj = o.lock();
+                if (!obj)
+                    continue;
+
+                auto objectIt = find(objects.begin(), objects.end(), obj);
+                if (objectIt == objects.end())
+                {
+                    objects.push_back(obj);
+                    layerMasks.push_back(0);
+                    objectIt = objects.end() - 1;
+                }
+                layerMasks[objectIt - objects.begin()] |= 1 << layer;
+            }
+        }
+
+        // The primitive ID is shifted by the number of primitives of the previous objects
+        vector<int> primitiveIdShifts;
+        int primitiveIdShift = 0;
+        for (auto& obj : objects)
+        {
+            obj->resetVisibility(primitiveIdShift);
+            primitiveIdShifts.push_back(primitiveIdShift);
+            primitiveIdShift += obj->getVerticesNumber() / 3;
+        }
+
+        int width = 0;
+        int height = 0;
+        vector<dmat4> viewMatrices;
+        vector<dmat4> projectionMatrices;
+        vector<float> blendWidths;
+        for (auto& camera : batch)
+        {
+            width = std::max(width, static_cast<int>(camera->_width));
+            height = std::max(height, static_cast<int>(camera->_height));
+            viewMatrices.push_back(camera->computeViewMatrix());
+            projectionMatrices.push_back(camera->computeProjectionMatrix());
+            blendWidths.push_back(camera->_blendWidth);
+        }
+
+        vector<int> visibilityFboParameters{width, height, layerCount};
+        if (visibilityFboParameters != _visibilityFboParameters)
+        {
+            _visibilityFbo->setParameters(0, false, false, false, layerCount);
+            _visibilityFbo->setSize(width, height);
+            _visibilityFboParameters = visibilityFboParameters;
+        }
+
+        // Render the primitive IDs seen by every camera in its own layer, each with its own viewport
+        _visibilityFbo->bindDraw();
+        GlStateCache::get().viewport(0, 0, batch[0]->_width, batch[0]->_height);
+        for (int layer = 1; layer < layerCount; ++layer)
+            glViewportIndexedf(layer, 0.f, 0.f, batch[layer]->_width, batch[layer]->_height);
+        GlStateCache::get().enable(GL_DEPTH_TEST);
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            auto& obj = objects[i];
+            Values fill;
+            obj->getAttribute("fill", fill);
+            obj->setAttribute("fill", {"primitiveId"});
+
+            obj->activate(true);
+            obj->setLayeredViewProjectionMatrices(viewMatrices, projectionMatrices, layerMasks[i]);
+            obj->draw();
+            obj->deactivate();
+
+            obj->setAttribute("fill", fill);
+        }
+
+        GlStateCache::get().disable(GL_DEPTH_TEST);
+        _visibilityFbo->unbindDraw();
+
+        // Update the vertices visibility for all cameras, then their contribution. All objects
+        // were rendered as they may hide each other, but only the requested ones are updated
+        auto isUpdated = [&](const shared_ptr<Object>& obj) { return onlyObjects.empty() || find(onlyObjects.begin(), onlyObjects.end(), obj) != onlyObjects.end(); };
+
+        GlStateCache::get().bindTextureUnit(0, _visibilityFbo->getColorTexture()->getTexId());
+        for (size_t i = 0; i < objects.size(); ++i)
+            if (isUpdated(objects[i]) && !objects[i]->hasBlendingMap())
+                objects[i]->transferVisibilityFromLayersToAttr(width, height, layerCount, primitiveIdShifts[i]);
+        GlStateCache::get().bindTextureUnit(0, 0);
+
+        for (auto& obj : objects)
+            if (isUpdated(obj) && !obj->hasBlendingMap())
+                obj->computeCamerasContribution(viewMatrices, projectionMatrices, blendWidths);
+
+        // Objects blended in texture space test the occlusion against the depth of the visibility rendering
+        vector<glm::vec2> viewportSizes;
+        for (auto& camera : batch)
+            viewportSizes.emplace_back(camera->_width, camera->_height);
+
+        GlStateCache::get().bindTextureUnit(0, _visibilityFbo->getDepthTexture()->getTexId());
+        for (auto& obj : objects)
+            if (isUpdated(obj) && obj->hasBlendingMap())
+                obj->computeCamerasContributionToMap(viewMatrices, projectionMatrices, blendWidths, viewportSizes);
+        GlStateCache::get().bindTextureUnit(0, 0);
+    }
+}
+
+/*************/
+void Camera::blendingTessellateForCurrentCamera(const vector<shared_ptr<Object>>& objects)
 {
     for (auto& o : _objects)
     {
         if (o.expired())
             continue;
         auto obj = o.lock();
+        if (!objects.empty() && find(objects.begin(), objects.end(), obj) == objects.end())
+            continue;
 
         obj->tessellateForThisCamera(computeViewMatrix(), computeProjectionMatrix(), glm::radians(_fov * _width / _height), glm::radians(_fov), _blendWidth, _blendPrecision);
     }
@@ -368,6 +506,7 @@ bool Camera::doCalibration()
 
         // Force camera update with the new parameters
         _updatedParams = true;
+        ++_updateCount;
     }
 
     _calibrationReprojectionError = minValue;
@@ -375,6 +514,18 @@ bool Camera::doCalibration()
     return true;
 }
 
+/*************/
+vector<double> Camera::getBlendingParameters()
+{
+    auto viewMatrix = computeViewMatrix();
+    auto projectionMatrix = computeProjectionMatrix();
+
+    vector<double> parameters(glm::value_ptr(viewMatrix), glm::value_ptr(viewMatrix) + 16);
+    parameters.insert(parameters.end(), glm::value_ptr(projectionMatrix), glm::value_ptr(projectionMatrix) + 16);
+    parameters.insert(parameters.end(), {_width, _height, _blendWidth, _blendPrecision});
+    return parameters;
+}
+
 /*************/
 void Camera::drawModelOnce(const std::string& modelName, const glm::dmat4& rtMatrix)
 {
@@ -427,6 +578,12 @@ Values Camera::pickVertex(float x, float y)
 
     // Get the depth at the given point
     auto depth = _outFbo->getDepthAt(realX, realY);
+    return pickVertexAtDepth(realX, realY, depth);
+}
+
+/*************/
+Values Camera::pickVertexAtDepth(float realX, float realY, float depth)
+{
     if (depth == 1.f)
         return Values();
 
@@ -463,6 +620,28 @@ Values Camera::pickFragment(float x, float y, float& fragDepth)
 
     // Get the depth at the given point
     auto depth = _outFbo->getDepthAt(realX, realY);
+    return pickFragmentAtDepth(realX, realY, depth, fragDepth);
+}
+
+/*************/
+void Camera::pickFragmentAsync(float x, float y, function<void(const Values&, float)> callback)
+{
+    float realX = x * _width;
+    float realY = y * _height;
+
+    auto weakThis = weak_ptr<BaseObject>(shared_from_this());
+    _outFbo->getDepthAtAsync(realX, realY, [=](float depth) {
+        if (weakThis.expired())
+            return;
+        float fragDepth = 0.f;
+        auto point = pickFragmentAtDepth(realX, realY, depth, fragDepth);
+        callback(point, fragDepth);
+    });
+}
+
+/*************/
+Values Camera::pickFragmentAtDepth(float realX, float realY, float depth, float& fragDepth)
+{
     if (depth == 1.f)
         return Values();
 
@@ -509,7 +688,26 @@ Values Camera::pickCalibrationPoint(float x, float y)
 /*************/
 Values Camera::pickVertexOrCalibrationPoint(float x, float y)
 {
-    Values vertex = pickVertex(x, y);
+    return selectVertexOrCalibrationPoint(x, y, pickVertex(x, y));
+}
+
+/*************/
+void Camera::pickVertexOrCalibrationPointAsync(float x, float y, function<void(const Values&)> callback)
+{
+    float realX = x * _width;
+    float realY = y * _height;
+
+    auto weakThis = weak_ptr<BaseObject>(shared_from_this());
+    _outFbo->getDepthAtAsync(realX, realY, [=](float depth) {
+        if (weakThis.expired())
+            return;
+        callback(selectVertexOrCalibrationPoint(x, y, pickVertexAtDepth(realX, realY, depth)));
+    });
+}
+
+/*************/
+Values Camera::selectVertexOrCalibrationPoint(float x, float y, const Values& vertex)
+{
     Values point = pickCalibrationPoint(x, y);
 
     dvec3 screenPoint(x * _width, y * _height, 0.0);
@@ -537,7 +735,81 @@ Values Camera::pickVertexOrCalibrationPoint(float x, float y)
 }
 
 /*************/
-void Camera::render()
+bool Camera::updateUniformBuffer()
+{
+    UniformBlock block;
+
+    vec2 colorBalance = colorBalanceFromTemperature(_colorTemperature);
+    block.wireframeColor = vec4(_wireframeColor);
+    block.attributes = vec4(_blendWidth, _brightness, 0.f, 0.f);
+    block.fovAndColorBalance = vec4(_fov * _width / _height * M_PI / 180.0, _fov * M_PI / 180.0, colorBalance.x, colorBalance.y);
+    block.flags.x = _showCameraCount;
+
+    if (_colorLUT.size() == 768 && _isColorLUTActivated)
+    {
+        block.flags.y = 1;
+        for (int i = 0; i < 256; ++i)
+            block.colorLUT[i] = vec4(_colorLUT[i * 3].as<float>(), _colorLUT[i * 3 + 1].as<float>(), _colorLUT[i * 3 + 2].as<float>(), 0.f);
+        for (int u = 0; u < 3; ++u)
+            block.colorMixMatrix[u] = vec4(_colorMixMatrix[u], 0.f);
+    }
+
+    // Only upload the block if it changed since the last frame
+    bool updated = false;
+    if (!_uniformBufferReady || memcmp(&block, &_uniformBlock, sizeof(UniformBlock)) != 0)
+    {
+        _uniformBlock = block;
+        glNamedBufferSubData(_uniformBuffer, 0, sizeof(UniformBlock), &_uniformBlock);
+        _uniformBufferReady = true;
+        updated = true;
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, Shader::cameraBlockBinding, _uniformBuffer);
+    return updated;
+}
+
+/*************/
+bool Camera::canRenderLayered() const
+{
+    // Calibration display and additional drawables are specific to each camera
+    if (_hidden || _drawFrame || _flashBG || _displayCalibration || _displayAllCalibrations || !_drawables.empty() || _objects.empty())
+        return false;
+
+    for (auto& o : _objects)
+    {
+        auto obj = o.lock();
+        if (!obj || obj->getFill() != "texture")
+            return false;
+    }
+
+    return true;
+}
+
+/*************/
+bool Camera::isLayerCompatible(const Camera& other) const
+{
+    if (!canRenderLayered() || !other.canRenderLayered())
+        return false;
+
+    // Compare the sizes the cameras will have when rendered
+    auto width = _newWidth != 0 ? _newWidth : _width;
+    auto height = _newHeight != 0 ? _newHeight : _height;
+    auto otherWidth = other._newWidth != 0 ? other._newWidth : other._width;
+    auto otherHeight = other._newHeight != 0 ? other._newHeight : other._height;
+    if (width != otherWidth || height != otherHeight || _multisample != other._multisample || _render16bits != other._render16bits)
+        return false;
+
+    if (_objects.size() != other._objects.size())
+        return false;
+    for (size_t i = 0; i < _objects.size(); ++i)
+        if (_objects[i].lock() != other._objects[i].lock())
+            return false;
+
+    return true;
+}
+
+/*************/
+void Camera::updateFramebuffers()
 {
     if (_updateColorDepth)
     {
@@ -565,12 +837,55 @@ void Camera::render()
         _msFbo->setSize(spec.width, spec.height);
         _outFbo->setSize(spec.width, spec.height);
     }
+}
+
+/*************/
+bool Camera::updateRenderSignature(bool uniformsUpdated)
+{
+    // Skip the render if none of its inputs changed since the last frame, the output framebuffer
+    // still holding the same image. Calibration display and drawables are interactive, so always rendered.
+    // They are part of the signature too, for the first frame without them to clear them from the output
+    vector<int64_t> signature{static_cast<int64_t>(_width),
+        static_cast<int64_t>(_height),
+        _hidden,
+        _drawFrame,
+        _flashBG,
+        _displayCalibration,
+        _displayAllCalibrations,
+        !_drawables.empty(),
+        static_cast<int64_t>(getUpdateCount())};
+    for (auto& o : _objects)
+        if (auto obj = o.lock())
+            obj->appendRenderSignature(signature);
+
+    if (!uniformsUpdated && !_displayCalibration && !_displayAllCalibrations && _drawables.empty() && signature == _renderSignature)
+    {
+        _renderSkipped = true;
+        _culledObjectCount = 0;
+        return false;
+    }
+    _renderSignature = std::move(signature);
+    _renderSkipped = false;
+    return true;
+}
+
+/*************/
+void Camera::render()
+{
+    updateFramebuffers();
+    if (!_msFbo || !_outFbo)
+        return;
+
+    // Camera uniforms are shared by all objects through a uniform block
+    bool uniformsUpdated = updateUniformBuffer();
+    if (!updateRenderSignature(uniformsUpdated))
+        return;
 
 #ifdef DEBUG
     glGetError();
 #endif
-    glViewport(0, 0, _width, _height);
-    glEnable(GL_DEPTH_TEST);
+    GlStateCache::get().viewport(0, 0, _width, _height);
+    GlStateCache::get().enable(GL_DEPTH_TEST);
 
     if (_multisample)
         _msFbo->bindDraw();
@@ -581,7 +896,7 @@ void Camera::render()
     {
         glClearColor(1.0, 0.5, 0.0, 1.0);
         glClear(GL_COLOR_BUFFER_BIT);
-        glEnable(GL_SCISSOR_TEST);
+        GlStateCache::get().enable(GL_SCISSOR_TEST);
         glScissor(SCISSOR_WIDTH, SCISSOR_WIDTH, _width - SCISSOR_WIDTH * 2, _height - SCISSOR_WIDTH * 2);
     }
 
@@ -591,47 +906,33 @@ void Camera::render()
         glClearColor(0.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    _culledObjectCount = 0;
     if (!_hidden)
     {
-        // Draw the objects
+        auto viewMatrix = computeViewMatrix();
+        auto projectionMatrix = computeProjectionMatrix();
+
+        // Draw the objects, culling the ones outside of the view frustum
         for (auto& o : _objects)
         {
             auto obj = o.lock();
             if (!obj)
                 continue;
 
-            obj->activate();
-
-            vec2 colorBalance = colorBalanceFromTemperature(_colorTemperature);
-            obj->getShader()->setAttribute("uniform", {"_wireframeColor", _wireframeColor.x, _wireframeColor.y, _wireframeColor.z, _wireframeColor.w});
-            obj->getShader()->setAttribute("uniform", {"_cameraAttributes", _blendWidth, _brightness});
-            obj->getShader()->setAttribute("uniform", {"_fovAndColorBalance", _fov * _width / _height * M_PI / 180.0, _fov * M_PI / 180.0, colorBalance.x, colorBalance.y});
-            obj->getShader()->setAttribute("uniform", {"_showCameraCount", (int)_showCameraCount});
-            if (_colorLUT.size() == 768 && _isColorLUTActivated)
-            {
-                obj->getShader()->setAttribute("uniform", {"_colorLUT", _colorLUT});
-                obj->getShader()->setAttribute("uniform", {"_isColorLUT", 1});
-
-                Values m(10);
-                m[0] = "_colorMixMatrix";
-                for (int u = 0; u < 3; ++u)
-                    for (int v = 0; v < 3; ++v)
-                        m[u * 3 + v + 1] = _colorMixMatrix[u][v];
-                obj->getShader()->setAttribute("uniform", m);
-            }
-            else
+            if (!obj->isInFrustum(viewMatrix, projectionMatrix))
             {
-                obj->getShader()->setAttribute("uniform", {"_isColorLUT", 0});
+                ++_culledObjectCount;
+                continue;
             }
 
-            obj->setViewProjectionMatrix(computeViewMatrix(), computeProjectionMatrix());
+            // The on-screen footprint of the textures is not known when projected onto objects
+            obj->setTexturesSampledSize(0, 0);
+            obj->activate();
+            obj->setViewProjectionMatrix(viewMatrix, projectionMatrix);
             obj->draw();
             obj->deactivate();
         }
 
-        auto viewMatrix = computeViewMatrix();
-        auto projectionMatrix = computeProjectionMatrix();
-
         // Draw the calibrations points of all the cameras
         if (_displayAllCalibrations)
         {
@@ -730,8 +1031,8 @@ void Camera::render()
     }
 
     if (_drawFrame)
-        glDisable(GL_SCISSOR_TEST);
-    glDisable(GL_DEPTH_TEST);
+        GlStateCache::get().disable(GL_SCISSOR_TEST);
+    GlStateCache::get().disable(GL_DEPTH_TEST);
 
     // Blit the result to resolve the multisampling
     if (_multisample)
@@ -753,6 +1054,136 @@ void Camera::render()
     return;
 }
 
+/*************/
+void Camera::renderLayered(const vector<shared_ptr<Camera>>& cameras)
+{
+    if (cameras.empty() || cameras.size() > static_cast<size_t>(Shader::maxCameraLayers))
+    {
+        Log::get() << Log::WARNING << "Camera::" << __FUNCTION__ << " - Cannot render " << cameras.size() << " cameras in a single pass, rendering them separately" << Log::endl;
+        for (auto& camera : cameras)
+            camera->render();
+        return;
+    }
+
+    // The whole pass is skipped only if none of the cameras changed
+    bool needsRender = false;
+    for (auto& camera : cameras)
+    {
+        camera->updateFramebuffers();
+        bool uniformsUpdated = camera->updateUniformBuffer();
+        needsRender |= camera->updateRenderSignature(uniformsUpdated);
+    }
+
+    if (!needsRender)
+        return;
+
+    // Shared resources are held by this camera and created on first use
+    if (!_layeredFbo)
+    {
+        _layeredFbo = make_unique<Framebuffer>(_root);
+        glCreateFramebuffers(1, &_layerReadFbo);
+        glCreateBuffers(1, &_layersBuffer);
+    }
+
+    int layerCount = cameras.size();
+    vector<int> layeredFboParameters{static_cast<int>(_width), static_cast<int>(_height), layerCount, _multisample, _render16bits};
+    if (layeredFboParameters != _layeredFboParameters)
+    {
+        _layeredFbo->setParameters(_multisample, _render16bits, false, false, layerCount);
+        _layeredFbo->setSize(_width, _height);
+        _layeredFboParameters = layeredFboParameters;
+    }
+
+    // Uniforms of all cameras, read by the shaders from the layer index
+    vector<UniformBlock> layerBlocks;
+    for (auto& camera : cameras)
+        layerBlocks.push_back(camera->_uniformBlock);
+    if (layerBlocks.size() != _layerBlocks.size() || memcmp(layerBlocks.data(), _layerBlocks.data(), layerBlocks.size() * sizeof(UniformBlock)) != 0)
+    {
+        glNamedBufferData(_layersBuffer, layerBlocks.size() * sizeof(UniformBlock), layerBlocks.data(), GL_DYNAMIC_DRAW);
+        _layerBlocks = std::move(layerBlocks);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Shader::cameraLayersBinding, _layersBuffer);
+
+    vector<dmat4> viewMatrices;
+    vector<dmat4> projectionMatrices;
+    for (auto& camera : cameras)
+    {
+        viewMatrices.push_back(camera->computeViewMatrix());
+        projectionMatrices.push_back(camera->computeProjectionMatrix());
+        camera->_renderSkipped = false;
+        camera->_culledObjectCount = 0;
+    }
+
+#ifdef DEBUG
+    glGetError();
+#endif
+    GlStateCache::get().viewport(0, 0, _width, _height);
+    GlStateCache::get().enable(GL_DEPTH_TEST);
+
+    _layeredFbo->bindDraw();
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // All cameras share the same objects, drawn once for all layers. Objects
+    // are culled only if outside of all the frustums
+    for (auto& o : _objects)
+    {
+        auto obj = o.lock();
+        if (!obj)
+            continue;
+
+        bool isVisible = false;
+        for (int layer = 0; layer < layerCount; ++layer)
+        {
+            if (obj->isInFrustum(viewMatrices[layer], projectionMatrices[layer]))
+                isVisible = true;
+            else
+                ++cameras[layer]->_culledObjectCount;
+        }
+
+        if (!isVisible)
+            continue;
+
+        obj->setTexturesSampledSize(0, 0);
+        obj->activate(true);
+        obj->setLayeredViewProjectionMatrices(viewMatrices, projectionMatrices);
+        obj->draw();
+        obj->deactivate();
+    }
+
+    GlStateCache::get().disable(GL_DEPTH_TEST);
+    _layeredFbo->unbindDraw();
+
+    // Copy each layer to the output of its camera, resolving the multisampling if needed
+    auto colorTexture = _layeredFbo->getColorTexture()->getTexId();
+    auto depthTexture = _layeredFbo->getDepthTexture()->getTexId();
+    for (int layer = 0; layer < layerCount; ++layer)
+    {
+        auto& camera = cameras[layer];
+        glNamedFramebufferTextureLayer(_layerReadFbo, GL_COLOR_ATTACHMENT0, colorTexture, 0, layer);
+        glNamedFramebufferTextureLayer(_layerReadFbo, GL_DEPTH_ATTACHMENT, depthTexture, 0, layer);
+        glBlitNamedFramebuffer(_layerReadFbo,
+            camera->_outFbo->getFboId(),
+            0,
+            0,
+            _width,
+            _height,
+            0,
+            0,
+            camera->_outFbo->getWidth(),
+            camera->_outFbo->getHeight(),
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+            GL_NEAREST);
+    }
+
+#ifdef DEBUG
+    GLenum error = glGetError();
+    if (error)
+        Log::get() << Log::WARNING << _type << "::" << __FUNCTION__ << " - Error while rendering the cameras: " << error << Log::endl;
+#endif
+}
+
 /*************/
 bool Camera::addCalibrationPoint(const Values& worldPoint)
 {
@@ -1,9 +1,27 @@
 #include "./controller_blender.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
 #include "./camera.h"
 #include "./geometry.h"
+#include "./log.h"
+#include "./mesh.h"
 #include "./object.h"
+#include "./osUtils.h"
 #include "./scene.h"
+#include "./timer.h"
 
 using namespace std;
 
@@ -54,55 +72,196 @@ void Blender::update()
 
     if (_computeBlending && (!_blendingComputed || _continuousBlending))
     {
+        // Everything is recomputed the first time, or when explicitly requested
+        bool fullUpdate = !_blendingComputed;
         _blendingComputed = true;
 
         // Only the master scene computes the blending
         if (isMaster)
         {
             auto cameras = getObjectsOfType("camera");
-            auto objects = getObjLinkedToCameras();
+            if (cameras.size() == 0)
+                return;
 
-            if (cameras.size() != 0)
+            // Find the cameras which changed since the last computation. The blending of the objects
+            // they see, or used to see, has to be updated for all the cameras seeing these objects
+            auto links = getObjectLinks();
+            unordered_map<string, CameraBlendingState> cameraStates;
+            unordered_set<string> affectedObjectNames;
+            for (auto& it : cameras)
             {
-                for (auto& it : objects)
-                    dynamic_pointer_cast<Object>(it)->resetTessellation();
+                auto camera = dynamic_pointer_cast<Camera>(it);
+                auto& state = cameraStates[camera->getName()];
+                state.parameters = camera->getBlendingParameters();
+                for (auto& linked : links[camera->getName()])
+                    if (dynamic_pointer_cast<Object>(getObject(linked)))
+                        state.objects.push_back(linked);
 
-                // Tessellate
-                for (auto& it : cameras)
-                {
-                    auto camera = dynamic_pointer_cast<Camera>(it);
-                    camera->computeVertexVisibility();
-                    camera->blendingTessellateForCurrentCamera();
-                }
+                auto previousStateIt = _cameraBlendingStates.find(camera->getName());
+                if (!fullUpdate && previousStateIt != _cameraBlendingStates.end() && previousStateIt->second.parameters == state.parameters
+                    && previousStateIt->second.objects == state.objects)
+                    continue;
+
+                affectedObjectNames.insert(state.objects.begin(), state.objects.end());
+                if (previousStateIt != _cameraBlendingStates.end())
+                    affectedObjectNames.insert(previousStateIt->second.objects.begin(), previousStateIt->second.objects.end());
+            }
 
-                for (auto& it : objects)
-                    dynamic_pointer_cast<Object>(it)->resetBlendingAttribute();
+            for (auto& previousState : _cameraBlendingStates)
+                if (cameraStates.find(previousState.first) == cameraStates.end())
+                    affectedObjectNames.insert(previousState.second.objects.begin(), previousState.second.objects.end());
+            _cameraBlendingStates = std::move(cameraStates);
 
-                // Compute each camera contribution
-                for (auto& it : cameras)
+            // Objects which moved or changed sideness are affected too, whatever the cameras seeing them
+            unordered_map<string, vector<double>> objectStates;
+            for (auto& cameraState : _cameraBlendingStates)
+            {
+                for (auto& name : cameraState.second.objects)
                 {
-                    auto camera = dynamic_pointer_cast<Camera>(it);
-                    camera->computeVertexVisibility();
-                    camera->computeBlendingContribution();
+                    if (objectStates.find(name) != objectStates.end())
+                        continue;
+                    auto object = dynamic_pointer_cast<Object>(getObject(name));
+                    if (!object)
+                        continue;
+
+                    auto& parameters = objectStates[name];
+                    parameters = getObjectBlendingParameters(object);
+                    auto previousStateIt = _objectBlendingStates.find(name);
+                    if (previousStateIt == _objectBlendingStates.end() || previousStateIt->second != parameters)
+                        affectedObjectNames.insert(name);
                 }
             }
-            else
+            _objectBlendingStates = std::move(objectStates);
+
+            vector<shared_ptr<Object>> affectedObjects;
+            for (auto& name : affectedObjectNames)
+                if (auto object = dynamic_pointer_cast<Object>(getObject(name)))
+                    affectedObjects.push_back(object);
+
+            // Only the cameras seeing the affected objects take part in the computation
+            vector<shared_ptr<Camera>> affectedCameras;
+            for (auto& it : cameras)
             {
-                return;
+                auto& objectNames = _cameraBlendingStates[it->getName()].objects;
+                if (any_of(objectNames.begin(), objectNames.end(), [&](const string& name) { return affectedObjectNames.count(name) != 0; }))
+                    affectedCameras.push_back(dynamic_pointer_cast<Camera>(it));
             }
 
-            for (auto& object : objects)
-                object->setAttribute("activateVertexBlending", {1});
-
-            // If there are some other scenes, send them the blending
-            auto geometries = getObjectsOfType("geometry");
-            for (auto& geometry : geometries)
+            bool notificationDeferred = false;
+            if (!affectedObjects.empty())
             {
-                auto serializedGeometry = dynamic_pointer_cast<Geometry>(geometry)->serialize();
-                sendBuffer(geometry->getName(), std::move(serializedGeometry));
+                Timer::get() << "blendingCompute";
+
+                vector<shared_ptr<Geometry>> geometries;
+                for (auto& object : affectedObjects)
+                    for (auto& linked : links[object->getName()])
+                        if (auto geometry = dynamic_pointer_cast<Geometry>(getObject(linked)))
+                            geometries.push_back(geometry);
+
+                // At startup, the result of a previous computation with the same meshes, cameras and objects may be on disk
+                auto cacheKey = fullUpdate ? getBlendingCacheKey(affectedObjects) : string();
+                unordered_map<string, shared_ptr<SerializedObject>> cachedBuffers;
+                bool cacheHit = loadBlendingCache(cacheKey, cachedBuffers)
+                    && all_of(geometries.begin(), geometries.end(), [&](const shared_ptr<Geometry>& geometry) { return cachedBuffers.count(geometry->getName()) != 0; });
+
+                bool textureBlending = _blendingMethod == "texture";
+                vector<pair<string, shared_ptr<SerializedObject>>> serializedGeometries;
+                if (cacheHit)
+                {
+                    // The geometries take ownership of the cached buffers, the other scenes get a copy
+                    for (auto& geometry : geometries)
+                    {
+                        auto& buffer = cachedBuffers[geometry->getName()];
+                        serializedGeometries.emplace_back(geometry->getName(), make_shared<SerializedObject>(*buffer));
+                        geometry->deserialize(buffer);
+                    }
+
+                    for (auto& object : affectedObjects)
+                    {
+                        object->setAttribute("activateVertexBlending", {textureBlending ? 0 : 1});
+                        object->setAttribute("activateTextureBlending", {textureBlending ? 1 : 0});
+                    }
+
+                    Log::get() << Log::MESSAGE << "Blender::" << __FUNCTION__ << " - Blending loaded from the cache" << Log::endl;
+                }
+                else
+                {
+                    // Blending in texture space is done on the original geometry, in the blending maps
+                    for (auto& object : affectedObjects)
+                    {
+                        object->resetTessellation();
+                        object->resetBlendingMap(textureBlending ? _blendingMapResolution : 0);
+                    }
+
+                    // Tessellate. The visibility is rendered with all objects, as unaffected ones may hide affected ones
+                    if (!textureBlending)
+                    {
+                        for (auto& camera : affectedCameras)
+                        {
+                            camera->computeVertexVisibility();
+                            camera->blendingTessellateForCurrentCamera(affectedObjects);
+                        }
+
+                        for (auto& object : affectedObjects)
+                            object->resetBlendingAttribute();
+                    }
+
+                    // Compute each camera contribution, the visibility of all cameras being rendered at once
+                    if (!affectedCameras.empty())
+                        affectedCameras[0]->computeBlendingContributions(affectedCameras, affectedObjects);
+
+                    for (auto& object : affectedObjects)
+                    {
+                        object->setAttribute("activateVertexBlending", {textureBlending ? 0 : 1});
+                        object->setAttribute("activateTextureBlending", {textureBlending ? 1 : 0});
+                    }
+
+                    // The geometries are read back on a later frame, not to stall the rendering. They are then sent to
+                    // the other scenes and saved to the cache, and the secondary scenes are notified once all of them were sent
+                    if (!geometries.empty())
+                    {
+                        auto weakBlender = weak_ptr<BaseObject>(shared_from_this());
+                        auto readGeometries = make_shared<vector<pair<string, shared_ptr<SerializedObject>>>>();
+                        auto geometriesCount = geometries.size();
+                        for (auto& geometry : geometries)
+                        {
+                            auto geometryName = geometry->getName();
+                            geometry->serializeAsync([=](shared_ptr<SerializedObject> serializedGeometry) {
+                                if (weakBlender.expired())
+                                    return;
+
+                                readGeometries->emplace_back(geometryName, serializedGeometry);
+                                if (readGeometries->size() != geometriesCount)
+                                    return;
+
+                                // Geometries which could not be read back are skipped, but the secondary scenes are notified anyway
+                                auto allRead = true;
+                                for (auto& readGeometry : *readGeometries)
+                                {
+                                    if (readGeometry.second)
+                                        sendBuffer(readGeometry.first, readGeometry.second);
+                                    else
+                                        allRead = false;
+                                }
+                                if (!cacheKey.empty() && allRead)
+                                    saveBlendingCache(cacheKey, *readGeometries);
+                                setObjectAttribute(_name, "blendingUpdated", {});
+                            });
+                        }
+                        notificationDeferred = true;
+                    }
+                }
+
+                Timer::get() >> "blendingCompute";
+
+                // If there are some other scenes, send them the geometries loaded from the cache
+                for (auto& serializedGeometry : serializedGeometries)
+                    sendBuffer(serializedGeometry.first, serializedGeometry.second);
             }
 
-            setObjectAttribute(_name, "blendingUpdated", {});
+            // Secondary scenes wait for this notification, even if nothing changed
+            if (!notificationDeferred)
+                setObjectAttribute(_name, "blendingUpdated", {});
         }
         // The non-master scenes only need to activate blending
         else
@@ -113,9 +272,13 @@ void Blender::update()
                 _vertexBlendingCondition.wait_for(updateBlendingLock, chrono::seconds(1));
             _vertexBlendingReceptionStatus = false;
 
+            auto textureBlending = _blendingMethod == "texture";
             auto objects = getObjLinkedToCameras();
             for (auto& object : objects)
-                object->setAttribute("activateVertexBlending", {1});
+            {
+                object->setAttribute("activateVertexBlending", {textureBlending ? 0 : 1});
+                object->setAttribute("activateTextureBlending", {textureBlending ? 1 : 0});
+            }
         }
     }
     // This deactivates the blending
@@ -137,10 +300,232 @@ void Blender::update()
         }
 
         for (auto& object : objects)
+        {
             object->setAttribute("activateVertexBlending", {0});
+            object->setAttribute("activateTextureBlending", {0});
+        }
     }
 }
 
+/*************/
+const string& Blender::getBlendingCachePath()
+{
+    static string cachePath = []() -> string {
+        string path;
+        auto cacheEnv = getenv(SPLASH_BLENDING_CACHE_ENV);
+        if (cacheEnv)
+            path = string(cacheEnv);
+        else
+            path = Utils::getHomePath() + "/.cache/splash/blending";
+
+        if (path.empty())
+            return {};
+
+        // Create the directory hierarchy if needed
+        for (auto pos = path.find('/', 1); pos != string::npos; pos = path.find('/', pos + 1))
+            mkdir(path.substr(0, pos).c_str(), 0755);
+        mkdir(path.c_str(), 0755);
+
+        if (!Utils::isDir(path))
+        {
+            Log::get() << Log::WARNING << "Blender::" << __FUNCTION__ << " - Unable to create the blending cache directory " << path << ", blending cache disabled" << Log::endl;
+            return {};
+        }
+
+        return path + "/";
+    }();
+
+    return cachePath;
+}
+
+/*************/
+uint64_t Blender::hashCacheData(const char* data, size_t size, uint64_t hash)
+{
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/*************/
+vector<double> Blender::getObjectBlendingParameters(const shared_ptr<Object>& object)
+{
+    vector<double> parameters;
+    auto modelMatrix = object->getModelMatrix();
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            parameters.push_back(modelMatrix[c][r]);
+
+    Values sideness;
+    if (object->getAttribute("sideness", sideness) && !sideness.empty())
+        parameters.push_back(sideness[0].as<int>());
+
+    return parameters;
+}
+
+/*************/
+string Blender::getBlendingCacheKey(const vector<shared_ptr<Object>>& objects)
+{
+    if (getBlendingCachePath().empty())
+        return {};
+
+    ostringstream key;
+    key << setprecision(numeric_limits<double>::max_digits10);
+
+    key << "#method " << _blendingMethod << " " << _blendingMapResolution << "\n";
+
+    // Cameras and objects are sorted by name, as their order does not change the blending
+    map<string, const CameraBlendingState*> cameraStates;
+    for (auto& state : _cameraBlendingStates)
+        cameraStates[state.first] = &state.second;
+
+    for (auto& state : cameraStates)
+    {
+        key << "#camera " << state.first << "\n";
+        for (auto& value : state.second->parameters)
+            key << value << " ";
+        for (auto& object : state.second->objects)
+            key << object << " ";
+        key << "\n";
+    }
+
+    auto sortedObjects = objects;
+    sort(sortedObjects.begin(), sortedObjects.end(), [](const shared_ptr<Object>& a, const shared_ptr<Object>& b) { return a->getName() < b->getName(); });
+
+    auto links = getObjectLinks();
+    for (auto& object : sortedObjects)
+    {
+        key << "#object " << object->getName() << "\n";
+        for (auto& value : getObjectBlendingParameters(object))
+            key << value << " ";
+        key << "\n";
+
+        for (auto& geometryName : links[object->getName()])
+        {
+            if (!dynamic_pointer_cast<Geometry>(getObject(geometryName)))
+                continue;
+
+            key << "#geometry " << geometryName << "\n";
+            for (auto& meshName : links[geometryName])
+            {
+                auto mesh = dynamic_pointer_cast<Mesh>(getObject(meshName));
+                if (!mesh)
+                    continue;
+
+                // The mesh content is summarized by its hash, a mesh not loaded yet can not be matched
+                auto vertices = mesh->getVertCoords();
+                if (vertices.empty())
+                    return {};
+                auto uvs = mesh->getUVCoords();
+                auto normals = mesh->getNormals();
+                auto hash = hashCacheData(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(float));
+                hash = hashCacheData(reinterpret_cast<const char*>(uvs.data()), uvs.size() * sizeof(float), hash);
+                hash = hashCacheData(reinterpret_cast<const char*>(normals.data()), normals.size() * sizeof(float), hash);
+                key << "#mesh " << meshName << " " << vertices.size() << " " << hash << "\n";
+            }
+        }
+    }
+
+    return key.str();
+}
+
+/*************/
+bool Blender::loadBlendingCache(const string& key, unordered_map<string, shared_ptr<SerializedObject>>& buffers)
+{
+    if (key.empty())
+        return false;
+
+    auto filename = getBlendingCachePath() + to_string(std::hash<string>()(key)) + ".bin";
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(uint64_t) + sizeof(uint32_t)))
+    {
+        close(fd);
+        return false;
+    }
+
+    // The file is mapped instead of read, the buffers being copied only once into the serialized objects
+    size_t fileSize = fileStat.st_size;
+    auto mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    auto data = static_cast<char*>(mapping);
+    auto end = data + fileSize;
+    auto readValue = [&](void* value, size_t size) {
+        if (static_cast<size_t>(end - data) < size)
+            return false;
+        memcpy(value, data, size);
+        data += size;
+        return true;
+    };
+
+    uint64_t keyHash;
+    uint32_t bufferCount;
+    bool valid = readValue(&keyHash, sizeof(keyHash)) && readValue(&bufferCount, sizeof(bufferCount)) && keyHash == hashCacheData(key.data(), key.size());
+
+    for (uint32_t i = 0; valid && i < bufferCount; ++i)
+    {
+        uint32_t nameSize;
+        uint64_t bufferSize;
+        valid = readValue(&nameSize, sizeof(nameSize)) && static_cast<size_t>(end - data) >= nameSize;
+        if (!valid)
+            break;
+        auto name = string(data, nameSize);
+        data += nameSize;
+
+        // Checked beforehand, for the geometries not to be left half updated
+        valid = readValue(&bufferSize, sizeof(bufferSize)) && static_cast<uint64_t>(end - data) >= bufferSize && Geometry::isSerializedGeometryValid(data, bufferSize);
+        if (!valid)
+            break;
+
+        buffers[name] = make_shared<SerializedObject>(data, data + bufferSize);
+        data += bufferSize;
+    }
+
+    munmap(mapping, fileSize);
+
+    if (!valid)
+        buffers.clear();
+    return valid;
+}
+
+/*************/
+void Blender::saveBlendingCache(const string& key, const vector<pair<string, shared_ptr<SerializedObject>>>& buffers)
+{
+    // Write to a temporary file first, for concurrent processes not to read a partial file
+    auto filename = getBlendingCachePath() + to_string(std::hash<string>()(key)) + ".bin";
+    auto tmpFilename = filename + "." + to_string(getpid());
+    ofstream out(tmpFilename, ios::out | ios::binary);
+    if (!out)
+        return;
+
+    auto keyHash = hashCacheData(key.data(), key.size());
+    uint32_t bufferCount = buffers.size();
+    out.write(reinterpret_cast<const char*>(&keyHash), sizeof(keyHash));
+    out.write(reinterpret_cast<const char*>(&bufferCount), sizeof(bufferCount));
+    for (auto& buffer : buffers)
+    {
+        uint32_t nameSize = buffer.first.size();
+        uint64_t bufferSize = buffer.second->size();
+        out.write(reinterpret_cast<const char*>(&nameSize), sizeof(nameSize));
+        out.write(buffer.first.data(), nameSize);
+        out.write(reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+        out.write(buffer.second->data(), bufferSize);
+    }
+    out.close();
+
+    if (!out || rename(tmpFilename.c_str(), filename.c_str()) != 0)
+        remove(tmpFilename.c_str());
+}
+
 /*************/
 void Blender::registerAttributes()
 {
@@ -177,6 +562,35 @@ void Blender::registerAttributes()
         {'s'});
     setAttributeDescription("mode", "Set the blending mode. Can be 'none', 'once' or 'continuous'");
 
+    addAttribute("method",
+        [&](const Values& args) {
+            auto method = args[0].as<string>();
+            if (method != "vertex" && method != "texture")
+                return false;
+
+            if (method != _blendingMethod)
+                forceUpdate();
+            _blendingMethod = method;
+            return true;
+        },
+        [&]() -> Values { return {_blendingMethod}; },
+        {'s'});
+    setAttributeDescription("method",
+        "Set the blending method. Can be 'vertex', to tessellate the objects and store the blending in the vertices, or 'texture', to store it in a map in texture space. "
+        "The latter needs the objects texture coordinates to be in [0, 1] and not to overlap");
+
+    addAttribute("mapResolution",
+        [&](const Values& args) {
+            auto resolution = std::max(64, std::min(8192, args[0].as<int>()));
+            if (resolution != _blendingMapResolution && _blendingMethod == "texture")
+                forceUpdate();
+            _blendingMapResolution = resolution;
+            return true;
+        },
+        [&]() -> Values { return {_blendingMapResolution}; },
+        {'n'});
+    setAttributeDescription("mapResolution", "Set the width and height of the blending maps, when blending in texture space");
+
     addAttribute("blendingUpdated", [&](const Values& args) {
         _vertexBlendingReceptionStatus = true;
         _vertexBlendingCondition.notify_one();
@@ -88,6 +88,7 @@ Gui::~Gui()
     Log::get() << Log::DEBUGGING << "Gui::~Gui - Destructor" << Log::endl;
 #endif
 
+    GlStateCache::get().forgetTexture(_imFontTextureId);
     glDeleteTextures(1, &_imFontTextureId);
     glDeleteProgram(_imGuiShaderHandle);
     glDeleteBuffers(1, &_imGuiVboHandle);
@@ -769,7 +770,7 @@ void Gui::render()
         _wasVisible = _isVisible;
 
         _fbo->bindDraw();
-        glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+        GlStateCache::get().viewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
         glClearColor(0.0, 0.0, 0.0, 0.0);
         glClear(GL_COLOR_BUFFER_BIT);
         if (_isVisible || _showAbout)
@@ -1001,12 +1002,13 @@ void Gui::initImGui(int width, int height)
     io.Fonts->GetTexDataAsRGBA32(&pixels, &w, &h);
 
     // Set GL texture for font
+    GlStateCache::get().forgetTexture(_imFontTextureId);
     glDeleteTextures(1, &_imFontTextureId);
-    glGenTextures(1, &_imFontTextureId);
-    glBindTexture(GL_TEXTURE_2D, _imFontTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glCreateTextures(GL_TEXTURE_2D, 1, &_imFontTextureId);
+    glTextureParameteri(_imFontTextureId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(_imFontTextureId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureStorage2D(_imFontTextureId, 1, GL_RGBA8, w, h);
+    glTextureSubImage2D(_imFontTextureId, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
     io.Fonts->TexID = (void*)(intptr_t)_imFontTextureId;
 
     // Init clipboard callbacks
@@ -1140,6 +1142,9 @@ void Gui::initImWidgets()
         stream << "  GUI rendering: " << setprecision(4) << gui << " ms\n";
         stream << "  Windows rendering: " << setprecision(4) << win << " ms\n";
         stream << "  Swapping and events: " << setprecision(4) << buf << " ms\n";
+        stream << "  Last blending computation: " << setprecision(4) << Timer::get()["blendingCompute"] * 0.001 << " ms\n";
+        stream << "  Skipped cameras: " << Timer::get()["skippedCameras"] << ", culled objects: " << Timer::get()["culledObjects"] << "\n";
+        stream << "  GL state changes: " << Timer::get()["glStateChanges"] << " / " << Timer::get()["glCalls"] << " calls\n";
 
         return stream.str();
     });
@@ -1208,13 +1213,13 @@ void Gui::imGuiRenderDrawLists(ImDrawData* draw_data)
     if (!draw_data->CmdListsCount)
         return;
 
-    glEnable(GL_BLEND);
+    GlStateCache::get().enable(GL_BLEND);
     glBlendEquation(GL_FUNC_ADD);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_SCISSOR_TEST);
-    glActiveTexture(GL_TEXTURE0);
+    GlStateCache::get().disable(GL_CULL_FACE);
+    GlStateCache::get().disable(GL_DEPTH_TEST);
+    GlStateCache::get().enable(GL_SCISSOR_TEST);
+    GlStateCache::get().activeTexture(0);
 
     const float width = ImGui::GetIO().DisplaySize.x;
     const float height = ImGui::GetIO().DisplaySize.y;
@@ -1222,7 +1227,7 @@ void Gui::imGuiRenderDrawLists(ImDrawData* draw_data)
         {2.0f / width, 0.0f, 0.0f, 0.0f}, {0.0f, 2.0f / -height, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f, 0.0f}, {-1.0f, 1.0f, 0.0f, 1.0f},
     };
 
-    glUseProgram(_imGuiShaderHandle);
+    GlStateCache::get().useProgram(_imGuiShaderHandle);
     glUniform1i(_imGuiTextureLocation, 0);
     glUniformMatrix4fv(_imGuiProjMatrixLocation, 1, GL_FALSE, (float*)orthoProjection);
     glBindVertexArray(_imGuiVaoHandle);
@@ -1246,7 +1251,7 @@ void Gui::imGuiRenderDrawLists(ImDrawData* draw_data)
             }
             else
             {
-                glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+                GlStateCache::get().bindTextureUnit(0, (GLuint)(intptr_t)pcmd->TextureId);
                 glScissor((int)pcmd->ClipRect.x, (int)(height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
                 glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
             }
@@ -1257,11 +1262,11 @@ void Gui::imGuiRenderDrawLists(ImDrawData* draw_data)
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glUseProgram(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GlStateCache::get().useProgram(0);
+    GlStateCache::get().bindTextureUnit(0, 0);
 
-    glDisable(GL_SCISSOR_TEST);
-    glDisable(GL_BLEND);
+    GlStateCache::get().disable(GL_SCISSOR_TEST);
+    GlStateCache::get().disable(GL_BLEND);
 }
 
 /*************/
@@ -0,0 +1,335 @@
+#include "./dxt_compressor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+bool DxtCompressor::isSupported(const ImageBufferSpec& spec)
+{
+    if (spec.type != ImageBufferSpec::Type::UINT8 || spec.width == 0 || spec.height == 0 || spec.width % 4 != 0 || spec.height % 4 != 0)
+        return false;
+
+    return getLayout(spec) != Layout::Unsupported;
+}
+
+/*************/
+DxtCompressor::Layout DxtCompressor::getLayout(const ImageBufferSpec& spec)
+{
+    if (spec.bpp == 24 && spec.format == "RGB")
+        return Layout::RGB;
+    else if (spec.bpp == 24 && spec.format == "BGR")
+        return Layout::BGR;
+    else if (spec.bpp == 32 && spec.format == "RGBA")
+        return Layout::RGBA;
+    else if (spec.bpp == 32 && spec.format == "BGRA")
+        return Layout::BGRA;
+    else if (spec.bpp == 16 && spec.format == "YUYV")
+        return Layout::YUYV;
+    else if (spec.bpp == 16 && spec.format == "UYVY")
+        return Layout::UYVY;
+
+    return Layout::Unsupported;
+}
+
+/*************/
+bool DxtCompressor::compress(const ImageBuffer& input, ImageBuffer& output, Format format, Quality quality)
+{
+    auto inputSpec = input.getSpec();
+    if (!isSupported(inputSpec))
+        return false;
+
+    // Compressed images are stored as the Hap decoder does, one byte per channel with a single channel
+    ImageBufferSpec outputSpec;
+    if (format == Format::RGB_DXT1)
+        outputSpec = ImageBufferSpec(inputSpec.width, inputSpec.height / 2, 1, 8, ImageBufferSpec::Type::UINT8);
+    else
+        outputSpec = ImageBufferSpec(inputSpec.width, inputSpec.height, 1, 8, ImageBufferSpec::Type::UINT8);
+    outputSpec.format = getFormatName(format);
+    outputSpec.videoFrame = inputSpec.videoFrame;
+
+    if (output.getSpec() != outputSpec)
+        output = ImageBuffer(outputSpec);
+
+    const int blocksPerRow = inputSpec.width / 4;
+    const int blockRows = inputSpec.height / 4;
+    const int blockSize = format == Format::RGB_DXT1 ? 8 : 16;
+    const auto layout = getLayout(inputSpec);
+    const int stride = inputSpec.width * inputSpec.bpp / 8;
+    auto inputData = reinterpret_cast<const uint8_t*>(input.data());
+    auto outputData = reinterpret_cast<uint8_t*>(output.data());
+
+    auto compressRows = [=](int firstRow, int lastRow) {
+        Block block;
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            auto blockOutput = outputData + y * blocksPerRow * blockSize;
+            for (int x = 0; x < blocksPerRow; ++x)
+            {
+                fetchBlock(layout, inputData + y * 4 * stride, stride, x, block);
+                switch (format)
+                {
+                case Format::RGB_DXT1:
+                    encodeColorBlock(block, quality, blockOutput);
+                    break;
+                case Format::RGBA_DXT5:
+                    encodeAlphaBlock(block, blockOutput);
+                    encodeColorBlock(block, quality, blockOutput + 8);
+                    break;
+                case Format::YCoCg_DXT5:
+                    convertToYCoCg(block);
+                    encodeAlphaBlock(block, blockOutput);
+                    encodeColorBlock(block, quality, blockOutput + 8);
+                    break;
+                }
+                blockOutput += blockSize;
+            }
+        }
+    };
+
+    // Each worker compresses a contiguous range of block rows
+    int workers = std::max(1, std::min(static_cast<int>(thread::hardware_concurrency()), blockRows));
+    vector<future<void>> threads;
+    for (int w = 1; w < workers; ++w)
+        threads.push_back(async(launch::async, [=]() { compressRows(blockRows * w / workers, blockRows * (w + 1) / workers); }));
+    compressRows(0, blockRows / workers);
+    for (auto& thread : threads)
+        thread.wait();
+
+    return true;
+}
+
+/*************/
+string DxtCompressor::getFormatName(Format format)
+{
+    switch (format)
+    {
+    default:
+    case Format::RGB_DXT1:
+        return "RGB_DXT1";
+    case Format::RGBA_DXT5:
+        return "RGBA_DXT5";
+    case Format::YCoCg_DXT5:
+        return "YCoCg_DXT5";
+    }
+}
+
+/*************/
+void DxtCompressor::fetchBlock(Layout layout, const uint8_t* data, int stride, int blockX, Block& block)
+{
+    for (int j = 0; j < 4; ++j)
+    {
+        auto line = data + j * stride;
+        auto pixels = &block[j * 4];
+
+        switch (layout)
+        {
+        default:
+            break;
+        case Layout::RGB:
+        case Layout::BGR:
+        {
+            const int red = layout == Layout::RGB ? 0 : 2;
+            line += blockX * 12;
+            for (int i = 0; i < 4; ++i)
+            {
+                pixels[i][0] = line[i * 3 + red];
+                pixels[i][1] = line[i * 3 + 1];
+                pixels[i][2] = line[i * 3 + 2 - red];
+                pixels[i][3] = 255;
+            }
+            break;
+        }
+        case Layout::RGBA:
+        case Layout::BGRA:
+        {
+            const int red = layout == Layout::RGBA ? 0 : 2;
+            line += blockX * 16;
+            for (int i = 0; i < 4; ++i)
+            {
+                pixels[i][0] = line[i * 4 + red];
+                pixels[i][1] = line[i * 4 + 1];
+                pixels[i][2] = line[i * 4 + 2 - red];
+                pixels[i][3] = line[i * 4 + 3];
+            }
+            break;
+        }
+        case Layout::YUYV:
+        case Layout::UYVY:
+        {
+            // Two pixels share their chroma, with the same conversion as the yuv2rgb shader function
+            const int luma = layout == Layout::UYVY ? 1 : 0;
+            const int chroma = 1 - luma;
+            line += blockX * 8;
+            for (int i = 0; i < 4; ++i)
+            {
+                auto pair = line + (i / 2) * 4;
+                int y = pair[luma + (i % 2) * 2] - 16;
+                int u = pair[chroma] - 128;
+                int v = pair[chroma + 2] - 128;
+
+                pixels[i][0] = toByte(y + ((1437 * v) >> 10));
+                pixels[i][1] = toByte(y - ((352 * u + 731 * v) >> 10));
+                pixels[i][2] = toByte(y + ((1815 * u) >> 10));
+                pixels[i][3] = 255;
+            }
+            break;
+        }
+        }
+    }
+}
+
+/*************/
+void DxtCompressor::convertToYCoCg(Block& block)
+{
+    int co[16], cg[16];
+    int maxChroma = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int r = block[i][0], g = block[i][1], b = block[i][2];
+        co[i] = (r - b) / 2;
+        cg[i] = (2 * g - r - b) / 4;
+        block[i][3] = static_cast<uint8_t>((r + 2 * g + b + 2) / 4);
+        maxChroma = std::max(maxChroma, std::max(std::abs(co[i]), std::abs(cg[i])));
+    }
+
+    // Low chroma blocks are scaled up to use more of the available precision.
+    // The scale is stored in the blue channel, as (scale - 1) * 8
+    int scale = 1;
+    if (maxChroma < 32)
+        scale = 4;
+    else if (maxChroma < 64)
+        scale = 2;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        block[i][0] = toByte(co[i] * scale + 128);
+        block[i][1] = toByte(cg[i] * scale + 128);
+        block[i][2] = static_cast<uint8_t>((scale - 1) * 8);
+    }
+}
+
+/*************/
+void DxtCompressor::encodeColorBlock(const Block& block, Quality quality, uint8_t* output)
+{
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minColor[c] = std::min(minColor[c], static_cast<int>(block[i][c]));
+            maxColor[c] = std::max(maxColor[c], static_cast<int>(block[i][c]));
+        }
+    }
+
+    if (quality == Quality::High)
+    {
+        // The extremities of the bounding box are rarely reached, so it is inset by 1/16th
+        int center[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            int inset = (maxColor[c] - minColor[c]) >> 4;
+            minColor[c] += inset;
+            maxColor[c] -= inset;
+            center[c] = (minColor[c] + maxColor[c]) / 2;
+        }
+
+        // Select the diagonal of the box along which the colors are spread
+        int covarianceRG = 0;
+        int covarianceBG = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            int g = block[i][1] - center[1];
+            covarianceRG += (block[i][0] - center[0]) * g;
+            covarianceBG += (block[i][2] - center[2]) * g;
+        }
+        if (covarianceRG < 0)
+            std::swap(minColor[0], maxColor[0]);
+        if (covarianceBG < 0)
+            std::swap(minColor[2], maxColor[2]);
+    }
+
+    auto toRgb565 = [](const int* color) -> uint16_t { return ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3); };
+    auto fromRgb565 = [](uint16_t value, int* color) {
+        int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    };
+
+    uint16_t color0 = toRgb565(maxColor);
+    uint16_t color1 = toRgb565(minColor);
+    uint32_t indices = 0;
+
+    // With DXT1, the four colors mode is selected by color0 > color1. If they are equal, all indices are left to 0
+    if (color0 != color1)
+    {
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        int endpoint0[3], endpoint1[3], axis[3];
+        fromRgb565(color0, endpoint0);
+        fromRgb565(color1, endpoint1);
+        for (int c = 0; c < 3; ++c)
+            axis[c] = endpoint0[c] - endpoint1[c];
+        const int axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+        // Pixels are projected on the line between the endpoints, the closest of the four steps giving the index
+        // Steps go from color1 to color0, while indices are ordered as color0, color1, 2/3 color0 and 1/3 color0
+        const uint32_t stepToIndex[4] = {1, 3, 2, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            int projection = (block[i][0] - endpoint1[0]) * axis[0] + (block[i][1] - endpoint1[1]) * axis[1] + (block[i][2] - endpoint1[2]) * axis[2];
+            int step = std::min(3, std::max(0, (6 * projection + axisLength) / (2 * axisLength)));
+            indices |= stepToIndex[step] << (2 * i);
+        }
+    }
+
+    output[0] = color0 & 0xFF;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xFF;
+    output[3] = color1 >> 8;
+    for (int b = 0; b < 4; ++b)
+        output[4 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+/*************/
+void DxtCompressor::encodeAlphaBlock(const Block& block, uint8_t* output)
+{
+    int minAlpha = 255;
+    int maxAlpha = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        minAlpha = std::min(minAlpha, static_cast<int>(block[i][3]));
+        maxAlpha = std::max(maxAlpha, static_cast<int>(block[i][3]));
+    }
+
+    // alpha0 > alpha1 selects the eight values mode. If they are equal, all indices are left to 0
+    uint64_t indices = 0;
+    if (minAlpha != maxAlpha)
+    {
+        // Same as for the colors: steps go from alpha1 to alpha0, indices 2 to 7 going from alpha0 to alpha1
+        const int range = maxAlpha - minAlpha;
+        const uint64_t stepToIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            int step = (14 * (block[i][3] - minAlpha) + range) / (2 * range);
+            indices |= stepToIndex[step] << (3 * i);
+        }
+    }
+
+    output[0] = static_cast<uint8_t>(maxAlpha);
+    output[1] = static_cast<uint8_t>(minAlpha);
+    for (int b = 0; b < 6; ++b)
+        output[2 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+} // end of namespace
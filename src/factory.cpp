@@ -38,7 +38,9 @@
 #endif
 #include "./queue.h"
 #include "./scene.h"
+#include "./sink_file.h"
 #include "./texture.h"
+#include "./texture_atlas.h"
 #include "./texture_image.h"
 #if HAVE_OSX
 #include "./texture_syphon.h"
@@ -349,6 +351,11 @@ void Factory::registerObjects()
         "sink a texture to a host buffer",
         "Get the texture content to a host buffer. Only used internally.");
 
+    _objectBook["sink_file"] = Page([&]() { return dynamic_pointer_cast<BaseObject>(make_shared<Sink_File>(_root)); },
+        BaseObject::Category::MISC,
+        "record a texture to video files",
+        "Records the connected texture to video files, encoded with an intra-frame codec (Hap, ProRes or Motion JPEG).");
+
 #if HAVE_SHMDATA
     _objectBook["mesh_shmdata"] = Page(
         [&]() {
@@ -407,6 +414,12 @@ void Factory::registerObjects()
         "Allows for creating a timed playlist of image sources.",
         true);
 
+    _objectBook["texture_atlas"] = Page([&]() { return dynamic_pointer_cast<BaseObject>(make_shared<Texture_Atlas>(_root)); },
+        BaseObject::Category::IMAGE,
+        "texture atlas",
+        "Texture array packing many small images of the same size and format, objects selecting their layer through their atlasLayer attribute.",
+        true);
+
     _objectBook["texture_image"] = Page([&]() { return dynamic_pointer_cast<BaseObject>(make_shared<Texture_Image>(_root)); },
         BaseObject::Category::IMAGE,
         "texture image",
@@ -67,6 +67,8 @@ bool Filter::linkTo(const std::shared_ptr<BaseObject>& obj)
 
     if (dynamic_pointer_cast<Texture>(obj).get() != nullptr)
     {
+        resetFusion();
+
         if (!_inTextures.empty() && _inTextures[_inTextures.size() - 1].expired())
             _screen->removeTexture(_inTextures[_inTextures.size() - 1].lock());
 
@@ -99,6 +101,8 @@ void Filter::unlinkFrom(const std::shared_ptr<BaseObject>& obj)
 {
     if (dynamic_pointer_cast<Texture>(obj).get() != nullptr)
     {
+        resetFusion();
+
         for (int i = 0; i < _inTextures.size();)
         {
             if (_inTextures[i].expired())
@@ -161,13 +165,97 @@ void Filter::updateSizeWrtRatio()
     }
 }
 
+/*************/
+bool Filter::isFusable() const
+{
+    if (!_shaderSource.empty() || !_shaderSourceFile.empty())
+        return false;
+    if (_inTextures.size() != 1 || _inTextures[0].expired() || _parents.size() != 1)
+        return false;
+    if (!_colorCurves.empty() || _autoBlackLevelTargetValue != 0.f || _sizeOverride[0] > 0 || _sizeOverride[1] > 0)
+        return false;
+    return true;
+}
+
+/*************/
+void Filter::resetFusion()
+{
+    for (auto& weakFilter : _fusedFilters)
+    {
+        auto filter = weakFilter.lock();
+        if (filter && filter->_fusedInto.lock().get() == this)
+            filter->_fusedInto.reset();
+    }
+    _fusedFilters.clear();
+
+    if (_fusedInput)
+    {
+        _screen->removeTexture(_fusedInput);
+        _fusedInput.reset();
+        if (!_inTextures.empty())
+            if (auto input = _inTextures[0].lock())
+                _screen->addTexture(input);
+        updateShaderParameters();
+    }
+}
+
+/*************/
+bool Filter::updateFusedFilters()
+{
+    // Only the default shader knows how to apply the upstream filters
+    vector<shared_ptr<Filter>> chain;
+    if (_shaderSource.empty() && _shaderSourceFile.empty() && _inTextures.size() == 1)
+    {
+        auto upstream = dynamic_pointer_cast<Filter>(_inTextures[0].lock());
+        while (upstream && upstream->isFusable() && chain.size() < _maxFusedFilters)
+        {
+            chain.insert(chain.begin(), upstream);
+            upstream = dynamic_pointer_cast<Filter>(upstream->_inTextures[0].lock());
+        }
+    }
+
+    // The most upstream fused filter may also have been linked to another input
+    bool chainChanged = chain.size() != _fusedFilters.size();
+    for (size_t i = 0; !chainChanged && i < chain.size(); ++i)
+        chainChanged = chain[i] != _fusedFilters[i].lock();
+    if (!chainChanged && !chain.empty())
+        chainChanged = chain[0]->_inTextures[0].lock() != _fusedInput;
+
+    if (chainChanged)
+    {
+        resetFusion();
+        for (auto& filter : chain)
+            _fusedFilters.push_back(filter);
+
+        if (!chain.empty())
+        {
+            _fusedInput = chain[0]->_inTextures[0].lock();
+            _screen->removeTexture(_inTextures[0].lock());
+            _screen->addTexture(_fusedInput);
+            updateShaderParameters();
+        }
+    }
+
+    // The fused filters may have been applied by another filter until now, for example one further downstream which was removed
+    auto self = dynamic_pointer_cast<Filter>(shared_from_this());
+    for (auto& filter : chain)
+        filter->_fusedInto = self;
+
+    return chainChanged;
+}
+
 /*************/
 void Filter::render()
 {
     if (_inTextures.empty() || _inTextures[0].expired())
         return;
 
-    auto input = _inTextures[0].lock();
+    // This filter is applied by a downstream filter, see updateFusedFilters
+    if (!_fusedInto.expired())
+        return;
+
+    bool fusionChanged = updateFusedFilters();
+    auto input = _fusedInput ? _fusedInput : _inTextures[0].lock();
     auto inputSpec = input->getSpec();
 
     if (inputSpec != _outTextureSpec || (_sizeOverride[0] > 0 && _sizeOverride[1] > 0))
@@ -188,8 +276,9 @@ void Filter::render()
     }
 
     _fbo->bindDraw();
-    glViewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
+    GlStateCache::get().viewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
 
+    _screen->setTexturesSampledSize(_outTextureSpec.width, _outTextureSpec.height);
     _screen->activate();
     updateUniforms();
     _screen->draw();
@@ -197,11 +286,30 @@ void Filter::render()
 
     _fbo->unbindDraw();
 
-    _fbo->getColorTexture()->generateMipmap();
+    // Keep track of output modifications, so that downstream objects know when to render again.
+    // Time-dependent user shaders and automatic black level change the output at every frame
+    auto inputTimestamp = input->getTimestamp();
+    auto updateCount = getUpdateCount();
+    for (auto& weakFilter : _fusedFilters)
+        if (auto filter = weakFilter.lock())
+            updateCount += filter->getUpdateCount();
+    if (inputTimestamp != _inputTimestamp || updateCount != _updateCountAtRender || fusionChanged || !_shaderSource.empty() || _autoBlackLevelTargetValue != 0.f)
+    {
+        _timestamp = Timer::getTime();
+        _inputTimestamp = inputTimestamp;
+        _updateCountAtRender = updateCount;
+    }
 
     // Automatic black level stuff
-    if (_autoBlackLevelTargetValue != 0.f)
+    if (_autoBlackLevelTargetValue == 0.f)
+    {
+        _fbo->getColorTexture()->updateMipmap();
+    }
+    else
     {
+        // The mean value is read from the last mipmap level
+        _fbo->getColorTexture()->generateMipmap();
+
         auto luminance = _fbo->getColorTexture()->getMeanValue().luminance();
         auto deltaLuminance = _autoBlackLevelTargetValue - luminance;
         auto newBlackLevel = _autoBlackLevel + deltaLuminance / 2.f;
@@ -251,6 +359,45 @@ void Filter::updateUniforms()
         }
     }
 
+    // Parameters of the fused filters, as arrays ordered from the most upstream filter
+    if (!_fusedFilters.empty())
+    {
+        auto getUniform = [](const Filter& filter, const string& name, const Values& defaultValue) -> Values {
+            auto uniformIt = filter._filterUniforms.find(name);
+            return uniformIt == filter._filterUniforms.end() ? defaultValue : uniformIt->second;
+        };
+
+        Values blackLevels, brightnesses, contrasts, saturations, invertChannels, colorBalances;
+        for (auto& weakFilter : _fusedFilters)
+        {
+            auto filter = weakFilter.lock();
+            if (!filter)
+                continue;
+
+            blackLevels.push_back(getUniform(*filter, "_blackLevel", {0.f})[0].as<float>());
+            brightnesses.push_back(getUniform(*filter, "_brightness", {1.f})[0].as<float>());
+            contrasts.push_back(getUniform(*filter, "_contrast", {1.f})[0].as<float>());
+            saturations.push_back(getUniform(*filter, "_saturation", {1.f})[0].as<float>());
+            invertChannels.push_back(getUniform(*filter, "_invertChannels", {0})[0].as<int>());
+            auto colorBalance = getUniform(*filter, "_colorBalance", {1.f, 1.f});
+            colorBalances.push_back(colorBalance[0].as<float>());
+            colorBalances.push_back(colorBalance[1].as<float>());
+        }
+
+        // Arrays are given as a single nested Values
+        auto setArrayUniform = [&](const string& name, const Values& array) {
+            Values values;
+            values.push_back(array);
+            shader->setAttribute("uniform", {name, values});
+        };
+        setArrayUniform("_fusedBlackLevel", blackLevels);
+        setArrayUniform("_fusedBrightness", brightnesses);
+        setArrayUniform("_fusedContrast", contrasts);
+        setArrayUniform("_fusedSaturation", saturations);
+        setArrayUniform("_fusedInvertChannels", invertChannels);
+        setArrayUniform("_fusedColorBalance", colorBalances);
+    }
+
     // Update uniforms specific to the current filtering shader
     for (auto& uniform : _filterUniforms)
     {
@@ -285,8 +432,12 @@ void Filter::updateShaderParameters()
     if (!_shaderSource.empty() || !_shaderSourceFile.empty())
         return;
 
+    Values fillParameters{"filter"};
     if (!_colorCurves.empty()) // Validity of color curve has been checked earlier
-        _screen->setAttribute("fill", {"filter", "COLOR_CURVE_COUNT " + to_string(static_cast<int>(_colorCurves[0].size()))});
+        fillParameters.push_back("COLOR_CURVE_COUNT " + to_string(static_cast<int>(_colorCurves[0].size())));
+    if (!_fusedFilters.empty())
+        fillParameters.push_back("FUSED_FILTER_COUNT " + to_string(_fusedFilters.size()));
+    _screen->setAttribute("fill", fillParameters);
 
     // This is a trick to force the shader compilation
     _screen->activate();
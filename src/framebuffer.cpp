@@ -1,5 +1,8 @@
 #include "./framebuffer.h"
 
+#include <cstring>
+
+#include "./gl_readback.h"
 #include "./log.h"
 #include "./timer.h"
 
@@ -46,6 +49,7 @@ Framebuffer::Framebuffer(RootObject* root)
 /*************/
 Framebuffer::~Framebuffer()
 {
+    GlStateCache::get().forgetFramebuffer(_fbo);
     glDeleteFramebuffers(1, &_fbo);
 }
 
@@ -54,10 +58,10 @@ void Framebuffer::bindDraw()
 {
     if (_fbo)
     {
-        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_previousFbo);
+        _previousFbo = GlStateCache::get().getFramebuffer(GL_DRAW_FRAMEBUFFER);
         if (_multisample)
-            glEnable(GL_MULTISAMPLE);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+            GlStateCache::get().enable(GL_MULTISAMPLE);
+        GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
     }
 }
 
@@ -66,8 +70,8 @@ void Framebuffer::bindRead()
 {
     if (_fbo)
     {
-        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_previousFbo);
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+        _previousFbo = GlStateCache::get().getFramebuffer(GL_READ_FRAMEBUFFER);
+        GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
     }
 }
 
@@ -81,15 +85,34 @@ void Framebuffer::blit(const Framebuffer& src, const Framebuffer& dst)
 /*************/
 float Framebuffer::getDepthAt(float x, float y)
 {
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+    GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
     float depth = 0.f;
     glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
     return depth;
 }
 
 /*************/
-void Framebuffer::setParameters(int multisample, bool sixteenbpc, bool srgb, bool cubemap)
+void Framebuffer::getDepthAtAsync(float x, float y, function<void(float)> callback)
+{
+    GlReadback::get().read(sizeof(float),
+        [&](GLuint readbackBuffer) {
+            GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+            glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        },
+        [=](const char* data, size_t size) {
+            float depth = 1.f;
+            if (size == sizeof(float))
+                memcpy(&depth, data, sizeof(float));
+            callback(depth);
+        });
+}
+
+/*************/
+void Framebuffer::setParameters(int multisample, bool sixteenbpc, bool srgb, bool cubemap, int layers)
 {
     _multisample = multisample;
     _16bits = sixteenbpc;
@@ -97,14 +120,14 @@ void Framebuffer::setParameters(int multisample, bool sixteenbpc, bool srgb, boo
 
     auto spec = _colorTexture->getSpec();
 
-    _depthTexture->reset(spec.width, spec.height, "D", nullptr, _multisample, cubemap);
+    _depthTexture->reset(spec.width, spec.height, "D", nullptr, _multisample, cubemap, layers);
 
     if (_srgb)
-        _colorTexture->reset(spec.width, spec.height, "sRGBA", nullptr, _multisample, cubemap);
+        _colorTexture->reset(spec.width, spec.height, "sRGBA", nullptr, _multisample, cubemap, layers);
     else if (_16bits)
-        _colorTexture->reset(spec.width, spec.height, "RGBA16", nullptr, _multisample, cubemap);
+        _colorTexture->reset(spec.width, spec.height, "RGBA16", nullptr, _multisample, cubemap, layers);
     else
-        _colorTexture->reset(spec.width, spec.height, "RGBA", nullptr, _multisample, cubemap);
+        _colorTexture->reset(spec.width, spec.height, "RGBA", nullptr, _multisample, cubemap, layers);
 
     glNamedFramebufferTexture(_fbo, GL_DEPTH_ATTACHMENT, _depthTexture->getTexId(), 0);
     glNamedFramebufferTexture(_fbo, GL_COLOR_ATTACHMENT0, _colorTexture->getTexId(), 0);
@@ -143,8 +166,7 @@ void Framebuffer::unbindDraw()
 {
     if (_fbo)
     {
-        int currentFbo = 0;
-        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentFbo);
+        auto currentFbo = GlStateCache::get().getFramebuffer(GL_DRAW_FRAMEBUFFER);
         if (currentFbo != _fbo)
         {
             Log::get() << Log::WARNING << "Framebuffer::" << __FUNCTION__ << " - Cannot unbind a FBO which is not bound" << Log::endl;
@@ -152,8 +174,8 @@ void Framebuffer::unbindDraw()
         }
 
         if (_multisample)
-            glDisable(GL_MULTISAMPLE);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _previousFbo);
+            GlStateCache::get().disable(GL_MULTISAMPLE);
+        GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _previousFbo);
     }
 }
 
@@ -162,15 +184,14 @@ void Framebuffer::unbindRead()
 {
     if (_fbo)
     {
-        int currentFbo = 0;
-        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &currentFbo);
+        auto currentFbo = GlStateCache::get().getFramebuffer(GL_READ_FRAMEBUFFER);
         if (currentFbo != _fbo)
         {
             Log::get() << Log::WARNING << "Framebuffer::" << __FUNCTION__ << " - Cannot unbind a FBO which is not bound" << Log::endl;
             return;
         }
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, _previousFbo);
+        GlStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, _previousFbo);
     }
 }
 
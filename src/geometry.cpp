@@ -1,8 +1,12 @@
 #include "geometry.h"
 
+#include <array>
+#include <cstring>
+#include <limits>
+
+#include "gl_readback.h"
 #include "log.h"
 #include "mesh.h"
-#include "scene.h"
 
 using namespace std;
 using namespace glm;
@@ -15,10 +19,6 @@ Geometry::Geometry(RootObject* root)
     : BufferObject(root)
 {
     init();
-
-    auto scene = dynamic_cast<Scene*>(_root);
-    if (scene)
-        _onMasterScene = scene->isMaster();
 }
 
 /*************/
@@ -51,6 +51,8 @@ Geometry::~Geometry()
         glDeleteVertexArrays(1, &(v.second));
 
     glDeleteQueries(1, &_feedbackQuery);
+    if (_serializedMeshFence)
+        glDeleteSync(_serializedMeshFence);
 
 #ifdef DEBUG
     Log::get() << Log::DEBUGGING << "Geometry::~Geometry - Destructor" << Log::endl;
@@ -68,6 +70,8 @@ void Geometry::activate()
 void Geometry::activateAsSharedBuffer()
 {
     _mutex.lock();
+    // Buffers are activated as shared buffers to be modified by compute shaders
+    ++_buffersUpdateCount;
 
     if (_useAlternativeBuffers)
     {
@@ -148,35 +152,155 @@ void Geometry::deactivateFeedback()
 /*************/
 shared_ptr<SerializedObject> Geometry::serialize() const
 {
+    // The alternative buffers are only sent if they are used, which is not the case when blending in texture space
+    int verticesNumber = _useAlternativeBuffers ? _alternativeVerticesNumber : 0;
+
     auto serializedObject = make_shared<SerializedObject>();
     serializedObject->resize(sizeof(int));
-    *(int*)(serializedObject->data()) = _alternativeVerticesNumber;
+    *(int*)(serializedObject->data()) = verticesNumber;
     for (auto& buffer : _glAlternativeBuffers)
     {
+        if (verticesNumber == 0)
+            break;
         auto newBuffer = buffer->getBufferAsVector(_alternativeVerticesNumber);
         auto oldSize = serializedObject->size();
         serializedObject->resize(serializedObject->size() + newBuffer.size());
         std::copy(newBuffer.data(), newBuffer.data() + newBuffer.size(), serializedObject->data() + oldSize);
     }
 
+    // The blending map follows the buffers, preceded by its size
+    if (_blendingMap)
+    {
+        int mapSize = _blendingMap->getSpec().width;
+        size_t mapBytes = static_cast<size_t>(mapSize) * mapSize * 2 * sizeof(float);
+        auto oldSize = serializedObject->size();
+        serializedObject->resize(oldSize + sizeof(int) + mapBytes);
+        *(int*)(serializedObject->data() + oldSize) = mapSize;
+        glGetTextureImage(_blendingMap->getTexId(), 0, GL_RG, GL_FLOAT, mapBytes, serializedObject->data() + oldSize + sizeof(int));
+    }
+
     return serializedObject;
 }
 
 /*************/
-bool Geometry::deserialize(const shared_ptr<SerializedObject>& obj)
+void Geometry::serializeAsync(function<void(shared_ptr<SerializedObject>)> callback) const
 {
-    auto verticesNumber = *(int*)(obj->data());
+    // Same layout as serialize(), the buffers and the blending map being read back together
+    int verticesNumber = _useAlternativeBuffers ? _alternativeVerticesNumber : 0;
+    size_t buffersBytes = 0;
+    if (verticesNumber != 0)
+        for (auto& buffer : _glAlternativeBuffers)
+            buffersBytes += static_cast<size_t>(verticesNumber) * buffer->getElementSize() * buffer->getComponentSize();
+
+    int mapSize = _blendingMap ? _blendingMap->getSpec().width : 0;
+    size_t mapBytes = static_cast<size_t>(mapSize) * mapSize * 2 * sizeof(float);
+
+    auto name = _name;
+    GlReadback::get().read(buffersBytes + mapBytes,
+        [&](GLuint readbackBuffer) {
+            // Buffers and map may just have been written by compute shaders
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+            size_t offset = 0;
+            for (auto& buffer : _glAlternativeBuffers)
+            {
+                if (verticesNumber == 0)
+                    break;
+                auto bytes = static_cast<size_t>(verticesNumber) * buffer->getElementSize() * buffer->getComponentSize();
+                glCopyNamedBufferSubData(buffer->getId(), readbackBuffer, 0, offset, bytes);
+                offset += bytes;
+            }
+
+            if (mapSize != 0)
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+                glGetTextureImage(_blendingMap->getTexId(), 0, GL_RG, GL_FLOAT, mapBytes, reinterpret_cast<void*>(offset));
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+        },
+        [=](const char* data, size_t size) {
+            if (buffersBytes + mapBytes != 0 && (!data || size < buffersBytes + mapBytes))
+            {
+                Log::get() << Log::WARNING << "Geometry::serializeAsync - Unable to read back geometry " << name << Log::endl;
+                callback(nullptr);
+                return;
+            }
+
+            auto serializedObject = make_shared<SerializedObject>(sizeof(int) + buffersBytes + (mapSize != 0 ? sizeof(int) + mapBytes : 0));
+            *(int*)(serializedObject->data()) = verticesNumber;
+            if (buffersBytes != 0)
+                memcpy(serializedObject->data() + sizeof(int), data, buffersBytes);
+            if (mapSize != 0)
+            {
+                *(int*)(serializedObject->data() + sizeof(int) + buffersBytes) = mapSize;
+                memcpy(serializedObject->data() + 2 * sizeof(int) + buffersBytes, data + buffersBytes, mapBytes);
+            }
+            callback(serializedObject);
+        });
+}
 
-    if (obj->size() != verticesNumber * 4 * 14 + 4)
+/*************/
+bool Geometry::deserialize(const shared_ptr<SerializedObject>& obj)
+{
+    if (!isSerializedGeometryValid(obj->data(), obj->size()))
     {
         Log::get() << Log::WARNING << "Geometry::" << __FUNCTION__ << " - Received buffer size does not match its header. Dropping." << Log::endl;
         return false;
     }
 
-    _serializedMesh = std::move(*obj);
+    // The upload to the GPU is done by the texture upload loop, see uploadSerializedMesh
+    {
+        lock_guard<mutex> lock(_serializedMeshMutex);
+        _serializedMesh = std::move(*obj);
+        _serializedMeshPending.store(true, std::memory_order_release);
+    }
+    if (_root)
+        _root->signalBufferObjectUpdated();
     return true;
 }
 
+/*************/
+bool Geometry::isSerializedGeometryValid(const char* data, size_t size)
+{
+    if (size < sizeof(int))
+        return false;
+
+    int verticesNumber;
+    memcpy(&verticesNumber, data, sizeof(int));
+    if (verticesNumber < 0)
+        return false;
+
+    auto buffersSize = static_cast<size_t>(verticesNumber) * 4 * 14 + sizeof(int);
+    if (size == buffersSize)
+        return true;
+    if (size < buffersSize + sizeof(int))
+        return false;
+
+    int mapSize;
+    memcpy(&mapSize, data + buffersSize, sizeof(int));
+    return mapSize > 0 && size == buffersSize + sizeof(int) + static_cast<size_t>(mapSize) * mapSize * 2 * sizeof(float);
+}
+
+/*************/
+bool Geometry::getBoundingBox(glm::vec3& min, glm::vec3& max) const
+{
+    if (!_boundingBoxValid || getMeshTimestamp() != _timestamp)
+        return false;
+
+    min = _boundingBoxMin;
+    max = _boundingBoxMax;
+    return true;
+}
+
+/*************/
+int64_t Geometry::getMeshTimestamp() const
+{
+    auto mesh = _mesh.lock();
+    if (!mesh)
+        return _timestamp;
+    return mesh->getTimestamp();
+}
+
 /*************/
 bool Geometry::linkTo(const shared_ptr<BaseObject>& obj)
 {
@@ -221,10 +345,34 @@ float Geometry::pickVertex(dvec3 p, dvec3& v)
     return distance;
 }
 
+/*************/
+void Geometry::resetBlendingMap(int size)
+{
+    if (size <= 0)
+    {
+        _blendingMap.reset();
+        ++_buffersUpdateCount;
+        return;
+    }
+
+    if (!_blendingMap)
+    {
+        _blendingMap = make_shared<Texture_Image>(_root);
+        _blendingMap->setAttribute("clampToEdge", {1});
+        _blendingMap->setAttribute("filtering", {0});
+    }
+
+    if (_blendingMap->getSpec().width != size)
+        _blendingMap->reset(size, size, "RG32F", nullptr);
+    glClearTexImage(_blendingMap->getTexId(), 0, GL_RG, GL_FLOAT, nullptr);
+    ++_buffersUpdateCount;
+}
+
 /*************/
 void Geometry::swapBuffers()
 {
     _glAlternativeBuffers.swap(_glTemporaryBuffers);
+    ++_buffersUpdateCount;
 
     int tmp = _alternativeVerticesNumber;
     _alternativeVerticesNumber = _temporaryVerticesNumber;
@@ -249,88 +397,94 @@ void Geometry::update()
     if (_timestamp != mesh->getTimestamp())
     {
         mesh->update();
+        auto timestamp = mesh->getTimestamp();
 
-        vector<float> vertices = mesh->getVertCoords();
-        if (vertices.size() == 0)
-            return;
-        _verticesNumber = vertices.size() / 4;
-        _glBuffers[0] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _verticesNumber, vertices.data());
-
-        vector<float> texcoords = mesh->getUVCoords();
-        if (texcoords.size() == 0)
+        glm::vec3 boundingBoxMin, boundingBoxMax;
+        if (!mesh->getBoundingBox(boundingBoxMin, boundingBoxMax))
             return;
-        _glBuffers[1] = make_shared<GpuBuffer>(2, GL_FLOAT, GL_STATIC_DRAW, _verticesNumber, texcoords.data());
-
-        vector<float> normals = mesh->getNormals();
-        if (normals.size() == 0)
-            return;
-        _glBuffers[2] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _verticesNumber, normals.data());
-
-        // An additional annexe buffer, to be filled by compute shaders. Contains a vec4 for each vertex
-        vector<float> annexe = mesh->getAnnexe();
-        if (annexe.size() == 0)
-            _glBuffers[3] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _verticesNumber, nullptr);
-        else
-            _glBuffers[3] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _verticesNumber, annexe.data());
-
-        // Check the buffers
-        bool buffersSet = true;
-        for (auto& buffer : _glBuffers)
-            if (!*buffer)
-                buffersSet = false;
 
+        // Buffers are created once and reused afterwards: their storage is rewritten in place, or orphaned if the vertex count changed.
+        // As their GL ids do not change, the vertex arrays only need to be pointed to them again, not recreated
+        const array<GLint, 4> elementSizes{4, 2, 4, 4};
+        for (size_t i = 0; i < _glBuffers.size(); ++i)
+            if (!_glBuffers[i])
+                _glBuffers[i] = make_shared<GpuBuffer>(elementSizes[i], GL_FLOAT, GL_STATIC_DRAW, 0, nullptr);
+
+        // The buffers are only mapped, and thus invalidated, once the mesh is known to be complete
+        size_t verticesNumber = 0;
+        array<float*, 4> mappedBuffers{};
+        bool buffersSet = mesh->copyTo([&](size_t meshVerticesNumber, array<float*, 4>& arrays) {
+            verticesNumber = meshVerticesNumber;
+            for (size_t i = 0; i < _glBuffers.size(); ++i)
+            {
+                mappedBuffers[i] = static_cast<float*>(_glBuffers[i]->mapForWriting(verticesNumber));
+                if (!mappedBuffers[i])
+                    return false;
+            }
+            arrays = mappedBuffers;
+            return true;
+        });
+        for (size_t i = 0; i < _glBuffers.size(); ++i)
+            if (mappedBuffers[i])
+                buffersSet = _glBuffers[i]->unmap() && buffersSet;
+
+        // The mesh is not ready, or the buffers were lost: try again next time. In the latter case
+        // the buffers have been invalidated, so nothing is drawn from them until then
         if (!buffersSet)
         {
-            _glBuffers.clear();
-            _glBuffers.resize(4);
+            if (verticesNumber != 0)
+                _verticesNumber = 0;
             return;
         }
 
-        for (auto& v : _vertexArray)
-            glDeleteVertexArrays(1, &(v.second));
-        _vertexArray.clear();
+        _verticesNumber = verticesNumber;
+        _boundingBoxMin = boundingBoxMin;
+        _boundingBoxMax = boundingBoxMax;
 
-        _timestamp = mesh->getTimestamp();
+        _timestamp = timestamp;
+        _boundingBoxValid = true;
 
         _buffersDirty = true;
+        ++_buffersUpdateCount;
     }
 
-    // If a serialized geometry is present, we use it as the alternative buffer
-    if (!_onMasterScene && _serializedMesh.size() != 0)
+    // If a serialized geometry has been staged by the upload loop, we use it as the alternative buffer
+    if (_serializedMeshStaged.load(std::memory_order_acquire))
     {
         lock_guard<shared_timed_mutex> lock(_writeMutex);
 
-        if (_glTemporaryBuffers.size() != 4)
-            _glTemporaryBuffers.resize(4);
-
-        _temporaryVerticesNumber = *(int*)(_serializedMesh.data());
-        _temporaryBufferSize = _temporaryVerticesNumber;
-
-        if (!_glTemporaryBuffers[0])
-            _glTemporaryBuffers[0] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _temporaryVerticesNumber, _serializedMesh.data() + 4);
-        else
-            _glTemporaryBuffers[0]->setBufferFromVector(vector<char>(_serializedMesh.data() + 4, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 4));
+        if (glIsSync(_serializedMeshFence) == GL_TRUE)
+        {
+            glWaitSync(_serializedMeshFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(_serializedMeshFence);
+        }
+        _serializedMeshFence = nullptr;
 
-        if (!_glTemporaryBuffers[1])
-            _glTemporaryBuffers[1] = make_shared<GpuBuffer>(2, GL_FLOAT, GL_STATIC_DRAW, _temporaryVerticesNumber, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 4);
-        else
-            _glTemporaryBuffers[1]->setBufferFromVector(
-                vector<char>(_serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 4, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 6));
+        // Geometries blended in texture space come without tessellated buffers
+        if (_stagedVerticesNumber != 0)
+        {
+            _glStagingBuffers.swap(_glAlternativeBuffers);
+            _alternativeVerticesNumber = _stagedVerticesNumber;
+            _alternativeBufferSize = _stagedVerticesNumber;
+            _buffersDirty = true;
+        }
 
-        if (!_glTemporaryBuffers[2])
-            _glTemporaryBuffers[2] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _temporaryVerticesNumber, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 6);
-        else
-            _glTemporaryBuffers[2]->setBufferFromVector(
-                vector<char>(_serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 6, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 10));
+        // The blending map can only be uploaded from the upload context if it already had the right size
+        if (_stagedMapSize == 0 && _blendingMap)
+        {
+            resetBlendingMap(0);
+        }
+        else if (_stagedMapSize != 0 && !_stagedMapUploaded)
+        {
+            resetBlendingMap(_stagedMapSize);
+            auto mapOffset = sizeof(int) + static_cast<size_t>(_stagedVerticesNumber) * 4 * 14 + sizeof(int);
+            glTextureSubImage2D(_blendingMap->getTexId(), 0, 0, 0, _stagedMapSize, _stagedMapSize, GL_RG, GL_FLOAT, _stagedMesh.data() + mapOffset);
+        }
 
-        if (!_glTemporaryBuffers[3])
-            _glTemporaryBuffers[3] = make_shared<GpuBuffer>(4, GL_FLOAT, GL_STATIC_DRAW, _temporaryVerticesNumber, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 10);
-        else
-            _glTemporaryBuffers[3]->setBufferFromVector(
-                vector<char>(_serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 10, _serializedMesh.data() + 4 + _temporaryVerticesNumber * 4 * 14));
+        _stagedMesh = SerializedObject();
 
-        swapBuffers();
-        _buffersDirty = true;
+        ++_buffersUpdateCount;
+        _serializedMeshStaged.store(false, std::memory_order_release);
     }
 
     GLFWwindow* context = glfwGetCurrentContext();
@@ -368,11 +522,82 @@ void Geometry::update()
     }
 }
 
+/*************/
+void Geometry::uploadSerializedMesh()
+{
+    // A staged geometry has to be swapped in before staging the next one
+    if (!_serializedMeshPending.load(std::memory_order_acquire) || _serializedMeshStaged.load(std::memory_order_acquire))
+        return;
+
+    lock_guard<shared_timed_mutex> lock(_writeMutex);
+
+    // The received geometry is moved to its own member, so that the one deserialized next does not replace it before it is swapped in
+    {
+        lock_guard<mutex> lockMesh(_serializedMeshMutex);
+        _stagedMesh = std::move(_serializedMesh);
+        _serializedMesh = SerializedObject();
+        _serializedMeshPending.store(false, std::memory_order_release);
+    }
+
+    // The buffers are written directly from the received geometry, which was checked when deserialized
+    int verticesNumber = *(int*)(_stagedMesh.data());
+    auto offset = sizeof(int);
+    if (verticesNumber != 0)
+    {
+        const array<GLint, 4> elementSizes{4, 2, 4, 4};
+        if (_glStagingBuffers.size() != elementSizes.size())
+            _glStagingBuffers.resize(elementSizes.size());
+
+        for (size_t i = 0; i < _glStagingBuffers.size(); ++i)
+        {
+            if (!_glStagingBuffers[i])
+                _glStagingBuffers[i] = make_shared<GpuBuffer>(elementSizes[i], GL_FLOAT, GL_STATIC_DRAW, 0, nullptr);
+
+            auto bytes = static_cast<size_t>(verticesNumber) * elementSizes[i] * sizeof(float);
+            auto mappedBuffer = _glStagingBuffers[i]->mapForWriting(verticesNumber);
+            if (mappedBuffer)
+                memcpy(mappedBuffer, _stagedMesh.data() + offset, bytes);
+            if (!mappedBuffer || !_glStagingBuffers[i]->unmap())
+            {
+                // Try again during the next upload loop, unless a newer geometry arrived meanwhile
+                Log::get() << Log::WARNING << "Geometry::" << __FUNCTION__ << " - Unable to write to the staging buffers" << Log::endl;
+                lock_guard<mutex> lockMesh(_serializedMeshMutex);
+                if (!_serializedMeshPending.load(std::memory_order_acquire))
+                    _serializedMesh = std::move(_stagedMesh);
+                _stagedMesh = SerializedObject();
+                _serializedMeshPending.store(true, std::memory_order_release);
+                return;
+            }
+            offset += bytes;
+        }
+    }
+    _stagedVerticesNumber = verticesNumber;
+
+    _stagedMapSize = 0;
+    _stagedMapUploaded = false;
+    if (_stagedMesh.size() > offset)
+    {
+        _stagedMapSize = *(int*)(_stagedMesh.data() + offset);
+        auto blendingMap = _blendingMap;
+        if (blendingMap && blendingMap->getSpec().width == _stagedMapSize)
+        {
+            glTextureSubImage2D(blendingMap->getTexId(), 0, 0, 0, _stagedMapSize, _stagedMapSize, GL_RG, GL_FLOAT, _stagedMesh.data() + offset + sizeof(int));
+            _stagedMapUploaded = true;
+        }
+    }
+
+    // The fence has to be flushed to be visible from the rendering context
+    _serializedMeshFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    _serializedMeshStaged.store(true, std::memory_order_release);
+}
+
 /*************/
 void Geometry::useAlternativeBuffers(bool isActive)
 {
     _useAlternativeBuffers = isActive;
     _buffersDirty = true;
+    ++_buffersUpdateCount;
 }
 
 /*************/
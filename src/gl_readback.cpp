@@ -0,0 +1,108 @@
+#include "./gl_readback.h"
+
+#include <algorithm>
+
+#include "./log.h"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+void GlReadback::read(size_t size, const CopyFunction& copy, ReadyFunction ready)
+{
+    Request request;
+    request.size = size;
+    request.ready = move(ready);
+
+    // Nothing to copy, but the callback is still called from process()
+    if (size != 0)
+    {
+        auto buffer = getBuffer(size);
+        request.buffer = buffer.first;
+        copy(request.buffer);
+
+        // The fence has to be flushed to be signaled without further GL calls
+        request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    _requests.push_back(move(request));
+}
+
+/*************/
+void GlReadback::process(bool wait)
+{
+    vector<Request> readyRequests;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto it = _requests.begin(); it != _requests.end();)
+        {
+            if (it->fence)
+            {
+                auto status = glClientWaitSync(it->fence, 0, wait ? GL_TIMEOUT_IGNORED : 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                {
+                    ++it;
+                    continue;
+                }
+                glDeleteSync(it->fence);
+            }
+
+            readyRequests.push_back(move(*it));
+            it = _requests.erase(it);
+        }
+    }
+
+    // Callbacks are called without holding the lock, as they may queue new readbacks
+    for (auto& request : readyRequests)
+    {
+        if (request.buffer == 0)
+        {
+            request.ready(nullptr, 0);
+            continue;
+        }
+
+        auto data = static_cast<const char*>(glMapNamedBufferRange(request.buffer, 0, request.size, GL_MAP_READ_BIT));
+        if (data)
+        {
+            request.ready(data, request.size);
+            glUnmapNamedBuffer(request.buffer);
+        }
+        else
+        {
+            // Callers may wait for all their readbacks, so failures are reported too
+            Log::get() << Log::WARNING << "GlReadback::" << __FUNCTION__ << " - Unable to map the readback buffer" << Log::endl;
+            request.ready(nullptr, 0);
+        }
+
+        GLint capacity = 0;
+        glGetNamedBufferParameteriv(request.buffer, GL_BUFFER_SIZE, &capacity);
+        lock_guard<mutex> lock(_mutex);
+        _freeBuffers.emplace_back(request.buffer, capacity);
+    }
+}
+
+/*************/
+pair<GLuint, size_t> GlReadback::getBuffer(size_t size)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto bufferIt = find_if(_freeBuffers.begin(), _freeBuffers.end(), [&](const pair<GLuint, size_t>& buffer) { return buffer.second >= size; });
+        if (bufferIt != _freeBuffers.end())
+        {
+            auto buffer = *bufferIt;
+            _freeBuffers.erase(bufferIt);
+            return buffer;
+        }
+    }
+
+    GLuint buffer = 0;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferData(buffer, size, nullptr, GL_STREAM_READ);
+    return {buffer, size};
+}
+
+} // end of namespace
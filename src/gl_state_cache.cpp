@@ -0,0 +1,250 @@
+#include "./gl_state_cache.h"
+
+#include "./timer.h"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+void GlStateCache::State::reset(uint64_t gen)
+{
+    generation = gen;
+    program = -1;
+    activeTexture = -1;
+    textures.fill(-1);
+    drawFramebuffer = -1;
+    readFramebuffer = -1;
+    viewportKnown = false;
+    capabilities.clear();
+}
+
+/*************/
+void GlStateCache::setEnabled(bool enabled)
+{
+    if (_enabled.exchange(enabled) != enabled)
+        invalidate();
+}
+
+/*************/
+void GlStateCache::forgetContext(GLFWwindow* /*context*/)
+{
+    // States are kept alive as threads may still hold a pointer to them,
+    // and the same GLFWwindow address may be given to a future context
+    invalidate();
+}
+
+/*************/
+GlStateCache::State* GlStateCache::getState()
+{
+    if (!_enabled)
+        return nullptr;
+
+    thread_local GLFWwindow* cachedContext{nullptr};
+    thread_local State* cachedState{nullptr};
+
+    auto context = glfwGetCurrentContext();
+    if (!context)
+        return nullptr;
+
+    if (context != cachedContext)
+    {
+        lock_guard<mutex> lock(_statesMutex);
+        auto& state = _states[context];
+        if (!state)
+            state = make_unique<State>();
+        cachedContext = context;
+        cachedState = state.get();
+    }
+
+    auto generation = _generation.load(memory_order_acquire);
+    if (cachedState->generation != generation)
+        cachedState->reset(generation);
+
+    // Textures and framebuffers deleted from another context have their bindings forgotten here
+    auto textureGeneration = _textureGeneration.load(memory_order_acquire);
+    if (cachedState->textureGeneration != textureGeneration)
+    {
+        cachedState->textures.fill(-1);
+        cachedState->textureGeneration = textureGeneration;
+    }
+
+    auto framebufferGeneration = _framebufferGeneration.load(memory_order_acquire);
+    if (cachedState->framebufferGeneration != framebufferGeneration)
+    {
+        cachedState->drawFramebuffer = -1;
+        cachedState->readFramebuffer = -1;
+        cachedState->framebufferGeneration = framebufferGeneration;
+    }
+
+    return cachedState;
+}
+
+/*************/
+void GlStateCache::forgetTexture(GLuint /*texture*/)
+{
+    // Other contexts' states belong to their threads, so they reset their texture bindings themselves on their next access
+    _textureGeneration.fetch_add(1, memory_order_acq_rel);
+}
+
+/*************/
+void GlStateCache::forgetFramebuffer(GLuint /*fbo*/)
+{
+    _framebufferGeneration.fetch_add(1, memory_order_acq_rel);
+}
+
+/*************/
+void GlStateCache::useProgram(GLuint program)
+{
+    auto state = getState();
+    if (state && state->program == static_cast<GLint>(program))
+    {
+        count(false);
+        return;
+    }
+
+    glUseProgram(program);
+    if (state)
+        state->program = program;
+    count(true);
+}
+
+/*************/
+void GlStateCache::activeTexture(GLuint unit)
+{
+    auto state = getState();
+    if (state && state->activeTexture == static_cast<GLint>(unit))
+    {
+        count(false);
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    if (state)
+        state->activeTexture = unit;
+    count(true);
+}
+
+/*************/
+GLuint GlStateCache::getActiveTexture()
+{
+    auto state = getState();
+    if (state && state->activeTexture != -1)
+        return state->activeTexture;
+
+    GLint activeTexture = 0;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+    activeTexture -= GL_TEXTURE0;
+    if (state)
+        state->activeTexture = activeTexture;
+    return activeTexture;
+}
+
+/*************/
+void GlStateCache::bindTextureUnit(GLuint unit, GLuint texture)
+{
+    auto state = getState();
+    if (state && unit < _textureUnitCount && state->textures[unit] == static_cast<GLint>(texture))
+    {
+        count(false);
+        return;
+    }
+
+    glBindTextureUnit(unit, texture);
+    if (state && unit < _textureUnitCount)
+        state->textures[unit] = texture;
+    count(true);
+}
+
+/*************/
+void GlStateCache::bindFramebuffer(GLenum target, GLuint fbo)
+{
+    auto state = getState();
+    if (state)
+    {
+        bool drawKnown = state->drawFramebuffer == static_cast<GLint>(fbo);
+        bool readKnown = state->readFramebuffer == static_cast<GLint>(fbo);
+        if ((target == GL_DRAW_FRAMEBUFFER && drawKnown) || (target == GL_READ_FRAMEBUFFER && readKnown) || (target == GL_FRAMEBUFFER && drawKnown && readKnown))
+        {
+            count(false);
+            return;
+        }
+    }
+
+    glBindFramebuffer(target, fbo);
+    if (state)
+    {
+        if (target == GL_DRAW_FRAMEBUFFER || target == GL_FRAMEBUFFER)
+            state->drawFramebuffer = fbo;
+        if (target == GL_READ_FRAMEBUFFER || target == GL_FRAMEBUFFER)
+            state->readFramebuffer = fbo;
+    }
+    count(true);
+}
+
+/*************/
+GLuint GlStateCache::getFramebuffer(GLenum target)
+{
+    auto state = getState();
+    auto cached = state ? (target == GL_READ_FRAMEBUFFER ? &state->readFramebuffer : &state->drawFramebuffer) : nullptr;
+    if (cached && *cached != -1)
+        return *cached;
+
+    GLint fbo = 0;
+    glGetIntegerv(target == GL_READ_FRAMEBUFFER ? GL_READ_FRAMEBUFFER_BINDING : GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+    if (cached)
+        *cached = fbo;
+    return fbo;
+}
+
+/*************/
+void GlStateCache::setCapability(GLenum cap, bool enabled)
+{
+    auto state = getState();
+    if (state)
+    {
+        auto capIt = state->capabilities.find(cap);
+        if (capIt != state->capabilities.end() && capIt->second == enabled)
+        {
+            count(false);
+            return;
+        }
+    }
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    if (state)
+        state->capabilities[cap] = enabled;
+    count(true);
+}
+
+/*************/
+void GlStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    auto state = getState();
+    if (state && state->viewportKnown && state->viewport == std::array<GLint, 4>({x, y, width, height}))
+    {
+        count(false);
+        return;
+    }
+
+    glViewport(x, y, width, height);
+    if (state)
+    {
+        state->viewport = {x, y, width, height};
+        state->viewportKnown = true;
+    }
+    count(true);
+}
+
+/*************/
+void GlStateCache::publishCounters()
+{
+    Timer::get().setDuration("glCalls", _callCount.exchange(0, memory_order_relaxed));
+    Timer::get().setDuration("glStateChanges", _changeCount.exchange(0, memory_order_relaxed));
+}
+
+} // end of namespace
@@ -1,5 +1,7 @@
 #include "gpuBuffer.h"
 
+#include "./gl_readback.h"
+
 using namespace std;
 
 namespace Splash
@@ -106,6 +108,23 @@ vector<char> GpuBuffer::getBufferAsVector(size_t vertexNbr)
     return buffer;
 }
 
+/*************/
+void GpuBuffer::getBufferAsVectorAsync(size_t vertexNbr, function<void(vector<char>&&)> callback)
+{
+    if (!_glId || !_type || !_usage || !_elementSize)
+        return;
+
+    auto vectorSize = _baseSize * _elementSize * (vertexNbr ? vertexNbr : _size);
+    auto glId = _glId;
+    GlReadback::get().read(vectorSize,
+        [&](GLuint readbackBuffer) {
+            // The buffer may just have been written by a compute shader
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            glCopyNamedBufferSubData(glId, readbackBuffer, 0, 0, vectorSize);
+        },
+        [=](const char* data, size_t size) { callback(vector<char>(data, data + size)); });
+}
+
 /*************/
 void GpuBuffer::setBufferFromVector(const vector<char>& buffer)
 {
@@ -118,6 +137,34 @@ void GpuBuffer::setBufferFromVector(const vector<char>& buffer)
     glNamedBufferSubData(_glId, 0, buffer.size(), buffer.data());
 }
 
+/*************/
+void* GpuBuffer::mapForWriting(size_t size)
+{
+    if (!_glId || !_type || !_usage || !_elementSize)
+        return nullptr;
+
+    auto memorySize = size * _elementSize * _baseSize;
+    if (size != _size)
+    {
+        glNamedBufferData(_glId, memorySize, nullptr, _usage);
+        _size = size;
+    }
+
+    if (memorySize == 0)
+        return nullptr;
+
+    return glMapNamedBufferRange(_glId, 0, memorySize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+/*************/
+bool GpuBuffer::unmap()
+{
+    if (!_glId)
+        return false;
+
+    return glUnmapNamedBuffer(_glId) == GL_TRUE;
+}
+
 /*************/
 void GpuBuffer::resize(size_t size)
 {
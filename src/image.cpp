@@ -15,12 +15,15 @@
 
 #define SPLASH_IMAGE_COPY_THREADS 2
 #define SPLASH_IMAGE_SERIALIZED_HEADER_SIZE 4096
+#define SPLASH_IMAGE_KEYFRAME_INTERVAL 60
 
 using namespace std;
 
 namespace Splash
 {
 
+atomic_int Image::_streamCount{0};
+
 /*************/
 Image::Image(RootObject* root)
     : BufferObject(root)
@@ -97,7 +100,11 @@ void Image::set(const ImageBuffer& img)
 {
     lock_guard<Spinlock> lockRead(_readMutex);
     if (_image)
+    {
         *_image = img;
+        _imageKeyframe = -1;
+        ++_frameIndex;
+    }
 }
 
 /*************/
@@ -110,9 +117,20 @@ void Image::set(unsigned int w, unsigned int h, unsigned int channels, ImageBuff
     if (!_image)
         _image = unique_ptr<ImageBuffer>(new ImageBuffer());
     std::swap(*_image, img);
+    _imageKeyframe = -1;
+    ++_frameIndex;
     updateTimestamp();
 }
 
+/*************/
+bool Image::getDamage(vector<ImageRegion>& damage) const
+{
+    lock_guard<Spinlock> lock(_readMutex);
+    if (!_image)
+        return false;
+    return _image->getDamage(damage);
+}
+
 /*************/
 shared_ptr<SerializedObject> Image::serialize() const
 {
@@ -124,20 +142,56 @@ shared_ptr<SerializedObject> Image::serialize() const
     // We first get the xml version of the specs, and pack them into the obj
     if (!_image)
         return {};
-    string xmlSpec = _image->getSpec().to_string();
+    auto spec = _image->getSpec();
+    string xmlSpec = spec.to_string();
     int nbrChar = xmlSpec.size();
-    int imgSize = _image->getSpec().rawSize();
-    int totalSize = SPLASH_IMAGE_SERIALIZED_HEADER_SIZE + imgSize;
+    int imgSize = spec.rawSize();
+
+    // Only the regions which changed since the last full frame are sent, as long as the damage of every frame since then is known
+    // and they are small enough. The damage of all these frames has to be accumulated, hence the check on the frame index
+    vector<ImageRegion> frameDamage;
+    vector<ImageRegion> damage;
+    bool isDelta = spec.format.find("DXT") == string::npos && _lastKeyframe >= 0 && _frameIndex == _lastSerializedFrame + 1 &&
+                   _frameIndex - _lastKeyframe < SPLASH_IMAGE_KEYFRAME_INTERVAL && _image->getDamage(frameDamage);
+    int payloadSize = 0;
+    if (isDelta)
+    {
+        damage = _damageSinceKeyframe;
+        ImageBuffer::mergeRegions(damage, frameDamage);
+        for (const auto& region : damage)
+            payloadSize += region.width * region.height * spec.pixelBytes();
+    }
+    if (!isDelta || payloadSize > imgSize / 2)
+    {
+        isDelta = false;
+        damage.clear();
+        payloadSize = imgSize;
+        _lastKeyframe = _frameIndex;
+    }
+
+    int64_t baseFrame = isDelta ? _lastKeyframe : -1;
+    int regionCount = damage.size();
+    _lastSerializedFrame = _frameIndex;
+    _damageSinceKeyframe = damage;
 
+    int totalSize = SPLASH_IMAGE_SERIALIZED_HEADER_SIZE + payloadSize;
     auto obj = make_shared<SerializedObject>(totalSize);
 
     auto currentObjPtr = obj->data();
-    const char* ptr = reinterpret_cast<const char*>(&nbrChar);
-    copy(ptr, ptr + sizeof(nbrChar), currentObjPtr);
-    currentObjPtr += sizeof(nbrChar);
-
-    const char* charPtr = reinterpret_cast<const char*>(xmlSpec.c_str());
-    copy(charPtr, charPtr + nbrChar, currentObjPtr);
+    auto writeHeader = [&](const void* data, size_t size) {
+        const char* ptr = reinterpret_cast<const char*>(data);
+        copy(ptr, ptr + size, currentObjPtr);
+        currentObjPtr += size;
+    };
+
+    writeHeader(&nbrChar, sizeof(nbrChar));
+    writeHeader(xmlSpec.c_str(), nbrChar);
+    writeHeader(&_streamId, sizeof(_streamId));
+    writeHeader(&_frameIndex, sizeof(_frameIndex));
+    writeHeader(&baseFrame, sizeof(baseFrame));
+    writeHeader(&regionCount, sizeof(regionCount));
+    for (const auto& region : damage)
+        writeHeader(&region, sizeof(region));
     currentObjPtr = obj->data() + SPLASH_IMAGE_SERIALIZED_HEADER_SIZE;
 
     // And then, the image
@@ -145,6 +199,7 @@ shared_ptr<SerializedObject> Image::serialize() const
     if (imgPtr == NULL)
         return {};
 
+    if (!isDelta)
     {
         vector<future<void>> threads;
         int stride = SPLASH_IMAGE_COPY_THREADS;
@@ -152,6 +207,21 @@ shared_ptr<SerializedObject> Image::serialize() const
             threads.push_back(async(launch::async, ([=]() { copy(imgPtr + imgSize / stride * i, imgPtr + imgSize / stride * (i + 1), currentObjPtr + imgSize / stride * i); })));
         copy(imgPtr + imgSize / stride * (stride - 1), imgPtr + imgSize, currentObjPtr + imgSize / stride * (stride - 1));
     }
+    else
+    {
+        // Regions are packed one after the other, line by line
+        int lineSize = spec.width * spec.pixelBytes();
+        for (const auto& region : damage)
+        {
+            int regionLineSize = region.width * spec.pixelBytes();
+            for (uint32_t y = region.y; y < region.y + region.height; ++y)
+            {
+                auto linePtr = imgPtr + y * lineSize + region.x * spec.pixelBytes();
+                copy(linePtr, linePtr + regionLineSize, currentObjPtr);
+                currentObjPtr += regionLineSize;
+            }
+        }
+    }
 
     if (Timer::get().isDebug())
         Timer::get() >> "serialize " + _name;
@@ -176,28 +246,107 @@ bool Image::deserialize(const shared_ptr<SerializedObject>& obj)
     copy(currentObjPtr, currentObjPtr + sizeof(nbrChar), ptr);
     currentObjPtr += sizeof(nbrChar);
 
+    auto readHeader = [&](void* data, size_t size) {
+        char* ptr = reinterpret_cast<char*>(data);
+        copy(currentObjPtr, currentObjPtr + size, ptr);
+        currentObjPtr += size;
+    };
+
     try
     {
         char xmlSpecChar[nbrChar];
-        ptr = reinterpret_cast<char*>(xmlSpecChar);
-        copy(currentObjPtr, currentObjPtr + nbrChar, ptr);
+        readHeader(xmlSpecChar, nbrChar);
+        string xmlSpec(xmlSpecChar, nbrChar);
+
+        int streamId;
+        int64_t frame, baseFrame;
+        int regionCount;
+        readHeader(&streamId, sizeof(streamId));
+        readHeader(&frame, sizeof(frame));
+        readHeader(&baseFrame, sizeof(baseFrame));
+        readHeader(&regionCount, sizeof(regionCount));
+        vector<ImageRegion> damage(regionCount);
+        for (auto& region : damage)
+            readHeader(&region, sizeof(region));
         currentObjPtr = obj->data() + SPLASH_IMAGE_SERIALIZED_HEADER_SIZE;
-        string xmlSpec(xmlSpecChar);
 
         ImageBufferSpec spec;
         spec.from_string(xmlSpec.c_str());
 
-        ImageBufferSpec curSpec = _bufferDeserialize.getSpec();
-        if (spec != curSpec)
-            _bufferDeserialize = ImageBuffer(spec);
+        if (baseFrame < 0)
+        {
+            ImageBufferSpec curSpec = _bufferDeserialize.getSpec();
+            if (spec != curSpec)
+                _bufferDeserialize = ImageBuffer(spec);
+
+            auto rawBuffer = obj->grabData();
+            rawBuffer.shift(SPLASH_IMAGE_SERIALIZED_HEADER_SIZE);
+            _bufferDeserialize.setRawBuffer(std::move(rawBuffer));
+            _bufferDeserialize.resetDamage();
+            _bufferDeserializeKeyframe = ++_receivedKeyframes;
+            _deserializedKeyframe = frame;
+        }
+        else
+        {
+            // A partial frame holds all the changes since its full frame, and is applied over any frame received since then.
+            // Without this full frame, it is dropped until the next one
+            if (streamId != _deserializedStream || baseFrame != _deserializedKeyframe || frame <= _deserializedFrame)
+            {
+#ifdef DEBUG
+                Log::get() << Log::DEBUGGING << "Image::" << __FUNCTION__ << " - Dropping a partial frame for image " << _name << ", waiting for a full frame" << Log::endl;
+#endif
+                return false;
+            }
+
+            // The deserialization buffer only has to be filled if it does not derive from the full frame yet,
+            // which happens for the first partial frames following it
+            if (_bufferDeserializeKeyframe != _receivedKeyframes || _bufferDeserialize.getSpec() != spec)
+            {
+                ImageBuffer* baseImage = nullptr;
+                if (_bufferImage && _bufferImageKeyframe == _receivedKeyframes)
+                    baseImage = _bufferImage.get();
+                else if (_image && _imageKeyframe == _receivedKeyframes)
+                    baseImage = _image.get();
+
+                if (!baseImage || baseImage->getSpec() != spec)
+                {
+#ifdef DEBUG
+                    Log::get() << Log::DEBUGGING << "Image::" << __FUNCTION__ << " - No frame to apply the partial frame to for image " << _name << Log::endl;
+#endif
+                    return false;
+                }
+
+                _bufferDeserialize = *baseImage;
+                _bufferDeserializeKeyframe = _receivedKeyframes;
+            }
+
+            auto imgPtr = _bufferDeserialize.data();
+            auto payloadEnd = obj->data() + obj->size();
+            int lineSize = spec.width * spec.pixelBytes();
+            for (const auto& region : damage)
+            {
+                int regionLineSize = region.width * spec.pixelBytes();
+                if (region.x + region.width > spec.width || region.y + region.height > spec.height || currentObjPtr + region.height * regionLineSize > payloadEnd)
+                    throw runtime_error("invalid partial frame");
+
+                for (uint32_t y = region.y; y < region.y + region.height; ++y)
+                {
+                    copy(currentObjPtr, currentObjPtr + regionLineSize, imgPtr + y * lineSize + region.x * spec.pixelBytes());
+                    currentObjPtr += regionLineSize;
+                }
+            }
+            _bufferDeserialize.setDamage(damage);
+        }
 
-        auto rawBuffer = obj->grabData();
-        rawBuffer.shift(SPLASH_IMAGE_SERIALIZED_HEADER_SIZE);
-        _bufferDeserialize.setRawBuffer(std::move(rawBuffer));
+        _deserializedStream = streamId;
+        _deserializedFrame = frame;
 
         if (!_bufferImage)
             _bufferImage = unique_ptr<ImageBuffer>(new ImageBuffer());
+        else if (_imageUpdated)
+            _bufferDeserialize.mergeDamage(*_bufferImage);
         std::swap(*_bufferImage, _bufferDeserialize);
+        std::swap(_bufferImageKeyframe, _bufferDeserializeKeyframe);
         _imageUpdated = true;
 
         updateTimestamp();
@@ -253,6 +402,7 @@ bool Image::readFile(const string& filename)
     if (!_bufferImage)
         _bufferImage = unique_ptr<ImageBuffer>(new ImageBuffer());
     std::swap(*_bufferImage, img);
+    _bufferImageKeyframe = -1;
     _imageUpdated = true;
 
     updateTimestamp();
@@ -275,10 +425,27 @@ void Image::update()
 {
     if (_imageUpdated)
     {
-        lock_guard<Spinlock> lockRead(_readMutex);
-        shared_lock<shared_timed_mutex> lockWrite(_writeMutex);
-        _image.swap(_bufferImage);
-        _imageUpdated = false;
+        {
+            lock_guard<Spinlock> lockRead(_readMutex);
+            shared_lock<shared_timed_mutex> lockWrite(_writeMutex);
+            // Frames to compress are set aside, to be compressed without holding the locks
+            if (_compress)
+            {
+                _uncompressedImage.swap(_bufferImage);
+                _bufferImageKeyframe = -1;
+                _imageKeyframe = -1;
+            }
+            else
+            {
+                _image.swap(_bufferImage);
+                std::swap(_imageKeyframe, _bufferImageKeyframe);
+            }
+            _imageUpdated = false;
+            ++_frameIndex;
+        }
+
+        if (_compress)
+            compressImage();
 
         if (_remoteType.empty() || _type == _remoteType)
             updateMediaInfo();
@@ -289,6 +456,40 @@ void Image::update()
     }
 }
 
+/*************/
+void Image::compressImage()
+{
+    if (!_uncompressedImage)
+        return;
+
+    if (!_compressedImage)
+        _compressedImage = make_unique<ImageBuffer>();
+
+    auto startTime = Timer::getTime();
+    if (!DxtCompressor::compress(*_uncompressedImage, *_compressedImage, _compressionFormat, _compressionQuality))
+    {
+        // Already compressed frames are expected, as from Hap sources
+        auto spec = _uncompressedImage->getSpec();
+        if (!_compressionWarned && spec.format.find("DXT") == string::npos)
+        {
+            Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Frames of format " << spec.format << " and size " << spec.width << "x" << spec.height
+                       << " can not be compressed, they are used as is" << Log::endl;
+            _compressionWarned = true;
+        }
+
+        lock_guard<Spinlock> lockRead(_readMutex);
+        _image.swap(_uncompressedImage);
+        return;
+    }
+    _compressionTime = Timer::getTime() - startTime;
+
+    if (Timer::get().isDebug())
+        Timer::get().setDuration("compress " + _name, _compressionTime);
+
+    lock_guard<Spinlock> lockRead(_readMutex);
+    _image.swap(_compressedImage);
+}
+
 /*************/
 void Image::updateMediaInfo()
 {
@@ -300,6 +501,8 @@ void Image::updateMediaInfo()
     mediaInfo.push_back(Value(spec.channels, "channels"));
     mediaInfo.push_back(Value(spec.format, "format"));
     mediaInfo.push_back(Value(_srgb, "srgb"));
+    if (_compress)
+        mediaInfo.push_back(Value(_compressionTime, "compressionTime"));
     updateMoreMediaInfo(mediaInfo);
     std::swap(_mediaInfo, mediaInfo);
 }
@@ -347,6 +550,8 @@ void Image::createDefaultImage()
     if (!_image)
         _image = unique_ptr<ImageBuffer>(new ImageBuffer());
     std::swap(*_image, img);
+    _imageKeyframe = -1;
+    ++_frameIndex;
     updateTimestamp();
 }
 
@@ -373,6 +578,8 @@ void Image::createPattern()
     if (!_image)
         _image = unique_ptr<ImageBuffer>(new ImageBuffer());
     std::swap(*_image, img);
+    _imageKeyframe = -1;
+    ++_frameIndex;
     updateTimestamp();
 }
 
@@ -440,6 +647,58 @@ void Image::registerAttributes()
         {'n'});
     setAttributeDescription("pattern", "Set to 1 to replace the image with a pattern");
 
+    addAttribute("compression",
+        [&](const Values& args) {
+            auto format = args[0].as<string>();
+            if (format == "none")
+                _compress = false;
+            else if (format == "dxt1")
+                _compressionFormat = DxtCompressor::Format::RGB_DXT1;
+            else if (format == "dxt5")
+                _compressionFormat = DxtCompressor::Format::RGBA_DXT5;
+            else if (format == "ycocg")
+                _compressionFormat = DxtCompressor::Format::YCoCg_DXT5;
+            else
+                return false;
+
+            if (format != "none")
+                _compress = true;
+            _compressionWarned = false;
+            return true;
+        },
+        [&]() -> Values {
+            if (!_compress)
+                return {"none"};
+            switch (_compressionFormat)
+            {
+            default:
+            case DxtCompressor::Format::RGB_DXT1:
+                return {"dxt1"};
+            case DxtCompressor::Format::RGBA_DXT5:
+                return {"dxt5"};
+            case DxtCompressor::Format::YCoCg_DXT5:
+                return {"ycocg"};
+            }
+        },
+        {'s'});
+    setAttributeDescription("compression",
+        "Compress the incoming frames on the CPU before uploading or sending them: none, dxt1, dxt5 (keeps the alpha channel) or ycocg (better quality, same size as dxt5)");
+
+    addAttribute("compressionQuality",
+        [&](const Values& args) {
+            auto quality = args[0].as<string>();
+            if (quality == "fast")
+                _compressionQuality = DxtCompressor::Quality::Fast;
+            else if (quality == "high")
+                _compressionQuality = DxtCompressor::Quality::High;
+            else
+                return false;
+            return true;
+        },
+        [&]() -> Values { return {_compressionQuality == DxtCompressor::Quality::Fast ? "fast" : "high"}; },
+        {'s'});
+    setAttributeDescription("compressionQuality", "Compression quality preset, either fast or high");
+
     addAttribute("mediaInfo",
         [&](const Values& args) {
             _mediaInfo = args;
@@ -1,5 +1,7 @@
 #include "./imageBuffer.h"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace Splash
@@ -127,4 +129,93 @@ void ImageBuffer::zero()
         memset(_buffer.data(), 0, _buffer.size());
 }
 
+/*************/
+bool ImageBuffer::getDamage(vector<ImageRegion>& damage) const
+{
+    if (!_hasDamage)
+        return false;
+
+    damage = _damage;
+    return true;
+}
+
+/*************/
+void ImageBuffer::setDamage(const vector<ImageRegion>& damage)
+{
+    _hasDamage = true;
+    _damage.clear();
+
+    vector<ImageRegion> clippedDamage;
+    for (const auto& region : damage)
+    {
+        // Regions are clipped to the image
+        if (region.x >= _spec.width || region.y >= _spec.height || region.width == 0 || region.height == 0)
+            continue;
+
+        auto clipped = region;
+        clipped.width = std::min(region.width, _spec.width - region.x);
+        clipped.height = std::min(region.height, _spec.height - region.y);
+        clippedDamage.push_back(clipped);
+    }
+
+    mergeRegions(_damage, clippedDamage);
+}
+
+/*************/
+void ImageBuffer::resetDamage()
+{
+    _hasDamage = false;
+    _damage.clear();
+}
+
+/*************/
+void ImageBuffer::mergeDamage(const ImageBuffer& previous)
+{
+    if (!_hasDamage)
+        return;
+
+    if (!previous._hasDamage || previous._spec != _spec)
+    {
+        resetDamage();
+        return;
+    }
+
+    auto damage = _damage;
+    damage.insert(damage.end(), previous._damage.begin(), previous._damage.end());
+    setDamage(damage);
+}
+
+/*************/
+void ImageBuffer::mergeRegions(vector<ImageRegion>& regions, const vector<ImageRegion>& added)
+{
+    auto contains = [](const ImageRegion& a, const ImageRegion& b) {
+        return b.x >= a.x && b.y >= a.y && b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+    };
+
+    for (const auto& region : added)
+    {
+        if (region.width == 0 || region.height == 0)
+            continue;
+        if (any_of(regions.begin(), regions.end(), [&](const ImageRegion& existing) { return contains(existing, region); }))
+            continue;
+        regions.erase(remove_if(regions.begin(), regions.end(), [&](const ImageRegion& existing) { return contains(region, existing); }), regions.end());
+        regions.push_back(region);
+    }
+
+    if (regions.size() <= _maxDamageRegions)
+        return;
+
+    auto bounds = regions[0];
+    for (const auto& region : regions)
+    {
+        auto right = std::max(bounds.x + bounds.width, region.x + region.width);
+        auto bottom = std::max(bounds.y + bounds.height, region.y + region.height);
+        bounds.x = std::min(bounds.x, region.x);
+        bounds.y = std::min(bounds.y, region.y);
+        bounds.width = right - bounds.x;
+        bounds.height = bottom - bounds.y;
+    }
+    regions = {bounds};
+}
+
 } // end of namespace
@@ -1,5 +1,6 @@
 #include "image_shmdata.h"
 
+#include <algorithm>
 #include <hap.h>
 #include <regex>
 
@@ -20,6 +21,7 @@
 #include "timer.h"
 
 #define SPLASH_SHMDATA_THREADS 2
+#define SPLASH_SHMDATA_DAMAGE_TILE_SIZE 64
 #define SPLASH_SHMDATA_WITH_POOL 0 // FIXME: there is an issue with the threadpool in the shmdata callback
 
 using namespace std;
@@ -254,6 +256,7 @@ void Image_Shmdata::readHapFrame(void* data, int data_size)
     unsigned long outputBufferBytes = bufSpec.width * bufSpec.height * bufSpec.channels;
     if (!hapDecodeFrame(data, data_size, _readerBuffer.data(), outputBufferBytes, textureFormat))
         return;
+    _readerBuffer.resetDamage();
 
     if (!_bufferImage)
         _bufferImage = unique_ptr<ImageBuffer>(new ImageBuffer());
@@ -286,9 +289,15 @@ void Image_Shmdata::readUncompressedFrame(void* data, int data_size)
         }
 
         _readerBuffer = ImageBuffer(spec);
+        _tileHashes.clear();
     }
 
-    if (!_isYUV && (_channels == 3 || _channels == 4))
+    bool linearCopy = (!_isYUV && (_channels == 3 || _channels == 4)) || _is422;
+    if (_detectDamage && linearCopy)
+    {
+        copyAndDetectDamage(data, _is422 ? 2 : _channels);
+    }
+    else if (!_isYUV && (_channels == 3 || _channels == 4))
     {
         char* pixels = (char*)(_readerBuffer).data();
         vector<future<void>> threads;
@@ -333,16 +342,150 @@ void Image_Shmdata::readUncompressedFrame(void* data, int data_size)
     else
         return;
 
+    if (!_detectDamage || !linearCopy)
+        _readerBuffer.resetDamage();
+
     if (!_bufferImage)
         _bufferImage = unique_ptr<ImageBuffer>(new ImageBuffer());
+    else if (_imageUpdated)
+        _readerBuffer.mergeDamage(*_bufferImage); // The previous frame has not been consumed yet
     std::swap(*(_bufferImage), _readerBuffer);
     _imageUpdated = true;
     updateTimestamp();
 }
 
+/*************/
+void Image_Shmdata::copyAndDetectDamage(const void* data, int pixelBytes)
+{
+    const int tileSize = SPLASH_SHMDATA_DAMAGE_TILE_SIZE;
+    const int tilesX = (_width + tileSize - 1) / tileSize;
+    const int tilesY = (_height + tileSize - 1) / tileSize;
+    const int lineSize = _width * pixelBytes;
+    const int tileLineSize = tileSize * pixelBytes;
+
+    // Without hashes from a previous frame, the whole frame is considered as changed
+    bool knownPreviousFrame = _tileHashes.size() == static_cast<size_t>(tilesX * tilesY);
+    if (!knownPreviousFrame)
+        _tileHashes.assign(tilesX * tilesY, 0);
+
+    vector<uint8_t> changedTiles(tilesX * tilesY, 0);
+    auto source = static_cast<const char*>(data);
+    auto pixels = _readerBuffer.data();
+
+    // Lines are hashed right after being copied, while they are still in cache
+    auto copyTileRows = [&](int firstTileRow, int lastTileRow) {
+        vector<uint64_t> hashes(tilesX);
+        for (int tileY = firstTileRow; tileY < lastTileRow; ++tileY)
+        {
+            fill(hashes.begin(), hashes.end(), 14695981039346656037ull);
+            int lastLine = std::min(_height, (tileY + 1) * tileSize);
+            for (int y = tileY * tileSize; y < lastLine; ++y)
+            {
+                auto line = pixels + y * lineSize;
+                memcpy(line, source + y * lineSize, lineSize);
+                for (int tileX = 0; tileX < tilesX; ++tileX)
+                {
+                    int start = tileX * tileLineSize;
+                    hashes[tileX] = hashBytes(line + start, std::min(lineSize - start, tileLineSize), hashes[tileX]);
+                }
+            }
+
+            for (int tileX = 0; tileX < tilesX; ++tileX)
+            {
+                auto index = tileY * tilesX + tileX;
+                changedTiles[index] = hashes[tileX] != _tileHashes[index];
+                _tileHashes[index] = hashes[tileX];
+            }
+        }
+    };
+
+    {
+        vector<future<void>> threads;
+        for (int block = 1; block < SPLASH_SHMDATA_THREADS; ++block)
+            threads.push_back(async(launch::async, [=]() { copyTileRows(tilesY * block / SPLASH_SHMDATA_THREADS, tilesY * (block + 1) / SPLASH_SHMDATA_THREADS); }));
+        copyTileRows(0, tilesY / SPLASH_SHMDATA_THREADS);
+    }
+
+    if (!knownPreviousFrame)
+    {
+        _readerBuffer.resetDamage();
+        return;
+    }
+
+    // Consecutive changed tiles of a tile row are merged, and so are runs spanning the same columns on consecutive tile rows
+    vector<ImageRegion> damage;
+    size_t previousRowStart = 0;
+    for (int tileY = 0; tileY < tilesY; ++tileY)
+    {
+        size_t rowStart = damage.size();
+        for (int tileX = 0; tileX < tilesX; ++tileX)
+        {
+            if (!changedTiles[tileY * tilesX + tileX])
+                continue;
+
+            int firstTile = tileX;
+            while (tileX + 1 < tilesX && changedTiles[tileY * tilesX + tileX + 1])
+                ++tileX;
+
+            ImageRegion region;
+            region.x = firstTile * tileSize;
+            region.y = tileY * tileSize;
+            region.width = std::min(_width, (tileX + 1) * tileSize) - region.x;
+            region.height = std::min(_height, (tileY + 1) * tileSize) - region.y;
+
+            auto aboveIt = find_if(damage.begin() + previousRowStart, damage.begin() + rowStart, [&](const ImageRegion& above) {
+                return above.x == region.x && above.width == region.width && above.y + above.height == region.y;
+            });
+            if (aboveIt != damage.begin() + rowStart)
+                aboveIt->height += region.height;
+            else
+                damage.push_back(region);
+        }
+        previousRowStart = rowStart;
+    }
+
+    _readerBuffer.setDamage(damage);
+}
+
+/*************/
+uint64_t Image_Shmdata::hashBytes(const char* data, size_t size, uint64_t hash)
+{
+    // Multiply and xorshift on 64 bits words. A multiplication only carries upwards, so the xorshift is needed to
+    // mix the high bits back downwards: otherwise changes of the highest bit of two words would cancel each other
+    auto mix = [](uint64_t hash, uint64_t word) {
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+        return hash ^ (hash >> 32);
+    };
+
+    size_t index = 0;
+    for (; index + sizeof(uint64_t) <= size; index += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + index, sizeof(word));
+        hash = mix(hash, word);
+    }
+    for (; index < size; ++index)
+        hash = mix(hash, static_cast<uint8_t>(data[index]));
+
+    return hash;
+}
+
 /*************/
 void Image_Shmdata::registerAttributes()
 {
     Image::registerAttributes();
+
+    addAttribute("detectDamage",
+        [&](const Values& args) {
+            lock_guard<shared_timed_mutex> lock(_writeMutex);
+            _detectDamage = args[0].as<int>();
+            _tileHashes.clear();
+            return true;
+        },
+        [&]() -> Values { return {_detectDamage}; },
+        {'n'});
+    setAttributeDescription("detectDamage",
+        "If set to 1, detect the regions which changed from one frame to the next so that only them are uploaded. Useful for sources which change only partially, as user "
+        "interfaces");
 }
 }
@@ -1,5 +1,8 @@
 #include "mesh.h"
 
+#include <cstring>
+#include <limits>
+
 #include "./log.h"
 #include "./meshLoader.h"
 #include "./osUtils.h"
@@ -51,6 +54,71 @@ bool Mesh::operator==(Mesh& otherMesh) const
     return true;
 }
 
+/*************/
+bool Mesh::copyTo(const function<bool(size_t, array<float*, 4>&)>& getArrays) const
+{
+    lock_guard<Spinlock> lock(_readMutex);
+
+    auto verticesNumber = _mesh.vertices.size();
+    if (verticesNumber == 0 || _mesh.uvs.size() != verticesNumber || _mesh.normals.size() != verticesNumber)
+        return false;
+
+    array<float*, 4> arrays{};
+    if (!getArrays(verticesNumber, arrays))
+        return false;
+    auto vertices = arrays[0];
+    auto uvs = arrays[1];
+    auto normals = arrays[2];
+    auto annexe = arrays[3];
+
+    // Vertices, texture coordinates and annexe share the layout of the GPU buffers
+    memcpy(vertices, _mesh.vertices.data(), verticesNumber * sizeof(glm::vec4));
+    memcpy(uvs, _mesh.uvs.data(), verticesNumber * sizeof(glm::vec2));
+
+    for (size_t i = 0; i < verticesNumber; ++i)
+    {
+        auto& normal = _mesh.normals[i];
+        normals[i * 4] = normal[0];
+        normals[i * 4 + 1] = normal[1];
+        normals[i * 4 + 2] = normal[2];
+        normals[i * 4 + 3] = 0.f;
+    }
+
+    if (_mesh.annexe.size() == verticesNumber)
+        memcpy(annexe, _mesh.annexe.data(), verticesNumber * sizeof(glm::vec4));
+    else
+        memset(annexe, 0, verticesNumber * sizeof(glm::vec4));
+
+    return true;
+}
+
+/*************/
+bool Mesh::getBoundingBox(glm::vec3& min, glm::vec3& max) const
+{
+    lock_guard<Spinlock> lock(_readMutex);
+
+    if (_mesh.vertices.empty())
+        return false;
+
+    min = glm::vec3(numeric_limits<float>::max());
+    max = glm::vec3(numeric_limits<float>::lowest());
+    for (auto& v : _mesh.vertices)
+    {
+        auto vertex = glm::vec3(v);
+        min = glm::min(min, vertex);
+        max = glm::max(max, vertex);
+    }
+
+    return true;
+}
+
+/*************/
+size_t Mesh::getVerticesNumber() const
+{
+    lock_guard<Spinlock> lock(_readMutex);
+    return _mesh.vertices.size();
+}
+
 /*************/
 vector<float> Mesh::getVertCoords() const
 {
@@ -1,5 +1,7 @@
 #include "mesh_bezierPatch.h"
 
+#include <future>
+
 #include "log.h"
 
 using namespace std;
@@ -116,6 +118,7 @@ void Mesh_BezierPatch::createPatch(Patch& patch)
 
     _patch = patch;
     _patchUpdated = true;
+    ++_patchUpdateCount;
 
     MeshContainer mesh;
     for (int v = 0; v < height - 1; ++v)
@@ -152,88 +155,105 @@ void Mesh_BezierPatch::createPatch(Patch& patch)
 }
 
 /*************/
-void Mesh_BezierPatch::updatePatch()
+void Mesh_BezierPatch::updateBernsteinBasis(int controlPoints, int resolution, vector<float>& basis)
 {
-    lock_guard<mutex> lock(_patchMutex);
-
-    vector<glm::vec2> vertices;
-    vector<glm::vec2> uvs;
-
-    // Update the binomial coefficients if needed
-    if (_patch.size != _binomialDimensions)
+    basis.resize(controlPoints * resolution);
+    auto degree = controlPoints - 1;
+    for (int s = 0; s < resolution; ++s)
     {
-        _binomialCoeffsX.clear();
-        _binomialCoeffsY.clear();
+        float t = (float)s / ((float)resolution - 1.f);
+        for (int i = 0; i < controlPoints; ++i)
+            basis[i + s * controlPoints] = (float)binomialCoeff(degree, i) * pow(t, (float)i) * pow(1.f - t, (float)(degree - i));
+    }
+}
 
-        for (int i = 0; i < _patch.size.x; ++i)
-            _binomialCoeffsX.push_back((float)binomialCoeff(_patch.size.x - 1, i));
+/*************/
+void Mesh_BezierPatch::runOnRows(int rowCount, const function<void(int, int)>& func)
+{
+    int chunks = rowCount >= _parallelRowThreshold ? _patchThreads : 1;
 
-        for (int i = 0; i < _patch.size.y; ++i)
-            _binomialCoeffsY.push_back((float)binomialCoeff(_patch.size.y - 1, i));
+    vector<future<void>> threads;
+    for (int c = 1; c < chunks; ++c)
+        threads.push_back(async(launch::async, [=, &func]() { func(rowCount * c / chunks, rowCount * (c + 1) / chunks); }));
+    func(0, rowCount / chunks);
+}
 
-        _binomialDimensions = _patch.size;
-    }
+/*************/
+void Mesh_BezierPatch::updatePatch()
+{
+    lock_guard<mutex> lock(_patchMutex);
 
-    // Compute the vertices positions
-    for (int v = 0; v < _patchResolution; ++v)
+    // The basis only depends on the patch size and resolution, and is evaluated once per axis. Each vertex is then
+    // the product of the control points by these two tables
+    if (_patch.size != _bernsteinDimensions || _patchResolution != _bernsteinResolution)
     {
-        glm::vec2 uv;
+        updateBernsteinBasis(_patch.size.x, _patchResolution, _bernsteinX);
+        updateBernsteinBasis(_patch.size.y, _patchResolution, _bernsteinY);
+        _bernsteinDimensions = _patch.size;
+        _bernsteinResolution = _patchResolution;
+    }
 
-        uv.y = (float)v / ((float)_patchResolution - 1.f);
+    const int resolution = _patchResolution;
+    const int sizeX = _patch.size.x;
+    const int sizeY = _patch.size.y;
 
-        for (int u = 0; u < _patchResolution; ++u)
+    // Compute the vertices positions
+    vector<glm::vec2> vertices(resolution * resolution);
+    runOnRows(resolution, [&](int firstRow, int lastRow) {
+        vector<glm::vec2> rowControlPoints(sizeX);
+        for (int v = firstRow; v < lastRow; ++v)
         {
-            uv.x = (float)u / ((float)_patchResolution - 1.f);
-
-            glm::vec2 vertex{0.f, 0.f};
-            for (int j = 0; j < _patch.size.y; ++j)
+            // Control points of the curve along this row
+            const float* basisY = &_bernsteinY[v * sizeY];
+            for (int i = 0; i < sizeX; ++i)
             {
-                for (int i = 0; i < _patch.size.x; ++i)
-                {
-                    float factor = _binomialCoeffsY[j] * pow(uv.y, (float)j) * pow(1.f - uv.y, (float)_patch.size.y - 1.f - (float)j) * _binomialCoeffsX[i] * pow(uv.x, (float)i) *
-                                   pow(1.f - uv.x, (float)_patch.size.x - 1.f - (float)i);
-                    vertex += factor * _patch.vertices[i + j * _patch.size.x];
-                }
+                glm::vec2 point{0.f, 0.f};
+                for (int j = 0; j < sizeY; ++j)
+                    point += basisY[j] * _patch.vertices[i + j * sizeX];
+                rowControlPoints[i] = point;
             }
 
-            vertices.push_back(vertex);
-            uvs.push_back(uv);
+            auto rowVertices = &vertices[v * resolution];
+            for (int u = 0; u < resolution; ++u)
+            {
+                const float* basisX = &_bernsteinX[u * sizeX];
+                glm::vec2 vertex{0.f, 0.f};
+                for (int i = 0; i < sizeX; ++i)
+                    vertex += basisX[i] * rowControlPoints[i];
+                rowVertices[u] = vertex;
+            }
         }
-    }
+    });
 
-    // Create the mesh
-    MeshContainer mesh;
-    for (int v = 0; v < _patchResolution - 1; ++v)
-    {
-        for (int u = 0; u < _patchResolution - 1; ++u)
-        {
-            mesh.vertices.push_back(glm::vec4(vertices[u + v * _patchResolution], 0.0, 1.0));
-            mesh.vertices.push_back(glm::vec4(vertices[u + 1 + v * _patchResolution], 0.0, 1.0));
-            mesh.vertices.push_back(glm::vec4(vertices[u + (v + 1) * _patchResolution], 0.0, 1.0));
+    // Create the mesh, with each row of quads written to its own range
+    const int quadsPerRow = resolution - 1;
+    const size_t verticesNumber = quadsPerRow * quadsPerRow * 6;
 
-            mesh.vertices.push_back(glm::vec4(vertices[u + 1 + v * _patchResolution], 0.0, 1.0));
-            mesh.vertices.push_back(glm::vec4(vertices[u + 1 + (v + 1) * _patchResolution], 0.0, 1.0));
-            mesh.vertices.push_back(glm::vec4(vertices[u + (v + 1) * _patchResolution], 0.0, 1.0));
-
-            mesh.uvs.push_back(uvs[u + v * _patchResolution]);
-            mesh.uvs.push_back(uvs[u + 1 + v * _patchResolution]);
-            mesh.uvs.push_back(uvs[u + (v + 1) * _patchResolution]);
-
-            mesh.uvs.push_back(uvs[u + 1 + v * _patchResolution]);
-            mesh.uvs.push_back(uvs[u + 1 + (v + 1) * _patchResolution]);
-            mesh.uvs.push_back(uvs[u + (v + 1) * _patchResolution]);
+    MeshContainer mesh;
+    mesh.vertices.resize(verticesNumber);
+    mesh.uvs.resize(verticesNumber);
+    mesh.normals.assign(verticesNumber, glm::vec3(0.0, 0.0, 1.0));
 
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
-            mesh.normals.push_back(glm::vec3(0.0, 0.0, 1.0));
+    const float uvStep = 1.f / ((float)resolution - 1.f);
+    runOnRows(quadsPerRow, [&](int firstRow, int lastRow) {
+        for (int v = firstRow; v < lastRow; ++v)
+        {
+            auto vertexIt = mesh.vertices.begin() + v * quadsPerRow * 6;
+            auto uvIt = mesh.uvs.begin() + v * quadsPerRow * 6;
+            for (int u = 0; u < quadsPerRow; ++u)
+            {
+                const int corners[6] = {u + v * resolution, u + 1 + v * resolution, u + (v + 1) * resolution, u + 1 + v * resolution, u + 1 + (v + 1) * resolution, u + (v + 1) * resolution};
+                for (auto corner : corners)
+                {
+                    *vertexIt++ = glm::vec4(vertices[corner], 0.0, 1.0);
+                    *uvIt++ = glm::vec2((float)(corner % resolution) * uvStep, (float)(corner / resolution) * uvStep);
+                }
+            }
         }
-    }
+    });
 
-    _bufferMesh = mesh;
-    _bezierMesh = mesh;
+    _bufferMesh = move(mesh);
+    _bezierMesh = _bufferMesh;
 
     updateTimestamp();
     _meshUpdated = true;
@@ -292,6 +312,7 @@ void Mesh_BezierPatch::registerAttributes()
         [&](const Values& args) {
             _patchResolution = std::max(4, args[0].as<int>());
             _patchUpdated = true;
+            ++_patchUpdateCount;
             updateTimestamp();
             return true;
         },
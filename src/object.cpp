@@ -2,6 +2,7 @@
 
 #include "filter.h"
 #include "geometry.h"
+#include "gl_state_cache.h"
 #include "image.h"
 #include "log.h"
 #include "mesh.h"
@@ -10,6 +11,7 @@
 #include "texture_image.h"
 #include "timer.h"
 
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/euler_angles.hpp>
@@ -51,15 +53,18 @@ Object::~Object()
 }
 
 /*************/
-void Object::activate()
+void Object::activate(bool layered)
 {
     if (_geometries.size() == 0)
         return;
 
     _mutex.lock();
 
+    // Layered rendering uses its own shader, to avoid recompiling when switching between modes
+    auto fill = (layered && (_fill == "texture" || _fill == "primitiveId")) ? _fill + "_layered" : _fill;
+
     // Create and store the shader depending on its type
-    auto shaderIt = _graphicsShaders.find(_fill);
+    auto shaderIt = _graphicsShaders.find(fill);
     if (shaderIt == _graphicsShaders.end() && _fill == "userDefined")
     {
         _graphicsShaders["userDefined"] = _shader;
@@ -67,7 +72,7 @@ void Object::activate()
     else if (shaderIt == _graphicsShaders.end())
     {
         _shader = make_shared<Shader>();
-        _graphicsShaders[_fill] = _shader;
+        _graphicsShaders[fill] = _shader;
     }
     else
     {
@@ -82,14 +87,21 @@ void Object::activate()
     for (auto& p : _fillParameters)
         shaderParameters.push_back(p);
 
+    // Texture arrays are only handled by the texture fill
+    bool textureArray = _fill == "texture" && _textures.size() > 0 && _textures[0]->getType() == "texture_atlas";
+
     if (_fill == "texture")
     {
         if (_vertexBlendingActive)
             shaderParameters.push_back("VERTEXBLENDING");
+        else if (_textureBlendingActive && _geometries[0]->getBlendingMap())
+            shaderParameters.push_back("TEXTUREBLENDING");
         if (_textures.size() > 0 && _textures[0]->getType() == "texture_syphon")
             shaderParameters.push_back("TEXTURE_RECT");
+        else if (textureArray)
+            shaderParameters.push_back("TEXTURE_ARRAY");
 
-        shaderParameters.push_front("texture");
+        shaderParameters.push_front(fill);
         _shader->setAttribute("fill", shaderParameters);
     }
     else if (_fill == "filter")
@@ -107,7 +119,7 @@ void Object::activate()
     }
     else
     {
-        shaderParameters.push_front(_fill);
+        shaderParameters.push_front(fill);
         _shader->setAttribute("fill", shaderParameters);
         _shader->setAttribute("uniform", {"_color", _color.r, _color.g, _color.b, _color.a});
     }
@@ -142,6 +154,33 @@ void Object::activate()
 
         texUnit++;
     }
+
+    if (textureArray)
+        _shader->setAttribute("uniform", {"_tex0_layer", _atlasLayer});
+
+    // The blending map comes after the textures
+    auto blendingMap = _geometries[0]->getBlendingMap();
+    if (_fill == "texture" && !_vertexBlendingActive && _textureBlendingActive && blendingMap)
+        _shader->setTexture(blendingMap, texUnit, "_blendingMap");
+}
+
+/*************/
+void Object::appendRenderSignature(vector<int64_t>& signature) const
+{
+    lock_guard<mutex> lock(_mutex);
+
+    signature.push_back(getUpdateCount());
+    for (auto& geometry : _geometries)
+    {
+        signature.push_back(geometry->getUpdateCount());
+        signature.push_back(geometry->getMeshTimestamp());
+        signature.push_back(geometry->getBuffersUpdateCount());
+    }
+    for (auto& texture : _textures)
+    {
+        signature.push_back(texture->getUpdateCount());
+        signature.push_back(texture->getTimestamp());
+    }
 }
 
 /*************/
@@ -212,6 +251,48 @@ int Object::getVerticesNumber() const
     return nbr;
 }
 
+/*************/
+bool Object::isInFrustum(const glm::dmat4& viewMatrix, const glm::dmat4& projectionMatrix) const
+{
+    lock_guard<mutex> lock(_mutex);
+
+    // User defined shaders may move the vertices around
+    if (_geometries.empty() || _fill == "userDefined")
+        return true;
+
+    // The box has to hold all the geometries of the object, not only the first one
+    glm::vec3 boxMin, boxMax;
+    for (size_t i = 0; i < _geometries.size(); ++i)
+    {
+        glm::vec3 geometryMin, geometryMax;
+        if (!_geometries[i]->getBoundingBox(geometryMin, geometryMax))
+            return true;
+
+        boxMin = i == 0 ? geometryMin : glm::min(boxMin, geometryMin);
+        boxMax = i == 0 ? geometryMax : glm::max(boxMax, geometryMax);
+    }
+
+    // The box is outside of the frustum if all its corners are on the outer side of the same clipping plane
+    auto mvp = projectionMatrix * viewMatrix * computeModelMatrix();
+    int outsideCount[6]{0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 8; ++i)
+    {
+        auto corner = mvp * glm::dvec4(i & 1 ? boxMax.x : boxMin.x, i & 2 ? boxMax.y : boxMin.y, i & 4 ? boxMax.z : boxMin.z, 1.0);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (corner[axis] < -corner.w)
+                ++outsideCount[axis * 2];
+            else if (corner[axis] > corner.w)
+                ++outsideCount[axis * 2 + 1];
+        }
+    }
+
+    for (auto count : outsideCount)
+        if (count == 8)
+            return false;
+    return true;
+}
+
 /*************/
 bool Object::linkTo(const shared_ptr<BaseObject>& obj)
 {
@@ -219,7 +300,14 @@ bool Object::linkTo(const shared_ptr<BaseObject>& obj)
     if (!BaseObject::linkTo(obj))
         return false;
 
-    if (obj->getType().find("texture") != string::npos)
+    // Texture atlases are sampled directly, as filters do not handle texture arrays
+    if (obj->getType().find("texture_atlas") != string::npos)
+    {
+        auto tex = dynamic_pointer_cast<Texture>(obj);
+        addTexture(tex);
+        return true;
+    }
+    else if (obj->getType().find("texture") != string::npos)
     {
         auto filter = dynamic_pointer_cast<Filter>(_root->createObject("filter", getName() + "_" + obj->getName() + "_filter"));
         if (filter->linkTo(obj))
@@ -275,7 +363,12 @@ bool Object::linkTo(const shared_ptr<BaseObject>& obj)
 void Object::unlinkFrom(const shared_ptr<BaseObject>& obj)
 {
     auto type = obj->getType();
-    if (type.find("texture") != string::npos)
+    if (type.find("texture_atlas") != string::npos)
+    {
+        auto tex = dynamic_pointer_cast<Texture>(obj);
+        removeTexture(tex);
+    }
+    else if (type.find("texture") != string::npos)
     {
         auto filterName = getName() + "_" + obj->getName() + "_filter";
 
@@ -422,6 +515,22 @@ void Object::resetBlendingAttribute()
     }
 }
 
+/*************/
+bool Object::hasBlendingMap() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return any_of(_geometries.begin(), _geometries.end(), [](const shared_ptr<Geometry>& geom) { return geom->getBlendingMap() != nullptr; });
+}
+
+/*************/
+void Object::resetBlendingMap(int size)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    for (auto& geom : _geometries)
+        geom->resetBlendingMap(size);
+}
+
 /*************/
 void Object::resetTessellation()
 {
@@ -515,6 +624,182 @@ void Object::transferVisibilityFromTexToAttr(int width, int height, int primitiv
     }
 }
 
+/*************/
+void Object::transferVisibilityFromLayersToAttr(int width, int height, int layerCount, int primitiveIdShift)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (!_computeShaderTransferVisibilityLayersToAttr)
+    {
+        _computeShaderTransferVisibilityLayersToAttr = make_shared<Shader>(Shader::prgCompute);
+        _computeShaderTransferVisibilityLayersToAttr->setAttribute("computePhase", {"transferVisibilityLayersToAttr"});
+    }
+
+    for (auto& geom : _geometries)
+    {
+        geom->update();
+        geom->activateAsSharedBuffer();
+        _computeShaderTransferVisibilityLayersToAttr->setAttribute("uniform", {"_texSize", (float)width, (float)height});
+        _computeShaderTransferVisibilityLayersToAttr->setAttribute("uniform", {"_idShift", primitiveIdShift});
+        _computeShaderTransferVisibilityLayersToAttr->setAttribute("uniform", {"_primitiveNbr", geom->getVerticesNumber() / 3});
+        _computeShaderTransferVisibilityLayersToAttr->doCompute(width / 32 + 1, height / 32 + 1, layerCount);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        geom->deactivate();
+    }
+}
+
+/*************/
+void Object::computeCamerasContribution(const vector<glm::dmat4>& viewMatrices, const vector<glm::dmat4>& projectionMatrices, const vector<float>& blendWidths)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (!_computeShaderComputeCamerasBlending)
+    {
+        _computeShaderComputeCamerasBlending = make_shared<Shader>(Shader::prgCompute);
+        _computeShaderComputeCamerasBlending->setAttribute("computePhase", {"computeCamerasContribution"});
+    }
+
+    auto cameraCount = std::min({viewMatrices.size(), projectionMatrices.size(), blendWidths.size(), static_cast<size_t>(Shader::maxCameraLayers)});
+    auto modelMatrix = computeModelMatrix();
+    Values mvps;
+    Values widths;
+    for (size_t camera = 0; camera < cameraCount; ++camera)
+    {
+        auto mvp = static_cast<glm::mat4>(projectionMatrices[camera] * viewMatrices[camera] * modelMatrix);
+        auto mvpPtr = glm::value_ptr(mvp);
+        for (int i = 0; i < 16; ++i)
+            mvps.push_back(mvpPtr[i]);
+        widths.push_back(blendWidths[camera]);
+    }
+
+    for (auto& geom : _geometries)
+    {
+        geom->update();
+        geom->activateAsSharedBuffer();
+
+        auto verticesNbr = geom->getVerticesNumber();
+        _computeShaderComputeCamerasBlending->setAttribute("uniform", {"_vertexNbr", verticesNbr});
+        _computeShaderComputeCamerasBlending->setAttribute("uniform", {"_sideness", _sideness});
+        _computeShaderComputeCamerasBlending->setAttribute("uniform", {"_cameraCount", static_cast<int>(cameraCount)});
+        _computeShaderComputeCamerasBlending->setAttribute("uniform", {"_mvps", mvps});
+        _computeShaderComputeCamerasBlending->setAttribute("uniform", {"_blendWidths", widths});
+        _computeShaderComputeCamerasBlending->doCompute(verticesNbr / 3 / 128 + 1);
+
+        geom->deactivate();
+
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+/*************/
+void Object::computeCamerasContributionToMap(
+    const vector<glm::dmat4>& viewMatrices, const vector<glm::dmat4>& projectionMatrices, const vector<float>& blendWidths, const vector<glm::vec2>& viewportSizes)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (!_computeShaderComputeCamerasBlendingMap)
+    {
+        _computeShaderComputeCamerasBlendingMap = make_shared<Shader>(Shader::prgCompute);
+        _computeShaderComputeCamerasBlendingMap->setAttribute("computePhase", {"computeCamerasContributionToMap"});
+    }
+
+    if (!_blendingPositionShader)
+    {
+        _blendingPositionShader = make_shared<Shader>();
+        _blendingPositionShader->setAttribute("fill", {"uvPosition"});
+    }
+
+    if (!_blendingPositionFbo)
+    {
+        _blendingPositionFbo = make_unique<Framebuffer>(_root);
+        _blendingPositionFbo->setParameters(0, true);
+    }
+
+    if (!_blendingNormalShader)
+    {
+        _blendingNormalShader = make_shared<Shader>();
+        _blendingNormalShader->setAttribute("fill", {"uvPosition", "NORMAL"});
+    }
+
+    if (!_blendingNormalFbo)
+    {
+        _blendingNormalFbo = make_unique<Framebuffer>(_root);
+        _blendingNormalFbo->setParameters(0, true);
+    }
+
+    auto cameraCount = std::min({viewMatrices.size(), projectionMatrices.size(), blendWidths.size(), viewportSizes.size(), static_cast<size_t>(Shader::maxCameraLayers)});
+    auto modelMatrix = computeModelMatrix();
+    Values mvps;
+    Values widths;
+    Values sizes;
+    for (size_t camera = 0; camera < cameraCount; ++camera)
+    {
+        auto mvp = static_cast<glm::mat4>(projectionMatrices[camera] * viewMatrices[camera] * modelMatrix);
+        auto mvpPtr = glm::value_ptr(mvp);
+        for (int i = 0; i < 16; ++i)
+            mvps.push_back(mvpPtr[i]);
+        widths.push_back(blendWidths[camera]);
+        sizes.push_back(viewportSizes[camera].x);
+        sizes.push_back(viewportSizes[camera].y);
+    }
+
+    for (auto& geom : _geometries)
+    {
+        geom->update();
+
+        auto blendingMap = geom->getBlendingMap();
+        glm::vec3 boxMin, boxMax;
+        if (!blendingMap || !geom->getBoundingBox(boxMin, boxMax))
+            continue;
+        auto boxSize = boxMax - boxMin;
+        auto mapSize = blendingMap->getSpec().width;
+
+        // Render the position and the normal of the surface in texture space, the normal being needed to test the sideness
+        for (auto pass : {make_pair(_blendingPositionShader.get(), _blendingPositionFbo.get()), make_pair(_blendingNormalShader.get(), _blendingNormalFbo.get())})
+        {
+            auto shader = pass.first;
+            auto fbo = pass.second;
+
+            fbo->setSize(mapSize, mapSize);
+            fbo->bindDraw();
+            GlStateCache::get().viewport(0, 0, mapSize, mapSize);
+            glClearColor(0.0, 0.0, 0.0, 0.0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            geom->activate();
+            shader->activate();
+            shader->setAttribute("uniform", {"_boundingBoxMin", boxMin.x, boxMin.y, boxMin.z});
+            shader->setAttribute("uniform", {"_boundingBoxSize", boxSize.x, boxSize.y, boxSize.z});
+            shader->updateUniforms();
+            glDrawArrays(GL_TRIANGLES, 0, geom->getVerticesNumber());
+            shader->deactivate();
+            geom->deactivate();
+
+            fbo->unbindDraw();
+        }
+
+        // Add the contribution of each camera seeing the texels
+        GlStateCache::get().bindTextureUnit(1, _blendingPositionFbo->getColorTexture()->getTexId());
+        GlStateCache::get().bindTextureUnit(2, _blendingNormalFbo->getColorTexture()->getTexId());
+        glBindImageTexture(0, blendingMap->getTexId(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_boundingBoxMin", boxMin.x, boxMin.y, boxMin.z});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_boundingBoxSize", boxSize.x, boxSize.y, boxSize.z});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_cameraCount", static_cast<int>(cameraCount)});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_mvps", mvps});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_blendWidths", widths});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_viewportSizes", sizes});
+        _computeShaderComputeCamerasBlendingMap->setAttribute("uniform", {"_sideness", _sideness});
+        _computeShaderComputeCamerasBlendingMap->doCompute(mapSize / 32 + 1, mapSize / 32 + 1);
+
+        glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+        GlStateCache::get().bindTextureUnit(1, 0);
+        GlStateCache::get().bindTextureUnit(2, 0);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+}
+
 /*************/
 void Object::computeCameraContribution(glm::dmat4 viewMatrix, glm::dmat4 projectionMatrix, float blendWidth)
 {
@@ -556,12 +841,29 @@ void Object::computeCameraContribution(glm::dmat4 viewMatrix, glm::dmat4 project
     }
 }
 
+/*************/
+void Object::setTexturesSampledSize(int width, int height)
+{
+    for (auto& texture : _textures)
+        texture->setSampledSize(width, height);
+}
+
 /*************/
 void Object::setViewProjectionMatrix(const glm::dmat4& mv, const glm::dmat4& mp)
 {
     _shader->setModelViewProjectionMatrix(mv * computeModelMatrix(), mp);
 }
 
+/*************/
+void Object::setLayeredViewProjectionMatrices(const vector<glm::dmat4>& mvs, const vector<glm::dmat4>& mps, int layerMask)
+{
+    auto modelMatrix = computeModelMatrix();
+    vector<glm::dmat4> modelViewMatrices;
+    for (auto& mv : mvs)
+        modelViewMatrices.push_back(mv * modelMatrix);
+    _shader->setLayeredModelViewProjectionMatrices(modelViewMatrices, mps, layerMask);
+}
+
 /*************/
 void Object::registerAttributes()
 {
@@ -577,6 +879,14 @@ void Object::registerAttributes()
         {'n'});
     setAttributeDescription("activateVertexBlending", "If set to 1, activate vertex blending");
 
+    addAttribute("activateTextureBlending",
+        [&](const Values& args) {
+            _textureBlendingActive = args[0].as<int>();
+            return true;
+        },
+        {'n'});
+    setAttributeDescription("activateTextureBlending", "If set to 1, activate blending from the blending map computed in texture space");
+
     addAttribute("position",
         [&](const Values& args) {
             _position = glm::dvec3(args[0].as<float>(), args[1].as<float>(), args[2].as<float>());
@@ -623,6 +933,15 @@ void Object::registerAttributes()
         {'n'});
     setAttributeDescription("sideness", "If set to 0 or 1, the object is single-sided. If set to 2, it is double-sided");
 
+    addAttribute("atlasLayer",
+        [&](const Values& args) {
+            _atlasLayer = std::max(0, args[0].as<int>());
+            return true;
+        },
+        [&]() -> Values { return {_atlasLayer}; },
+        {'n'});
+    setAttributeDescription("atlasLayer", "If the object is linked to a texture atlas, index of the atlas layer to display");
+
     addAttribute("fill",
         [&](const Values& args) {
             _fill = args[0].as<string>();
@@ -46,6 +46,7 @@ shared_ptr<BaseObject> RootObject::createObject(const string& type, const string
     object->setName(name);
     object->setSavable(false);
     _objects[name] = object;
+    _objectsListUpdated = true;
     return object;
 }
 
@@ -56,7 +57,10 @@ void RootObject::disposeObject(const string& name)
 
     auto objectIt = _objects.find(name);
     if (objectIt != _objects.end() && objectIt->second.unique())
+    {
         _objects.erase(objectIt);
+        _objectsListUpdated = true;
+    }
 }
 
 /*************/
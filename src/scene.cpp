@@ -1,5 +1,6 @@
 #include "scene.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "./camera.h"
@@ -7,6 +8,7 @@
 #include "./controller_gui.h"
 #include "./filter.h"
 #include "./geometry.h"
+#include "./gl_readback.h"
 #include "./image.h"
 #include "./link.h"
 #include "./log.h"
@@ -78,6 +80,7 @@ Scene::Scene(const string& name, const string& socketPrefix)
     {
         _blender->setName("blender");
         _objects["blender"] = _blender;
+        _objectsListUpdated = true;
     }
 
     registerAttributes();
@@ -139,6 +142,7 @@ std::shared_ptr<BaseObject> Scene::add(const string& type, const string& name)
             _objects[to_string(obj->getId())] = obj;
         else
             _objects[realName] = obj;
+        _objectsListUpdated = true;
 
         // Some objects have to be connected to the gui (if the Scene is master)
         if (_gui != nullptr)
@@ -174,6 +178,7 @@ void Scene::addGhost(const string& type, const string& name)
         obj->setGhost(true);
         _objects.erase(obj->getName());
         _objects[obj->getName()] = obj;
+        _objectsListUpdated = true;
     }
 }
 
@@ -289,6 +294,7 @@ bool Scene::link(const std::shared_ptr<BaseObject>& first, const std::shared_ptr
     lock_guard<recursive_mutex> lockObjects(_objectsMutex);
 
     bool result = second->linkTo(first);
+    _objectsListUpdated = true;
 
     return result;
 }
@@ -320,6 +326,7 @@ void Scene::unlink(const std::shared_ptr<BaseObject>& first, const std::shared_p
     lock_guard<recursive_mutex> lockObjects(_objectsMutex);
 
     second->unlinkFrom(first);
+    _objectsListUpdated = true;
 }
 
 /*************/
@@ -330,7 +337,10 @@ void Scene::remove(const string& name)
     lock_guard<recursive_mutex> lockObjects(_objectsMutex);
 
     if (_objects.find(name) != _objects.end())
+    {
         _objects.erase(name);
+        _objectsListUpdated = true;
+    }
 }
 
 /*************/
@@ -340,46 +350,32 @@ void Scene::render()
 #ifdef PROFILE
         PROFILEGL("Render loop")
 #endif
-        // Create lists of objects to update and to render
-        map<Priority, vector<shared_ptr<BaseObject>>> objectList{};
+        // Update the render graph, and run all pending tasks for every object
         {
             lock_guard<recursive_mutex> lockObjects(_objectsMutex);
-            for (auto& obj : _objects)
-            {
-                // We also run all pending tasks for every object
-                obj.second->runTasks();
-
-                // Ghosts are not updated in the render loop
-                if (obj.second->isGhost())
-                    continue;
-
-                auto priority = obj.second->getRenderingPriority();
-                if (priority == Priority::NO_RENDER)
-                    continue;
-
-                auto listIt = objectList.find(priority);
-                if (listIt == objectList.end())
-                {
-                    auto entry = objectList.emplace(std::make_pair(priority, vector<shared_ptr<BaseObject>>()));
-                    if (entry.second == true)
-                        listIt = entry.first;
-                    else
-                        continue;
-                }
-
-                listIt->second.push_back(obj.second);
-            }
+            updateRenderGraph();
+            for (auto& weakObject : _renderGraphObjects)
+                if (auto obj = weakObject.lock())
+                    obj->runTasks();
+            // Tasks may have modified the objects list
+            updateRenderGraph();
         }
 
+        // Complete the GPU readbacks queued during the previous frames
+        GlReadback::get().process();
+
         // Update and render the objects
         // See BaseObject::getRenderingPriority() for precision about priorities
         bool firstTextureSync = true; // Sync with the texture upload the first time we need textures
         bool firstWindowSync = true;  // Sync with the texture upload the last time we need textures
         auto textureLock = unique_lock<Spinlock>(_textureMutex, defer_lock);
-        for (auto& objPriority : objectList)
+        int culledObjects = 0;
+        int skippedCameras = 0;
+        vector<shared_ptr<Camera>> layeredCameras;
+        for (auto& renderGroup : _renderGraph)
         {
             // If the objects needs some Textures, we need to sync
-            if (firstTextureSync && objPriority.first > Priority::BLENDING && objPriority.first < Priority::POST_CAMERA)
+            if (firstTextureSync && renderGroup.priority > Priority::BLENDING && renderGroup.priority < Priority::POST_CAMERA)
             {
 #ifdef PROFILE
                 PROFILEGL("texture upload lock");
@@ -395,11 +391,18 @@ void Scene::render()
                 firstTextureSync = false;
             }
 
-            if (objPriority.second.size() != 0)
-                Timer::get() << objPriority.second[0]->getType();
+            Timer::get() << renderGroup.type;
 
-            for (auto& obj : objPriority.second)
+            for (auto& weakObject : renderGroup.objects)
             {
+                auto obj = weakObject.lock();
+                if (!obj)
+                    continue;
+
+                // Priority changes are only checked here, the graph being rebuilt for the next frame
+                if (obj->getRenderingPriority() != renderGroup.priority)
+                    _objectsListUpdated = true;
+
 #ifdef PROFILE
                 PROFILEGL("object " + obj->getName());
 #endif
@@ -417,13 +420,37 @@ void Scene::render()
                     if (obj->wasUpdated())
                         obj->setNotUpdated();
 
+                // Cameras are rendered together once all of them are updated
+                if (_layeredCameras && obj->getType() == "camera")
+                {
+                    layeredCameras.push_back(dynamic_pointer_cast<Camera>(obj));
+                    continue;
+                }
+
                 obj->render();
+
+                if (obj->getType() == "camera")
+                {
+                    auto camera = dynamic_pointer_cast<Camera>(obj);
+                    culledObjects += camera->getCulledObjectCount();
+                    skippedCameras += camera->wasRenderSkipped();
+                }
             }
 
-            if (objPriority.second.size() != 0)
-                Timer::get() >> objPriority.second[0]->getType();
+            if (!layeredCameras.empty())
+            {
+                renderLayeredCameras(layeredCameras);
+                for (auto& camera : layeredCameras)
+                {
+                    culledObjects += camera->getCulledObjectCount();
+                    skippedCameras += camera->wasRenderSkipped();
+                }
+                layeredCameras.clear();
+            }
+
+            Timer::get() >> renderGroup.type;
 
-            if (firstWindowSync && objPriority.first >= Priority::POST_CAMERA)
+            if (firstWindowSync && renderGroup.priority >= Priority::POST_CAMERA)
             {
 #ifdef PROFILE
                 PROFILEGL("texture upload unlock");
@@ -435,24 +462,112 @@ void Scene::render()
             }
         }
 
+        Timer::get().setDuration("culledObjects", culledObjects);
+        Timer::get().setDuration("skippedCameras", skippedCameras);
+
         {
 #ifdef PROFILE
             PROFILEGL("swap buffers");
 #endif
             // Swap all buffers at once
             Timer::get() << "swap";
-            for (auto& obj : _objects)
-                if (obj.second->getType() == "window")
-                    dynamic_pointer_cast<Window>(obj.second)->swapBuffers();
+            for (auto& weakWindow : _renderGraphWindows)
+                if (auto window = weakWindow.lock())
+                    window->swapBuffers();
             Timer::get() >> "swap";
         }
     }
 
+    GlStateCache::get().publishCounters();
+
 #ifdef PROFILE
     ProfilerGL::get().gatherTimings();
 #endif
 }
 
+/*************/
+void Scene::renderLayeredCameras(const vector<shared_ptr<Camera>>& cameras)
+{
+    // Group the cameras greedily, each group being rendered in a single pass
+    vector<vector<shared_ptr<Camera>>> groups;
+    for (auto& camera : cameras)
+    {
+        auto groupIt = find_if(groups.begin(), groups.end(), [&](const vector<shared_ptr<Camera>>& group) {
+            return static_cast<int>(group.size()) < Shader::maxCameraLayers && group[0]->isLayerCompatible(*camera);
+        });
+
+        if (groupIt == groups.end())
+            groups.push_back({camera});
+        else
+            groupIt->push_back(camera);
+    }
+
+    for (auto& group : groups)
+    {
+        if (group.size() == 1)
+            group[0]->render();
+        else
+            group[0]->renderLayered(group);
+    }
+}
+
+/*************/
+void Scene::updateRenderGraph()
+{
+    bool expectedValue = true;
+    if (!_objectsListUpdated.compare_exchange_strong(expectedValue, false))
+        return;
+
+    map<Priority, vector<shared_ptr<BaseObject>>> objectList{};
+    vector<weak_ptr<Window>> windows{};
+    vector<weak_ptr<Texture>> textures{};
+    vector<weak_ptr<Geometry>> geometries{};
+
+    _renderGraphObjects.clear();
+    for (auto& obj : _objects)
+    {
+        _renderGraphObjects.push_back(obj.second);
+
+        if (obj.second->getType() == "window")
+            windows.push_back(dynamic_pointer_cast<Window>(obj.second));
+
+        auto texture = dynamic_pointer_cast<Texture>(obj.second);
+        if (texture)
+            textures.push_back(texture);
+
+        auto geometry = dynamic_pointer_cast<Geometry>(obj.second);
+        if (geometry)
+            geometries.push_back(geometry);
+
+        // Ghosts are not updated in the render loop
+        if (obj.second->isGhost())
+            continue;
+
+        auto priority = obj.second->getRenderingPriority();
+        if (priority == Priority::NO_RENDER)
+            continue;
+
+        objectList[priority].push_back(obj.second);
+    }
+
+    _renderGraph.clear();
+    for (auto& objPriority : objectList)
+    {
+        RenderGroup renderGroup;
+        renderGroup.priority = objPriority.first;
+        renderGroup.type = objPriority.second[0]->getType();
+        for (auto& obj : objPriority.second)
+            renderGroup.objects.push_back(obj);
+        _renderGraph.push_back(renderGroup);
+    }
+
+    _renderGraphWindows = windows;
+
+    lock_guard<mutex> lockRenderGraph(_renderGraphTexturesMutex);
+    _renderGraphTextures = textures;
+    _renderGraphGeometries = geometries;
+}
+
 /*************/
 void Scene::run()
 {
@@ -557,18 +672,24 @@ void Scene::textureUploadRun()
             Timer::get() << "textureUpload";
 
             vector<shared_ptr<Texture>> textures;
+            vector<shared_ptr<Geometry>> geometries;
             bool expectedAtomicValue = false;
             if (_objectsCurrentlyUpdated.compare_exchange_strong(expectedAtomicValue, true, std::memory_order_acquire))
             {
-                for (auto& obj : _objects)
-                {
-                    auto texture = dynamic_pointer_cast<Texture>(obj.second);
-                    if (texture)
+                lock_guard<mutex> lockRenderGraph(_renderGraphTexturesMutex);
+                for (auto& weakTexture : _renderGraphTextures)
+                    if (auto texture = weakTexture.lock())
                         textures.emplace_back(texture);
-                }
+                for (auto& weakGeometry : _renderGraphGeometries)
+                    if (auto geometry = weakGeometry.lock())
+                        geometries.emplace_back(geometry);
                 _objectsCurrentlyUpdated.store(false, std::memory_order_release);
             }
 
+            // Geometries received from the World are staged here, off the render loop
+            for (auto& geometry : geometries)
+                geometry->uploadSerializedMesh();
+
             for (auto& texture : textures)
             {
 #ifdef PROFILE
@@ -636,6 +757,8 @@ void Scene::setAsMaster(const string& configFilePath)
     _colorCalibrator->setName("colorCalibrator");
     _objects["colorCalibrator"] = dynamic_pointer_cast<BaseObject>(_colorCalibrator);
 #endif
+
+    _objectsListUpdated = true;
 }
 
 /*************/
@@ -976,6 +1099,7 @@ void Scene::registerAttributes()
                 for (auto& localObject : _objects)
                     unlink(objectIt->second, localObject.second);
                 _objects.erase(objectIt);
+                _objectsListUpdated = true;
             });
 
             return true;
@@ -1026,6 +1150,24 @@ void Scene::registerAttributes()
         {'s'});
     setAttributeDescription("getObjectsNameByType", "Get a list of the objects having the given type");
 
+    addAttribute("glStateCache",
+        [&](const Values& args) {
+            GlStateCache::get().setEnabled(args[0].as<bool>());
+            return true;
+        },
+        [&]() -> Values { return {(int)GlStateCache::get().isEnabled()}; },
+        {'n'});
+    setAttributeDescription("glStateCache", "If set to 1, redundant OpenGL state changes are filtered out");
+
+    addAttribute("layeredCameras",
+        [&](const Values& args) {
+            _layeredCameras = args[0].as<bool>();
+            return true;
+        },
+        [&]() -> Values { return {(int)_layeredCameras}; },
+        {'n'});
+    setAttributeDescription("layeredCameras", "If set to 1, cameras with the same size seeing the same textured objects are rendered in a single pass");
+
     addAttribute("link",
         [&](const Values& args) {
             addTask([=]() {
@@ -1095,6 +1237,7 @@ void Scene::registerAttributes()
                     object->setName(newName);
                     _objects[newName] = object;
                     _objects.erase(objIt);
+                    _objectsListUpdated = true;
                 }
             });
 
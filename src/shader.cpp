@@ -1,9 +1,12 @@
 #include "shader.h"
 
 #include "log.h"
+#include "osUtils.h"
 #include "shaderSources.h"
 #include "timer.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -15,6 +18,9 @@ using namespace std;
 namespace Splash
 {
 
+// Uniform blocks shared between programs, with their binding point
+static const unordered_map<string, GLuint> sharedUniformBlocks{{"CameraUniforms", Shader::cameraBlockBinding}};
+
 /*************/
 Shader::Shader(ProgramType type)
 {
@@ -86,20 +92,20 @@ void Shader::activate()
 
         for (auto& u : _uniforms)
         {
-            if (u.second.type == "buffer")
-                glUniformBlockBinding(_program, u.second.glIndex, 1);
+            if ((u.second.type == "buffer" || u.second.type == "block") && u.second.glIndex != -1)
+                glUniformBlockBinding(_program, u.second.glIndex, u.second.glBinding);
         }
 
-        glUseProgram(_program);
+        GlStateCache::get().useProgram(_program);
 
         if (_sideness == singleSided)
         {
-            glEnable(GL_CULL_FACE);
+            GlStateCache::get().enable(GL_CULL_FACE);
             glCullFace(GL_BACK);
         }
         else if (_sideness == inverted)
         {
-            glEnable(GL_CULL_FACE);
+            GlStateCache::get().enable(GL_CULL_FACE);
             glCullFace(GL_FRONT);
         }
     }
@@ -113,9 +119,9 @@ void Shader::activate()
         }
 
         _activated = true;
-        glUseProgram(_program);
+        GlStateCache::get().useProgram(_program);
         updateUniforms();
-        glEnable(GL_RASTERIZER_DISCARD);
+        GlStateCache::get().enable(GL_RASTERIZER_DISCARD);
         glBeginTransformFeedback(GL_TRIANGLES);
     }
 }
@@ -126,10 +132,10 @@ void Shader::deactivate()
     if (_programType == prgGraphic)
     {
         if (_sideness != doubleSided)
-            glDisable(GL_CULL_FACE);
+            GlStateCache::get().disable(GL_CULL_FACE);
 
 #ifdef DEBUG
-        glUseProgram(0);
+        GlStateCache::get().useProgram(0);
 #endif
         _activated = false;
         for (int i = 0; i < _textures.size(); ++i)
@@ -139,7 +145,7 @@ void Shader::deactivate()
     else if (_programType == prgFeedback)
     {
         glEndTransformFeedback();
-        glDisable(GL_RASTERIZER_DISCARD);
+        GlStateCache::get().disable(GL_RASTERIZER_DISCARD);
 
         _activated = false;
     }
@@ -148,7 +154,7 @@ void Shader::deactivate()
 }
 
 /*************/
-void Shader::doCompute(GLuint numGroupsX, GLuint numGroupsY)
+void Shader::doCompute(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ)
 {
     if (_programType != prgCompute)
         return;
@@ -160,9 +166,9 @@ void Shader::doCompute(GLuint numGroupsX, GLuint numGroupsY)
     }
 
     _activated = true;
-    glUseProgram(_program);
+    GlStateCache::get().useProgram(_program);
     updateUniforms();
-    glDispatchCompute(numGroupsX, numGroupsY, 1);
+    glDispatchCompute(numGroupsX, numGroupsY, numGroupsZ);
     _activated = false;
 }
 
@@ -178,36 +184,8 @@ map<string, Values> Shader::getUniforms() const
 /*************/
 bool Shader::setSource(const std::string& src, const ShaderType type)
 {
-    GLuint shader = _shaders[type];
-
-    auto parsedSources = src;
-    parseIncludes(parsedSources);
-    const char* shaderSrc = parsedSources.c_str();
-    glShaderSource(shader, 1, (const GLchar**)&shaderSrc, 0);
-    glCompileShader(shader);
-
-    GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    if (status)
-    {
-#ifdef DEBUG
-        Log::get() << Log::DEBUGGING << "Shader::" << __FUNCTION__ << " - Shader of type " << stringFromShaderType(type) << " compiled successfully" << Log::endl;
-#endif
-    }
-    else
-    {
-        Log::get() << Log::WARNING << "Shader::" << __FUNCTION__ << " - Error while compiling a shader of type " << stringFromShaderType(type) << Log::endl;
-        GLint length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        char* log = (char*)malloc(length);
-        glGetShaderInfoLog(shader, length, &length, log);
-        Log::get() << Log::WARNING << "Shader::" << __FUNCTION__ << " - Error log: \n" << (const char*)log << Log::endl;
-        free(log);
-    }
-
-    _shadersSource[type] = parsedSources;
-    _isLinked = false;
-    return status;
+    storeSource(src, type);
+    return compileShader(type);
 }
 
 /*************/
@@ -258,7 +236,7 @@ void Shader::setTexture(const shared_ptr<Texture>& texture, const GLuint texture
         if (uniform.glIndex == -1)
             return;
 
-        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        GlStateCache::get().activeTexture(textureUnit);
         texture->bind();
 
         glUniform1i(uniform.glIndex, textureUnit);
@@ -298,6 +276,83 @@ void Shader::setModelViewProjectionMatrix(const glm::dmat4& mv, const glm::dmat4
             glUniformMatrix4fv(uniformIt->second.glIndex, 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(floatMv))));
 }
 
+/*************/
+void Shader::setLayeredModelViewProjectionMatrices(const vector<glm::dmat4>& mvs, const vector<glm::dmat4>& mps, int layerMask)
+{
+    auto layerCount = std::min(std::min(mvs.size(), mps.size()), static_cast<size_t>(maxCameraLayers));
+
+    vector<glm::mat4> mvpMatrices(layerCount);
+    vector<glm::mat4> normalMatrices(layerCount);
+    for (size_t layer = 0; layer < layerCount; ++layer)
+    {
+        mvpMatrices[layer] = (glm::mat4)(mps[layer] * mvs[layer]);
+        normalMatrices[layer] = glm::transpose(glm::inverse((glm::mat4)mvs[layer]));
+    }
+
+    auto uniformIt = _uniforms.find("_layerCount");
+    if (uniformIt != _uniforms.end())
+        if (uniformIt->second.glIndex != -1)
+            glUniform1i(uniformIt->second.glIndex, layerCount);
+
+    if ((uniformIt = _uniforms.find("_layerMask")) != _uniforms.end())
+        if (uniformIt->second.glIndex != -1)
+            glUniform1i(uniformIt->second.glIndex, layerMask);
+
+    if (layerCount == 0)
+        return;
+
+    if ((uniformIt = _uniforms.find("_layerModelViewProjectionMatrix")) != _uniforms.end())
+        if (uniformIt->second.glIndex != -1)
+            glUniformMatrix4fv(uniformIt->second.glIndex, layerCount, GL_FALSE, glm::value_ptr(mvpMatrices[0]));
+
+    if ((uniformIt = _uniforms.find("_layerNormalMatrix")) != _uniforms.end())
+        if (uniformIt->second.glIndex != -1)
+            glUniformMatrix4fv(uniformIt->second.glIndex, layerCount, GL_FALSE, glm::value_ptr(normalMatrices[0]));
+}
+
+/*************/
+void Shader::storeSource(const std::string& src, const ShaderType type)
+{
+    auto parsedSources = src;
+    parseIncludes(parsedSources);
+
+    _shadersSource[type] = parsedSources;
+    _shadersToCompile.insert(type);
+    _isLinked = false;
+}
+
+/*************/
+bool Shader::compileShader(const ShaderType type)
+{
+    GLuint shader = _shaders[type];
+    _shadersToCompile.erase(type);
+
+    const char* shaderSrc = _shadersSource[type].c_str();
+    glShaderSource(shader, 1, (const GLchar**)&shaderSrc, 0);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status)
+    {
+#ifdef DEBUG
+        Log::get() << Log::DEBUGGING << "Shader::" << __FUNCTION__ << " - Shader of type " << stringFromShaderType(type) << " compiled successfully" << Log::endl;
+#endif
+    }
+    else
+    {
+        Log::get() << Log::WARNING << "Shader::" << __FUNCTION__ << " - Error while compiling a shader of type " << stringFromShaderType(type) << Log::endl;
+        GLint length;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        char* log = (char*)malloc(length);
+        glGetShaderInfoLog(shader, length, &length, log);
+        Log::get() << Log::WARNING << "Shader::" << __FUNCTION__ << " - Error log: \n" << (const char*)log << Log::endl;
+        free(log);
+    }
+
+    return status;
+}
+
 /*************/
 void Shader::compileProgram()
 {
@@ -308,6 +363,10 @@ void Shader::compileProgram()
     _program = glCreateProgram();
     for (auto& shader : _shaders)
     {
+        // Shaders with a deferred compilation are attached when linking
+        if (_shadersToCompile.find(shader.first) != _shadersToCompile.end())
+            continue;
+
         if (glIsShader(shader.second))
         {
             glGetShaderiv(shader.second, GL_COMPILE_STATUS, &status);
@@ -326,7 +385,30 @@ void Shader::compileProgram()
 /*************/
 bool Shader::linkProgram()
 {
+    // Try to get the program from the binary cache first, skipping compilation altogether
+    auto cacheKey = getProgramCacheKey();
+    if (loadProgramBinary(cacheKey))
+    {
+#ifdef DEBUG
+        Log::get() << Log::DEBUGGING << "Shader::" << __FUNCTION__ << " - Shader program " << _currentProgramName << " loaded from the binary cache" << Log::endl;
+#endif
+
+        for (auto src : _shadersSource)
+            parseUniforms(src.second);
+
+        _isLinked = true;
+        return true;
+    }
+
+    // Compile the shaders which compilation has been deferred
+    auto shadersToCompile = _shadersToCompile;
+    for (auto type : shadersToCompile)
+        if (compileShader(static_cast<ShaderType>(type)))
+            glAttachShader(_program, _shaders[type]);
+
     GLint status;
+    if (!cacheKey.empty())
+        glProgramParameteri(_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(_program);
     glGetProgramiv(_program, GL_LINK_STATUS, &status);
     if (status == GL_TRUE)
@@ -335,6 +417,8 @@ bool Shader::linkProgram()
         Log::get() << Log::DEBUGGING << "Shader::" << __FUNCTION__ << " - Shader program " << _currentProgramName << " linked successfully" << Log::endl;
 #endif
 
+        saveProgramBinary(cacheKey);
+
         for (auto src : _shadersSource)
             parseUniforms(src.second);
 
@@ -357,6 +441,149 @@ bool Shader::linkProgram()
     }
 }
 
+/*************/
+string Shader::getProgramCacheKey() const
+{
+    if (getProgramCachePath().empty())
+        return {};
+
+    // The key holds everything which can change the program binary: driver, sources and feedback varyings
+    string key;
+    for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    {
+        auto value = reinterpret_cast<const char*>(glGetString(name));
+        key += string(value ? value : "") + "\n";
+    }
+
+    for (int type = vertex; type <= compute; ++type)
+    {
+        auto sourceIt = _shadersSource.find(type);
+        if (sourceIt == _shadersSource.end())
+            continue;
+        key += "#" + stringFromShaderType(type) + "\n" + sourceIt->second;
+    }
+
+    for (auto& varying : _feedbackVaryings)
+        key += "#varying " + varying + "\n";
+
+    return key;
+}
+
+/*************/
+const string& Shader::getProgramCachePath()
+{
+    static string cachePath = []() -> string {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (formatCount == 0)
+            return {};
+
+        string path;
+        auto cacheEnv = getenv(SPLASH_SHADER_CACHE_ENV);
+        if (cacheEnv)
+            path = string(cacheEnv);
+        else
+            path = Utils::getHomePath() + "/.cache/splash/shaders";
+
+        if (path.empty())
+            return {};
+
+        // Create the directory hierarchy if needed
+        for (auto pos = path.find('/', 1); pos != string::npos; pos = path.find('/', pos + 1))
+            mkdir(path.substr(0, pos).c_str(), 0755);
+        mkdir(path.c_str(), 0755);
+
+        if (!Utils::isDir(path))
+        {
+            Log::get() << Log::WARNING << "Shader::" << __FUNCTION__ << " - Unable to create the shader cache directory " << path << ", shader cache disabled" << Log::endl;
+            return {};
+        }
+
+        return path + "/";
+    }();
+
+    return cachePath;
+}
+
+/*************/
+uint64_t Shader::hashProgramCacheKey(const string& key)
+{
+    // FNV-1a, stored in the cache file to check against filename collisions
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : key)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/*************/
+bool Shader::loadProgramBinary(const string& key)
+{
+    if (key.empty())
+        return false;
+
+    auto filename = getProgramCachePath() + to_string(std::hash<string>()(key)) + ".bin";
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in)
+        return false;
+
+    uint64_t keyHash;
+    GLenum format;
+    GLint length;
+    in.read(reinterpret_cast<char*>(&keyHash), sizeof(keyHash));
+    in.read(reinterpret_cast<char*>(&format), sizeof(format));
+    in.read(reinterpret_cast<char*>(&length), sizeof(length));
+    if (!in || keyHash != hashProgramCacheKey(key) || length <= 0)
+        return false;
+
+    vector<char> binary(length);
+    in.read(binary.data(), length);
+    if (!in)
+        return false;
+
+    glProgramBinary(_program, format, binary.data(), length);
+
+    // The driver may refuse the binary, in which case the program is compiled the usual way
+    GLint status;
+    glGetProgramiv(_program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+/*************/
+void Shader::saveProgramBinary(const string& key)
+{
+    if (key.empty())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(_program, length, nullptr, &format, binary.data());
+
+    // Write to a temporary file first, for concurrent processes not to read a partial file
+    auto filename = getProgramCachePath() + to_string(std::hash<string>()(key)) + ".bin";
+    auto tmpFilename = filename + "." + to_string(getpid());
+    ofstream out(tmpFilename, ios::out | ios::binary);
+    if (!out)
+        return;
+
+    auto keyHash = hashProgramCacheKey(key);
+    out.write(reinterpret_cast<const char*>(&keyHash), sizeof(keyHash));
+    out.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(binary.data(), length);
+    out.close();
+
+    if (!out || rename(tmpFilename.c_str(), filename.c_str()) != 0)
+        remove(tmpFilename.c_str());
+}
+
 /*************/
 void Shader::parseIncludes(std::string& src)
 {
@@ -412,9 +639,20 @@ void Shader::parseUniforms(const std::string& src)
             string next = line.substr(position + 23, string::npos);
             string name = next.substr(0, next.find(" "));
 
+            // Blocks shared between programs are filled by their owner, which binds its own buffer
+            auto sharedBlockIt = sharedUniformBlocks.find(name);
+            if (sharedBlockIt != sharedUniformBlocks.end())
+            {
+                _uniforms[name].type = "block";
+                _uniforms[name].glIndex = glGetUniformBlockIndex(_program, name.c_str());
+                _uniforms[name].glBinding = sharedBlockIt->second;
+                continue;
+            }
+
             _uniforms[name].type = "buffer";
             _uniforms[name].glIndex = glGetUniformBlockIndex(_program, name.c_str());
-            glGenBuffers(1, &_uniforms[name].glBuffer);
+            if (_uniforms[name].glBuffer == 0)
+                glGenBuffers(1, &_uniforms[name].glBuffer);
             _uniforms[name].glBufferReady = false;
         }
         else
@@ -467,7 +705,7 @@ void Shader::parseUniforms(const std::string& src)
                 _uniforms[name].values = {0, 0, 0, 0, 0, 0, 0, 0, 0};
             else if (type == "mat4")
                 _uniforms[name].values = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-            else if (type == "sampler2D" || type == "sampler2DRect" || type == "samplerCube")
+            else if (type == "sampler2D" || type == "sampler2DArray" || type == "sampler2DRect" || type == "samplerCube" || type == "image2D")
                 _uniforms[name].values = {};
             else
             {
@@ -539,14 +777,14 @@ void Shader::parseUniforms(const std::string& src)
     for (auto& u : _uniforms)
     {
         string name = u.first;
-        if (u.second.type != "buffer")
+        if (u.second.type != "buffer" && u.second.type != "block")
         {
             if (glGetUniformLocation(_program, name.c_str()) == -1)
                 u.second.glIndex = -1;
         }
         else
         {
-            if (glGetUniformBlockIndex(_program, name.c_str()) == -1)
+            if (glGetUniformBlockIndex(_program, name.c_str()) == GL_INVALID_INDEX)
                 u.second.glIndex = -1;
         }
     }
@@ -715,6 +953,8 @@ void Shader::updateUniforms()
 void Shader::resetShader(ShaderType type)
 {
     glDeleteShader(_shaders[type]);
+    _shadersSource.erase(type);
+    _shadersToCompile.erase(type);
 
     if (type == vertex)
         _shaders[type] = glCreateShader(GL_VERTEX_SHADER);
@@ -747,7 +987,9 @@ void Shader::registerAttributes()
 
         // Check if the values changed from previous use
         auto uniformIt = _uniforms.find(uniformName);
-        if (uniformIt != _uniforms.end() && Value(uniformArgs) == Value(uniformIt->second.values))
+        if (uniformIt != _uniforms.end() && uniformIt->second.type == "block")
+            return false;
+        else if (uniformIt != _uniforms.end() && Value(uniformArgs) == Value(uniformIt->second.values))
             return true;
         else if (uniformIt == _uniforms.end())
             uniformIt = (_uniforms.emplace(make_pair(uniformName, Uniform()))).first;
@@ -774,9 +1016,20 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = texture;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_TEXTURE, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_TEXTURE, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_TEXTURE, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_TEXTURE, fragment);
+                compileProgram();
+            }
+            else if (args[0].as<string>() == "texture_layered" && (_fill != texture_layered || _shaderOptions != options))
+            {
+                _currentProgramName = args[0].as<string>();
+                _fill = texture_layered;
+                _shaderOptions = options;
+                auto layeredOptions = options + "#define LAYERED\n#define MAX_CAMERA_LAYERS " + to_string(maxCameraLayers) + "\n";
+                storeSource(layeredOptions + ShaderSources.VERTEX_SHADER_TEXTURE, vertex);
+                storeSource(layeredOptions + ShaderSources.GEOMETRY_SHADER_TEXTURE_LAYERED, geometry);
+                storeSource(layeredOptions + ShaderSources.FRAGMENT_SHADER_TEXTURE, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "object_cubemap" && (_fill != object_cubemap || _shaderOptions != options))
@@ -784,9 +1037,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = object_cubemap;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_OBJECT_CUBEMAP, vertex);
-                setSource(options + ShaderSources.GEOMETRY_SHADER_OBJECT_CUBEMAP, geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_OBJECT_CUBEMAP, fragment);
+                storeSource(options + ShaderSources.VERTEX_SHADER_OBJECT_CUBEMAP, vertex);
+                storeSource(options + ShaderSources.GEOMETRY_SHADER_OBJECT_CUBEMAP, geometry);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_OBJECT_CUBEMAP, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "cubemap_projection" && (_fill != cubemap_projection || _shaderOptions != options))
@@ -794,9 +1047,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = object_cubemap;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_CUBEMAP_PROJECTION, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_CUBEMAP_PROJECTION, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_CUBEMAP_PROJECTION, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_CUBEMAP_PROJECTION, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "filter" && (_fill != filter || _shaderOptions != options))
@@ -804,9 +1057,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = filter;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_FILTER, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_FILTER, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_FILTER, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_FILTER, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "color" && (_fill != color || _shaderOptions != options))
@@ -814,9 +1067,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = color;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_COLOR, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_COLOR, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "primitiveId" && (_fill != primitiveId || _shaderOptions != options))
@@ -824,9 +1077,20 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = primitiveId;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_PRIMITIVEID, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_PRIMITIVEID, fragment);
+                compileProgram();
+            }
+            else if (args[0].as<string>() == "primitiveId_layered" && (_fill != primitiveId_layered || _shaderOptions != options))
+            {
+                _currentProgramName = args[0].as<string>();
+                _fill = primitiveId_layered;
+                _shaderOptions = options;
+                auto layeredOptions = options + "#define LAYERED\n#define MAX_CAMERA_LAYERS " + to_string(maxCameraLayers) + "\n";
+                storeSource(layeredOptions + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
+                storeSource(layeredOptions + ShaderSources.GEOMETRY_SHADER_DEFAULT_LAYERED, geometry);
+                storeSource(layeredOptions + ShaderSources.FRAGMENT_SHADER_PRIMITIVEID, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "userDefined" && (_fill != userDefined || _shaderOptions != options))
@@ -835,9 +1099,9 @@ void Shader::registerGraphicAttributes()
                 _fill = userDefined;
                 _shaderOptions = options;
                 if (_shadersSource.find(ShaderType::vertex) == _shadersSource.end())
-                    setSource(options + ShaderSources.VERTEX_SHADER_FILTER, vertex);
+                    storeSource(options + ShaderSources.VERTEX_SHADER_FILTER, vertex);
                 if (_shadersSource.find(ShaderType::fragment) == _shadersSource.end())
-                    setSource(options + ShaderSources.FRAGMENT_SHADER_FILTER, fragment);
+                    storeSource(options + ShaderSources.FRAGMENT_SHADER_FILTER, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "uv" && (_fill != uv || _shaderOptions != options))
@@ -845,9 +1109,19 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = uv;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_DEFAULT, vertex);
+                resetShader(geometry);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_UV, fragment);
+                compileProgram();
+            }
+            else if (args[0].as<string>() == "uvPosition" && (_fill != uvPosition || _shaderOptions != options))
+            {
+                _currentProgramName = args[0].as<string>();
+                _fill = uvPosition;
+                _shaderOptions = options;
+                storeSource(options + ShaderSources.VERTEX_SHADER_UV_POSITION, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_UV, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_UV_POSITION, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "warp" && (_fill != warp || _shaderOptions != options))
@@ -855,9 +1129,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = warp;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_WARP, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_WARP, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_WARP, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_WARP, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "warpControl" && (_fill != warpControl || _shaderOptions != options))
@@ -865,9 +1139,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = warpControl;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_WARP_WIREFRAME, vertex);
-                setSource(options + ShaderSources.GEOMETRY_SHADER_WARP_WIREFRAME, geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_WARP_WIREFRAME, fragment);
+                storeSource(options + ShaderSources.VERTEX_SHADER_WARP_WIREFRAME, vertex);
+                storeSource(options + ShaderSources.GEOMETRY_SHADER_WARP_WIREFRAME, geometry);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_WARP_WIREFRAME, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "wireframe" && (_fill != wireframe || _shaderOptions != options))
@@ -875,9 +1149,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = wireframe;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_WIREFRAME, vertex);
-                setSource(options + ShaderSources.GEOMETRY_SHADER_WIREFRAME, geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_WIREFRAME, fragment);
+                storeSource(options + ShaderSources.VERTEX_SHADER_WIREFRAME, vertex);
+                storeSource(options + ShaderSources.GEOMETRY_SHADER_WIREFRAME, geometry);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_WIREFRAME, fragment);
                 compileProgram();
             }
             else if (args[0].as<string>() == "window" && (_fill != window || _shaderOptions != options))
@@ -885,9 +1159,9 @@ void Shader::registerGraphicAttributes()
                 _currentProgramName = args[0].as<string>();
                 _fill = window;
                 _shaderOptions = options;
-                setSource(options + ShaderSources.VERTEX_SHADER_WINDOW, vertex);
+                storeSource(options + ShaderSources.VERTEX_SHADER_WINDOW, vertex);
                 resetShader(geometry);
-                setSource(options + ShaderSources.FRAGMENT_SHADER_WINDOW, fragment);
+                storeSource(options + ShaderSources.FRAGMENT_SHADER_WINDOW, fragment);
                 compileProgram();
             }
             return true;
@@ -896,12 +1170,16 @@ void Shader::registerGraphicAttributes()
             string fill;
             if (_fill == texture)
                 fill = "texture";
+            else if (_fill == texture_layered)
+                fill = "texture_layered";
             else if (_fill == object_cubemap)
                 fill = "object_cubemap";
             else if (_fill == color)
                 fill = "color";
             else if (_fill == uv)
                 fill = "uv";
+            else if (_fill == uvPosition)
+                fill = "uvPosition";
             else if (_fill == wireframe)
                 fill = "wireframe";
             else if (_fill == window)
@@ -936,25 +1214,49 @@ void Shader::registerComputeAttributes()
         if ("resetVisibility" == args[0].as<string>())
         {
             _currentProgramName = args[0].as<string>();
-            setSource(options + ShaderSources.COMPUTE_SHADER_RESET_VISIBILITY, compute);
+            storeSource(options + ShaderSources.COMPUTE_SHADER_RESET_VISIBILITY, compute);
             compileProgram();
         }
         else if ("resetBlending" == args[0].as<string>())
         {
             _currentProgramName = args[0].as<string>();
-            setSource(options + ShaderSources.COMPUTE_SHADER_RESET_BLENDING, compute);
+            storeSource(options + ShaderSources.COMPUTE_SHADER_RESET_BLENDING, compute);
             compileProgram();
         }
         else if ("computeCameraContribution" == args[0].as<string>())
         {
             _currentProgramName = args[0].as<string>();
-            setSource(options + ShaderSources.COMPUTE_SHADER_COMPUTE_CAMERA_CONTRIBUTION, compute);
+            storeSource(options + ShaderSources.COMPUTE_SHADER_COMPUTE_CAMERA_CONTRIBUTION, compute);
             compileProgram();
         }
         else if ("transferVisibilityToAttr" == args[0].as<string>())
         {
             _currentProgramName = args[0].as<string>();
-            setSource(options + ShaderSources.COMPUTE_SHADER_TRANSFER_VISIBILITY_TO_ATTR, compute);
+            storeSource(options + ShaderSources.COMPUTE_SHADER_TRANSFER_VISIBILITY_TO_ATTR, compute);
+            compileProgram();
+        }
+        else if ("computeCamerasContribution" == args[0].as<string>())
+        {
+            _currentProgramName = args[0].as<string>();
+            storeSource(options + "#define MAX_CAMERA_LAYERS " + to_string(maxCameraLayers) + "\n" + ShaderSources.COMPUTE_SHADER_COMPUTE_CAMERAS_CONTRIBUTION, compute);
+            compileProgram();
+        }
+        else if ("transferVisibilityLayersToAttr" == args[0].as<string>())
+        {
+            _currentProgramName = args[0].as<string>();
+            storeSource(options + ShaderSources.COMPUTE_SHADER_TRANSFER_VISIBILITY_LAYERS_TO_ATTR, compute);
+            compileProgram();
+        }
+        else if ("computeCamerasContributionToMap" == args[0].as<string>())
+        {
+            _currentProgramName = args[0].as<string>();
+            storeSource(options + "#define MAX_CAMERA_LAYERS " + to_string(maxCameraLayers) + "\n" + ShaderSources.COMPUTE_SHADER_COMPUTE_CAMERAS_CONTRIBUTION_TO_MAP, compute);
+            compileProgram();
+        }
+        else if ("yuvConversion" == args[0].as<string>())
+        {
+            _currentProgramName = args[0].as<string>();
+            storeSource(options + ShaderSources.COMPUTE_SHADER_YUV_CONVERSION, compute);
             compileProgram();
         }
 
@@ -979,10 +1281,10 @@ void Shader::registerFeedbackAttributes()
         if ("tessellateFromCamera" == args[0].as<string>())
         {
             _currentProgramName = args[0].as<string>();
-            setSource(options + ShaderSources.VERTEX_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, vertex);
-            setSource(options + ShaderSources.TESS_CTRL_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, tess_ctrl);
-            setSource(options + ShaderSources.TESS_EVAL_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, tess_eval);
-            setSource(options + ShaderSources.GEOMETRY_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, geometry);
+            storeSource(options + ShaderSources.VERTEX_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, vertex);
+            storeSource(options + ShaderSources.TESS_CTRL_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, tess_ctrl);
+            storeSource(options + ShaderSources.TESS_EVAL_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, tess_eval);
+            storeSource(options + ShaderSources.GEOMETRY_SHADER_FEEDBACK_TESSELLATE_FROM_CAMERA, geometry);
             compileProgram();
         }
 
@@ -1003,6 +1305,8 @@ void Shader::registerFeedbackAttributes()
         }
 
         glTransformFeedbackVaryings(_program, args.size(), const_cast<const GLchar**>(feedbackVaryings), GL_SEPARATE_ATTRIBS);
+        _feedbackVaryings = varyingNames;
+        _isLinked = false;
 
         for (int i = 0; i < args.size(); ++i)
             delete feedbackVaryings[i];
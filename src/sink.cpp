@@ -1,7 +1,10 @@
 #include "./sink.h"
 
+#include <algorithm>
 #include <fstream>
 
+#include "./gl_state_cache.h"
+#include "./log.h"
 #include "./timer.h"
 
 using namespace std;
@@ -19,6 +22,8 @@ Sink::Sink(RootObject* root)
 
     if (!_root)
         return;
+
+    _handlerThread = thread([&]() { handlerLoop(); });
 }
 
 /*************/
@@ -27,18 +32,22 @@ Sink::~Sink()
     if (!_root)
         return;
 
-    if (_mappedPixels)
+    stopHandlerThread();
+
+    for (auto& slot : _slots)
     {
-        glUnmapNamedBuffer(_pbos[_pboWriteIndex]);
-        _mappedPixels = nullptr;
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.pixels)
+            glUnmapNamedBuffer(slot.pbo);
+        glDeleteBuffers(1, &slot.pbo);
     }
-
-    glDeleteBuffers(_pbos.size(), _pbos.data());
 }
 
 /*************/
 string Sink::getCaps() const
 {
+    lock_guard<mutex> lock(_queueMutex);
     return "video/x-raw,format=(string)" + _spec.format + ",width=(int)" + to_string(_spec.width) + ",height=(int)" + to_string(_spec.height) + ",framerate=(fraction)" +
            to_string(_framerate) + "/1,pixel-aspect-ratio=(fraction)1/1";
 }
@@ -73,10 +82,30 @@ void Sink::unlinkFrom(const shared_ptr<BaseObject>& obj)
 /*************/
 void Sink::render()
 {
-    if (!_inputTexture || !_mappedPixels)
-        return;
-
-    handlePixels(reinterpret_cast<char*>(_mappedPixels), _spec);
+    // Slots are handed in capture order, so a slot still in flight holds back the next ones
+    while (!_inFlightSlots.empty())
+    {
+        auto index = _inFlightSlots.front();
+        auto& slot = _slots[index];
+        if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        _inFlightSlots.pop_front();
+
+        slot.pixels = static_cast<const char*>(glMapNamedBufferRange(slot.pbo, 0, slot.spec.rawSize(), GL_MAP_READ_BIT));
+
+        lock_guard<mutex> lock(_queueMutex);
+        if (!slot.pixels)
+        {
+            slot.state = SlotState::Free;
+            continue;
+        }
+
+        slot.state = SlotState::Mapped;
+        queueSlot(index);
+    }
 }
 
 /*************/
@@ -85,16 +114,12 @@ void Sink::update()
     if (!_inputTexture)
         return;
 
+    recycleSlots();
+
     auto textureSpec = _inputTexture->getSpec();
     if (textureSpec.rawSize() == 0)
         return;
 
-    if (!_pbos.empty() && _mappedPixels)
-    {
-        glUnmapNamedBuffer(_pbos[_pboWriteIndex]);
-        _mappedPixels = nullptr;
-    }
-
     if (!_opened)
         return;
 
@@ -104,39 +129,112 @@ void Sink::update()
         return;
     _lastFrameTiming = currentTime;
 
-    if (_spec != textureSpec || _pbos.size() != _pboCount)
+    auto readbackSpec = getReadbackSpec(textureSpec);
+    if (_spec != readbackSpec || _slots.size() != _pboCount)
     {
-        updatePbos(textureSpec.width, textureSpec.height, textureSpec.pixelBytes());
-        _spec = textureSpec;
-        _image = ImageBuffer(_spec);
+        resetSlots(readbackSpec.rawSize());
+        lock_guard<mutex> lock(_queueMutex);
+        _spec = readbackSpec;
     }
 
-    // TODO: figure out why replacing glGetTexImage with glGetTextureImage is not straightforward
-    _inputTexture->bind();
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[_pboWriteIndex]);
-    if (_spec.bpp == 32)
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
-    else if (_spec.bpp == 24)
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-    else if (_spec.bpp == 16 && _spec.channels != 1)
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_UNSIGNED_SHORT, 0);
-    else if (_spec.bpp == 16 && _spec.channels == 1)
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_SHORT, 0);
-    else if (_spec.bpp == 8)
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+    // If all the slots are in use, the readback is late and the frame is dropped
+    unique_lock<mutex> lockQueue(_queueMutex);
+    auto slotIt = find_if(_slots.begin(), _slots.end(), [](const ReadbackSlot& slot) { return slot.state == SlotState::Free; });
+    if (slotIt == _slots.end())
+    {
+        ++_droppedFrames;
+        return;
+    }
+    slotIt->state = SlotState::InFlight;
+    lockQueue.unlock();
 
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    _inputTexture->unbind();
+    if (_spec.format == "I420" || _spec.format == "Y42B")
+    {
+        convertToYUV(slotIt->pbo);
+    }
+    else
+    {
+        // TODO: figure out why replacing glGetTexImage with glGetTextureImage is not straightforward
+        _inputTexture->bind();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slotIt->pbo);
+        if (_spec.bpp == 32)
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+        else if (_spec.bpp == 24)
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        else if (_spec.bpp == 16 && _spec.channels != 1)
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_UNSIGNED_SHORT, 0);
+        else if (_spec.bpp == 16 && _spec.channels == 1)
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_SHORT, 0);
+        else if (_spec.bpp == 8)
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        _inputTexture->unbind();
+    }
+
+    slotIt->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slotIt->spec = _spec;
+    slotIt->captureTime = currentTime;
+    _inFlightSlots.push_back(distance(_slots.begin(), slotIt));
+}
 
-    _pboWriteIndex = (_pboWriteIndex + 1) % _pbos.size();
+/*************/
+ImageBufferSpec Sink::getReadbackSpec(const ImageBufferSpec& textureSpec)
+{
+    unique_lock<mutex> lock(_queueMutex);
+    auto format = _outputFormat;
+    int width = _outputWidth > 0 ? _outputWidth : static_cast<int>(textureSpec.width);
+    int height = _outputHeight > 0 ? _outputHeight : static_cast<int>(textureSpec.height);
+    lock.unlock();
 
-    _mappedPixels = (GLubyte*)glMapNamedBufferRange(_pbos[_pboWriteIndex], 0, _spec.rawSize(), GL_MAP_READ_BIT);
+    if (format == "native")
+        return textureSpec;
+
+    if (textureSpec.type != ImageBufferSpec::Type::UINT8 || (textureSpec.channels != 3 && textureSpec.channels != 4))
+    {
+        if (!_conversionWarned)
+            Log::get() << Log::WARNING << "Sink::" << __FUNCTION__ << " - Conversion to " << format << " is only supported for 8bpc RGB(A) textures, falling back to native format"
+                       << Log::endl;
+        _conversionWarned = true;
+        return textureSpec;
+    }
+
+    // The conversion shader handles blocks of 8x2 pixels
+    width = max(8, width - width % 8);
+    height = max(2, height - height % 2);
+    return ImageBufferSpec(width, height, 3, format == "I420" ? 12 : 16, ImageBufferSpec::Type::UINT8, format);
+}
+
+/*************/
+void Sink::convertToYUV(GLuint pbo)
+{
+    if (!_conversionShader || _conversionShaderFormat != _spec.format)
+    {
+        _conversionShader = make_shared<Shader>(Shader::prgCompute);
+        _conversionShader->setAttribute("computePhase", {"yuvConversion", _spec.format == "I420" ? "YUV420" : "YUV422"});
+        _conversionShaderFormat = _spec.format;
+    }
+
+    // Sampling an sRGB texture gives linear values, which are encoded back to match a plain readback
+    GLint internalFormat = 0;
+    glGetTextureLevelParameteriv(_inputTexture->getTexId(), 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    auto srgb = internalFormat == GL_SRGB8_ALPHA8 || internalFormat == GL_SRGB8;
+
+    GlStateCache::get().bindTextureUnit(0, _inputTexture->getTexId());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pbo);
+    _conversionShader->setAttribute("uniform", {"_outputSize", static_cast<int>(_spec.width), static_cast<int>(_spec.height)});
+    _conversionShader->setAttribute("uniform", {"_srgb", static_cast<int>(srgb)});
+    _conversionShader->doCompute((_spec.width / 8 + 7) / 8, (_spec.height / 2 + 7) / 8);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
 }
 
 /*************/
 void Sink::handlePixels(const char* pixels, const ImageBufferSpec& spec)
 {
     auto size = spec.rawSize();
+
+    lock_guard<mutex> lock(_lockPixels);
     if (size != _buffer.size())
         _buffer.resize(size);
 
@@ -144,18 +242,111 @@ void Sink::handlePixels(const char* pixels, const ImageBufferSpec& spec)
 }
 
 /*************/
-void Sink::updatePbos(int width, int height, int bytes)
+void Sink::handlerLoop()
 {
-    if (!_pbos.empty())
-        glDeleteBuffers(_pbos.size(), _pbos.data());
+    unique_lock<mutex> lock(_queueMutex);
+    while (true)
+    {
+        _queueCondition.wait(lock, [&]() { return !_handlerRunning || !_queuedSlots.empty(); });
+        if (!_handlerRunning)
+            return;
+
+        auto index = _queuedSlots.front();
+        _queuedSlots.pop_front();
+        auto pixels = _slots[index].pixels;
+        auto spec = _slots[index].spec;
+        auto captureTime = _slots[index].captureTime;
+        _handlingSlot = true;
+
+        lock.unlock();
+        handlePixels(pixels, spec);
+        lock.lock();
+
+        _slots[index].state = SlotState::Handled;
+        _handlingSlot = false;
+        _latency = Timer::getTime() - captureTime;
+        _queueCondition.notify_all();
+    }
+}
 
-    _pbos.resize(_pboCount);
-    glCreateBuffers(_pbos.size(), _pbos.data());
+/*************/
+void Sink::queueSlot(int index)
+{
+    if (_queuedSlots.size() >= _queueSize)
+    {
+        ++_droppedFrames;
+        if (_dropPolicy == DropPolicy::DropNewest)
+        {
+            _slots[index].state = SlotState::Handled;
+            return;
+        }
+
+        _slots[_queuedSlots.front()].state = SlotState::Handled;
+        _queuedSlots.pop_front();
+    }
 
-    for (int i = 0; i < _pbos.size(); ++i)
-        glNamedBufferData(_pbos[i], width * height * bytes, 0, GL_STREAM_READ);
+    _queuedSlots.push_back(index);
+    _queueCondition.notify_all();
+}
 
-    _pboWriteIndex = 0;
+/*************/
+void Sink::recycleSlots()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    for (auto& slot : _slots)
+    {
+        if (slot.state != SlotState::Handled)
+            continue;
+
+        glUnmapNamedBuffer(slot.pbo);
+        slot.pixels = nullptr;
+        slot.state = SlotState::Free;
+    }
+}
+
+/*************/
+void Sink::resetSlots(int size)
+{
+    {
+        // Queued slots are dropped, and the one being handled is waited for
+        unique_lock<mutex> lock(_queueMutex);
+        _droppedFrames += _queuedSlots.size();
+        _queuedSlots.clear();
+        _queueCondition.wait(lock, [&]() { return !_handlingSlot; });
+    }
+
+    for (auto& slot : _slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.pixels)
+            glUnmapNamedBuffer(slot.pbo);
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    _inFlightSlots.clear();
+
+    vector<ReadbackSlot> slots(_pboCount);
+    for (auto& slot : slots)
+    {
+        glCreateBuffers(1, &slot.pbo);
+        glNamedBufferData(slot.pbo, size, 0, GL_STREAM_READ);
+    }
+
+    lock_guard<mutex> lock(_queueMutex);
+    _slots = move(slots);
+}
+
+/*************/
+void Sink::stopHandlerThread()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _handlerRunning = false;
+        _queueCondition.notify_all();
+    }
+
+    if (_handlerThread.joinable())
+        _handlerThread.join();
 }
 
 /*************/
@@ -170,7 +361,93 @@ void Sink::registerAttributes()
         },
         [&]() -> Values { return {(int)_pboCount}; },
         {'n'});
-    setAttributeDescription("bufferCount", "Number of GPU buffers to use for data download to CPU memory");
+    setAttributeDescription("bufferCount", "Depth of the readback ring, i.e. number of GPU buffers to use for data download to CPU memory");
+
+    addAttribute("queueSize",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_queueMutex);
+            _queueSize = max(args[0].as<int>(), 1);
+            return true;
+        },
+        [&]() -> Values { return {(int)_queueSize}; },
+        {'n'});
+    setAttributeDescription("queueSize", "Maximum number of frames waiting to be handled by the sink output");
+
+    addAttribute("dropPolicy",
+        [&](const Values& args) {
+            auto policy = args[0].as<string>();
+            lock_guard<mutex> lock(_queueMutex);
+            if (policy == "oldest")
+                _dropPolicy = DropPolicy::DropOldest;
+            else if (policy == "newest")
+                _dropPolicy = DropPolicy::DropNewest;
+            else
+                return false;
+            return true;
+        },
+        [&]() -> Values { return {_dropPolicy == DropPolicy::DropOldest ? "oldest" : "newest"}; },
+        {'s'});
+    setAttributeDescription("dropPolicy", "Frame to drop when the output queue is full: 'oldest' queued frame, or 'newest' frame");
+
+    addAttribute("latency",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_queueMutex);
+            return {static_cast<float>(_latency) / 1e3f};
+        });
+    setAttributeParameter("latency", false, true);
+    setAttributeDescription("latency", "Duration between the readback of the last frame and the end of its handling, in ms");
+
+    addAttribute("depth",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_queueMutex);
+            return {static_cast<int>(count_if(_slots.begin(), _slots.end(), [](const ReadbackSlot& slot) { return slot.state != SlotState::Free; }))};
+        });
+    setAttributeParameter("depth", false, true);
+    setAttributeDescription("depth", "Number of buffers of the readback ring currently in use");
+
+    addAttribute("droppedFrames",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_queueMutex);
+            return {static_cast<int64_t>(_droppedFrames)};
+        });
+    setAttributeParameter("droppedFrames", false, true);
+    setAttributeDescription("droppedFrames", "Number of frames dropped since the sink creation, because the readback ring or the output queue was full");
+
+    addAttribute("outputFormat",
+        [&](const Values& args) {
+            auto format = args[0].as<string>();
+            if (format != "native" && format != "I420" && format != "Y42B")
+                return false;
+            lock_guard<mutex> lock(_queueMutex);
+            _outputFormat = format;
+            return true;
+        },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_queueMutex);
+            return {_outputFormat};
+        },
+        {'s'});
+    setAttributeDescription("outputFormat",
+        "Format of the frames read back: 'native' for the input texture format, 'I420' or 'Y42B' for planar YUV 4:2:0 or 4:2:2 converted on the GPU (8bpc RGB(A) inputs "
+        "only)");
+
+    addAttribute("outputSize",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_queueMutex);
+            _outputWidth = max(0, args[0].as<int>());
+            _outputHeight = max(0, args[1].as<int>());
+            return true;
+        },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_queueMutex);
+            return {_outputWidth, _outputHeight};
+        },
+        {'n', 'n'});
+    setAttributeDescription("outputSize",
+        "Size of the frames read back when converting to YUV, 0 meaning the input size. It is rounded down to a multiple of 8 in width and 2 in height");
 
     addAttribute("framerate",
         [&](const Values& args) {
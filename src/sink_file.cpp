@@ -0,0 +1,632 @@
+#include "./sink_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "./log.h"
+#include "./timer.h"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+Sink_File::Sink_File(RootObject* root)
+    : Sink(root)
+{
+    _type = "sink_file";
+    registerAttributes();
+
+    av_register_all();
+
+    if (!_root)
+        return;
+
+    _writerThread = thread([&]() { writerLoop(); });
+}
+
+/*************/
+Sink_File::~Sink_File()
+{
+    stopHandlerThread();
+
+    {
+        lock_guard<mutex> lock(_muxerMutex);
+        closeSegment();
+    }
+
+    stopWriterThread();
+    for (auto& block : _freeBlocks)
+        free(block);
+}
+
+/*************/
+void Sink_File::update()
+{
+    // The sink can not be closed from the handler thread, and frames would be read back for nothing until then
+    if (_recordingFailed.exchange(false) && !_recording)
+        setAttribute("opened", {0});
+
+    Sink::update();
+}
+
+/*************/
+void Sink_File::encodeFrame(AVFrame* frame)
+{
+    if (avcodec_send_frame(_context, frame) < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Error encoding frame" << Log::endl;
+        return;
+    }
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+
+    while (avcodec_receive_packet(_context, &packet) == 0)
+    {
+        av_packet_rescale_ts(&packet, _context->time_base, _stream->time_base);
+        packet.stream_index = _stream->index;
+        if (av_interleaved_write_frame(_formatContext, &packet) < 0)
+            Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Error writing frame to " << getSegmentPath() << Log::endl;
+    }
+}
+
+/*************/
+bool Sink_File::getEncoderSettings(string& encoderName, AVPixelFormat& pixelFormat, string& hapFormat) const
+{
+    hapFormat = "";
+    if (_codecName == "hap" || _codecName == "hap_alpha" || _codecName == "hap_q")
+    {
+        encoderName = "hap";
+        pixelFormat = AV_PIX_FMT_RGBA;
+        hapFormat = _codecName;
+    }
+    else if (_codecName == "prores")
+    {
+        encoderName = "prores_ks";
+        pixelFormat = AV_PIX_FMT_YUV422P10LE;
+    }
+    else if (_codecName == "mjpeg")
+    {
+        encoderName = "mjpeg";
+        pixelFormat = AV_PIX_FMT_YUVJ422P;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*************/
+AVPixelFormat Sink_File::getInputPixelFormat(const ImageBufferSpec& spec)
+{
+    if (spec.format == "I420")
+        return AV_PIX_FMT_YUV420P;
+    else if (spec.format == "Y42B")
+        return AV_PIX_FMT_YUV422P;
+    else if (spec.type != ImageBufferSpec::Type::UINT8)
+        return AV_PIX_FMT_NONE;
+    else if (spec.channels == 4 && spec.bpp == 32)
+        return AV_PIX_FMT_RGBA;
+    else if (spec.channels == 3 && spec.bpp == 24)
+        return AV_PIX_FMT_RGB24;
+
+    return AV_PIX_FMT_NONE;
+}
+
+/*************/
+string Sink_File::getSegmentPath() const
+{
+    // A new recording in the same file would overwrite the previous one, so takes following the first one are numbered too
+    if (_segmentDuration == 0 && _segmentIndex == 0)
+        return _path;
+
+    auto index = to_string(_segmentIndex);
+    index = string(max(0, 4 - static_cast<int>(index.size())), '0') + index;
+
+    auto extensionPos = _path.rfind('.');
+    auto separatorPos = _path.rfind('/');
+    if (extensionPos == string::npos || (separatorPos != string::npos && extensionPos < separatorPos))
+        return _path + "_" + index;
+
+    return _path.substr(0, extensionPos) + "_" + index + _path.substr(extensionPos);
+}
+
+/*************/
+void Sink_File::handlePixels(const char* pixels, const ImageBufferSpec& spec)
+{
+    if (!pixels || spec.rawSize() == 0)
+        return;
+
+    lock_guard<mutex> lock(_muxerMutex);
+    if (!_recording)
+        return;
+
+    // Frames are dropped rather than letting the write backlog grow past its bound
+    {
+        lock_guard<mutex> lockWrite(_writeMutex);
+        if (_queuedBytes >= _maxQueuedBytes)
+        {
+            ++_recordDroppedFrames;
+            return;
+        }
+    }
+
+    auto currentTime = Timer::getTime();
+    if (_formatContext)
+    {
+        bool segmentEnded = _segmentDuration > 0 && currentTime - _segmentStart >= static_cast<int64_t>(_segmentDuration) * 1000000;
+        if (segmentEnded || spec != _recordSpec)
+            closeSegment();
+    }
+
+    if (!_formatContext)
+    {
+        if (!openSegment(spec))
+        {
+            Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to open " << getSegmentPath() << ", recording stopped" << Log::endl;
+            closeSegment();
+            _recording = false;
+            _recordingFailed = true;
+            return;
+        }
+
+        _segmentStart = currentTime;
+        _lastPts = -1;
+    }
+
+    if (av_frame_make_writable(_frame) < 0)
+        return;
+
+    // Rows are read back bottom to top, so they are flipped with negative strides
+    auto inputFormat = getInputPixelFormat(spec);
+    auto formatDescriptor = av_pix_fmt_desc_get(inputFormat);
+    uint8_t* planes[4];
+    int linesizes[4];
+    av_image_fill_arrays(planes, linesizes, reinterpret_cast<const uint8_t*>(pixels), inputFormat, spec.width, spec.height, 1);
+    for (int plane = 0; plane < 4; ++plane)
+    {
+        if (!planes[plane] || linesizes[plane] == 0)
+            continue;
+        int planeHeight = (plane == 1 || plane == 2) ? AV_CEIL_RSHIFT(static_cast<int>(spec.height), formatDescriptor->log2_chroma_h) : static_cast<int>(spec.height);
+        planes[plane] += (planeHeight - 1) * linesizes[plane];
+        linesizes[plane] = -linesizes[plane];
+    }
+    sws_scale(_swsContext, planes, linesizes, 0, spec.height, _frame->data, _frame->linesize);
+
+    auto pts = static_cast<int64_t>(round(static_cast<double>(currentTime - _segmentStart) * _framerate / 1e6));
+    _frame->pts = max(pts, _lastPts + 1);
+    _lastPts = _frame->pts;
+    _frame->quality = _context->global_quality;
+
+    encodeFrame(_frame);
+}
+
+/*************/
+bool Sink_File::openSegment(const ImageBufferSpec& spec)
+{
+    string encoderName;
+    AVPixelFormat pixelFormat;
+    string hapFormat;
+    if (!getEncoderSettings(encoderName, pixelFormat, hapFormat))
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Codec " << _codecName << " is not supported" << Log::endl;
+        return false;
+    }
+
+    auto inputFormat = getInputPixelFormat(spec);
+    if (inputFormat == AV_PIX_FMT_NONE)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Input format " << spec.format << " is not supported" << Log::endl;
+        return false;
+    }
+
+    auto codec = avcodec_find_encoder_by_name(encoderName.c_str());
+    if (!codec && encoderName == "prores_ks")
+        codec = avcodec_find_encoder_by_name("prores");
+    if (!codec)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to find encoder " << encoderName << Log::endl;
+        return false;
+    }
+
+    auto path = getSegmentPath();
+    avformat_alloc_output_context2(&_formatContext, nullptr, nullptr, path.c_str());
+    if (!_formatContext)
+        avformat_alloc_output_context2(&_formatContext, nullptr, "mov", path.c_str());
+    if (!_formatContext)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to allocate output context for file " << path << Log::endl;
+        return false;
+    }
+
+    _context = avcodec_alloc_context3(codec);
+    if (!_context)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to allocate video codec context for encoder " << encoderName << Log::endl;
+        return false;
+    }
+
+    _context->width = spec.width;
+    _context->height = spec.height;
+    _context->time_base = (AVRational){1, static_cast<int>(_framerate)};
+    _context->sample_aspect_ratio = (AVRational){1, 1};
+    _context->pix_fmt = pixelFormat;
+    if (_formatContext->oformat->flags & AVFMT_GLOBALHEADER)
+        _context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (!hapFormat.empty())
+    {
+        av_opt_set(_context->priv_data, "format", hapFormat.c_str(), 0);
+    }
+    else if (encoderName == "mjpeg")
+    {
+        _context->flags |= AV_CODEC_FLAG_QSCALE;
+        _context->global_quality = FF_QP2LAMBDA * 2;
+    }
+
+    if (avcodec_open2(_context, codec, nullptr) < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to open encoder " << encoderName << Log::endl;
+        return false;
+    }
+
+    _stream = avformat_new_stream(_formatContext, nullptr);
+    if (!_stream)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to create video stream" << Log::endl;
+        return false;
+    }
+    _stream->time_base = _context->time_base;
+    avcodec_parameters_from_context(_stream->codecpar, _context);
+
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to open file " << path << ": " << strerror(errno) << Log::endl;
+        return false;
+    }
+    _position = 0;
+    _fileSize = 0;
+    _writeError = false;
+
+    // The muxer writes through the write blocks, the writer thread doing the actual file IO
+    auto ioBuffer = static_cast<uint8_t*>(av_malloc(_ioBufferSize));
+    _ioContext = avio_alloc_context(ioBuffer, _ioBufferSize, 1, this, nullptr, &Sink_File::writePacket, &Sink_File::seekPacket);
+    if (!_ioContext)
+    {
+        av_free(ioBuffer);
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to allocate IO context" << Log::endl;
+        return false;
+    }
+    _formatContext->pb = _ioContext;
+    _formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    if (avformat_write_header(_formatContext, nullptr) < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to write header to file " << path << Log::endl;
+        return false;
+    }
+
+    _swsContext = sws_getContext(spec.width, spec.height, inputFormat, spec.width, spec.height, pixelFormat, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+    _frame = av_frame_alloc();
+    if (!_frame)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to allocate frame" << Log::endl;
+        return false;
+    }
+    _frame->format = pixelFormat;
+    _frame->width = spec.width;
+    _frame->height = spec.height;
+    if (av_frame_get_buffer(_frame, 32) < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Unable to allocate picture buffer" << Log::endl;
+        return false;
+    }
+
+    _recordSpec = spec;
+    return true;
+}
+
+/*************/
+void Sink_File::closeSegment()
+{
+    // The trailer is only written if the segment was fully opened
+    if (_formatContext && _recordSpec != ImageBufferSpec())
+    {
+        encodeFrame(nullptr);
+        av_write_trailer(_formatContext);
+    }
+
+    if (_ioContext)
+    {
+        avio_flush(_ioContext);
+        av_freep(&_ioContext->buffer);
+        avio_context_free(&_ioContext);
+    }
+
+    if (_fd >= 0)
+    {
+        queueBlock(true);
+        _fd = -1;
+        ++_segmentIndex;
+    }
+
+    if (_context)
+        avcodec_free_context(&_context);
+
+    if (_formatContext)
+    {
+        avformat_free_context(_formatContext);
+        _formatContext = nullptr;
+        _stream = nullptr;
+    }
+
+    if (_swsContext)
+    {
+        sws_freeContext(_swsContext);
+        _swsContext = nullptr;
+    }
+
+    if (_frame)
+        av_frame_free(&_frame);
+
+    _recordSpec = ImageBufferSpec();
+}
+
+/*************/
+void Sink_File::appendToBlock(const uint8_t* buffer, int size)
+{
+    while (size > 0)
+    {
+        if (!_currentBlock.data)
+        {
+            lock_guard<mutex> lock(_writeMutex);
+            if (!_freeBlocks.empty())
+            {
+                _currentBlock.data = _freeBlocks.back();
+                _freeBlocks.pop_back();
+            }
+            else
+            {
+                void* block{nullptr};
+                if (posix_memalign(&block, _blockAlignment, _blockSize) != 0)
+                    return;
+                _currentBlock.data = static_cast<uint8_t*>(block);
+            }
+            _currentBlock.size = 0;
+            _currentBlock.offset = _position;
+        }
+
+        auto count = min<size_t>(size, _blockSize - _currentBlock.size);
+        memcpy(_currentBlock.data + _currentBlock.size, buffer, count);
+        _currentBlock.size += count;
+        _position += count;
+        _fileSize = max(_fileSize, _position);
+        buffer += count;
+        size -= count;
+
+        if (_currentBlock.size == _blockSize)
+            queueBlock();
+    }
+}
+
+/*************/
+void Sink_File::queueBlock(bool closeFile)
+{
+    lock_guard<mutex> lock(_writeMutex);
+    if (_currentBlock.data && _currentBlock.size == 0)
+    {
+        _freeBlocks.push_back(_currentBlock.data);
+        _currentBlock.data = nullptr;
+    }
+
+    if (_currentBlock.data || closeFile)
+    {
+        _currentBlock.fd = _fd;
+        _currentBlock.closeFile = closeFile;
+        _queuedBytes += _currentBlock.size;
+        _writeQueue.push_back(_currentBlock);
+        _writeCondition.notify_all();
+    }
+
+    _currentBlock = WriteBlock();
+}
+
+/*************/
+void Sink_File::writerLoop()
+{
+    unique_lock<mutex> lock(_writeMutex);
+    while (true)
+    {
+        _writeCondition.wait(lock, [&]() { return !_writerRunning || !_writeQueue.empty(); });
+        if (_writeQueue.empty())
+            return;
+
+        auto block = _writeQueue.front();
+        _writeQueue.pop_front();
+        lock.unlock();
+
+        size_t written = 0;
+        while (written < block.size)
+        {
+            auto result = pwrite(block.fd, block.data + written, block.size - written, block.offset + written);
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            if (result < 0)
+            {
+                if (!_writeError)
+                    Log::get() << Log::WARNING << "Sink_File::" << __FUNCTION__ << " - Error while writing to file: " << strerror(errno) << Log::endl;
+                _writeError = true;
+                break;
+            }
+
+            written += result;
+        }
+
+        if (block.closeFile)
+            ::close(block.fd);
+
+        lock.lock();
+        if (block.data)
+            _freeBlocks.push_back(block.data);
+        _queuedBytes -= block.size;
+    }
+}
+
+/*************/
+void Sink_File::stopWriterThread()
+{
+    {
+        lock_guard<mutex> lock(_writeMutex);
+        _writerRunning = false;
+        _writeCondition.notify_all();
+    }
+
+    if (_writerThread.joinable())
+        _writerThread.join();
+}
+
+/*************/
+int Sink_File::writePacket(void* opaque, uint8_t* buffer, int size)
+{
+    auto sink = static_cast<Sink_File*>(opaque);
+    sink->appendToBlock(buffer, size);
+    return size;
+}
+
+/*************/
+int64_t Sink_File::seekPacket(void* opaque, int64_t offset, int whence)
+{
+    auto sink = static_cast<Sink_File*>(opaque);
+    if (whence & AVSEEK_SIZE)
+        return sink->_fileSize;
+
+    int64_t position = -1;
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    default:
+        return -1;
+    case SEEK_SET:
+        position = offset;
+        break;
+    case SEEK_CUR:
+        position = sink->_position + offset;
+        break;
+    case SEEK_END:
+        position = sink->_fileSize + offset;
+        break;
+    }
+
+    if (position < 0)
+        return -1;
+
+    // Blocks hold their offset, so the block being filled is queued and a new one starts at the new position
+    if (position != sink->_position)
+    {
+        sink->queueBlock();
+        sink->_position = position;
+    }
+
+    return position;
+}
+
+/*************/
+void Sink_File::registerAttributes()
+{
+    Sink::registerAttributes();
+
+    addAttribute("path",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_muxerMutex);
+            _path = args[0].as<string>();
+            _segmentIndex = 0;
+            return true;
+        },
+        [&]() -> Values { return {_path}; },
+        {'s'});
+    setAttributeDescription("path", "Path of the recorded file. When segmenting, or when recording again to the same path, the file index is appended to the file name");
+
+    addAttribute("codec",
+        [&](const Values& args) {
+            auto codecName = args[0].as<string>();
+            transform(codecName.begin(), codecName.end(), codecName.begin(), ::tolower);
+            if (codecName != "hap" && codecName != "hap_alpha" && codecName != "hap_q" && codecName != "prores" && codecName != "mjpeg")
+                return false;
+            lock_guard<mutex> lock(_muxerMutex);
+            _codecName = codecName;
+            return true;
+        },
+        [&]() -> Values { return {_codecName}; },
+        {'s'});
+    setAttributeDescription("codec", "Intra-frame codec used for recording: hap, hap_alpha, hap_q, prores or mjpeg. It applies to the next recorded file");
+
+    addAttribute("segmentDuration",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_muxerMutex);
+            _segmentDuration = max(0, args[0].as<int>());
+            return true;
+        },
+        [&]() -> Values { return {_segmentDuration}; },
+        {'n'});
+    setAttributeDescription("segmentDuration", "Duration of each recorded file in seconds, a new file being started once reached. 0 records a single file");
+
+    addAttribute("bufferSize",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_writeMutex);
+            _maxQueuedBytes = static_cast<size_t>(max(8, args[0].as<int>())) << 20;
+            return true;
+        },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_writeMutex);
+            return {static_cast<int>(_maxQueuedBytes >> 20)};
+        },
+        {'n'});
+    setAttributeDescription("bufferSize", "Maximum amount of data waiting to be written to disk in MB, frames being dropped past it");
+
+    addAttribute("record",
+        [&](const Values& args) {
+            auto record = args[0].as<int>() > 0;
+            {
+                lock_guard<mutex> lock(_muxerMutex);
+                if (!record)
+                    closeSegment();
+                _recording = record;
+                _recordingFailed = false;
+            }
+            setAttribute("opened", {static_cast<int>(record)});
+            return true;
+        },
+        [&]() -> Values { return {static_cast<int>(_recording.load())}; },
+        {'n'});
+    setAttributeParameter("record", false, true);
+    setAttributeDescription("record", "Set to 1 to start recording, and to 0 to stop and finalize the current file");
+
+    addAttribute("recordDroppedFrames",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {static_cast<int64_t>(_recordDroppedFrames.load())}; });
+    setAttributeParameter("recordDroppedFrames", false, true);
+    setAttributeDescription("recordDroppedFrames", "Number of frames dropped since the sink creation because the disk could not keep up");
+
+    addAttribute("writeBacklog",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_writeMutex);
+            return {static_cast<float>(_queuedBytes) / static_cast<float>(1 << 20)};
+        });
+    setAttributeParameter("writeBacklog", false, true);
+    setAttributeDescription("writeBacklog", "Amount of data waiting to be written to disk, in MB");
+}
+
+} // end of namespace
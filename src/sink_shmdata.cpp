@@ -13,6 +13,12 @@ Sink_Shmdata::Sink_Shmdata(RootObject* root)
     registerAttributes();
 }
 
+/*************/
+Sink_Shmdata::~Sink_Shmdata()
+{
+    stopHandlerThread();
+}
+
 /*************/
 void Sink_Shmdata::handlePixels(const char* pixels, const ImageBufferSpec& spec)
 {
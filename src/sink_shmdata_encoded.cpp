@@ -18,11 +18,18 @@ Sink_Shmdata_Encoded::Sink_Shmdata_Encoded(RootObject* root)
     registerAttributes();
 
     av_register_all();
+
+    if (!_root)
+        return;
+
+    _encoderThread = thread([&]() { encoderLoop(); });
 }
 
 /*************/
 Sink_Shmdata_Encoded::~Sink_Shmdata_Encoded()
 {
+    stopHandlerThread();
+    stopEncoderThread();
     freeFFmpegObjects();
 }
 
@@ -88,11 +95,24 @@ bool Sink_Shmdata_Encoded::initFFmpegObjects(const ImageBufferSpec& spec)
     }
 
     _context->bit_rate = _bitRate;
+    // Keyframes are forced by the sink, unless the encoder proved to ignore them
+    _context->gop_size = _forcedKeyframesIgnored ? _keyframeInterval.load() : _maxGopSize;
+    _context->thread_count = _encoderThreads;
+    if (_encoderThreadType == "frame")
+        _context->thread_type = FF_THREAD_FRAME;
+    else if (_encoderThreadType == "slice")
+        _context->thread_type = FF_THREAD_SLICE;
+    else
+        _context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
     _context->width = spec.width;
     _context->height = spec.height;
     _context->time_base = (AVRational){1, static_cast<int>(_framerate)};
     _context->sample_aspect_ratio = (AVRational){static_cast<int>(spec.width), static_cast<int>(spec.height)};
-    _context->pix_fmt = AV_PIX_FMT_YUV420P;
+    _context->pix_fmt = getPixelFormat(spec);
+
+    // Some encoders, as NVENC ones, only turn forced keyframes into IDR frames if told to. This can still be overridden by the options
+    if (av_opt_find(_context->priv_data, "forced-idr", nullptr, 0, 0))
+        av_opt_set(_context->priv_data, "forced-idr", "1", 0);
 
     auto options = parseOptions(_options);
     for (auto& option : options)
@@ -104,11 +124,41 @@ bool Sink_Shmdata_Encoded::initFFmpegObjects(const ImageBufferSpec& spec)
         return false;
     }
 
+    // Frames given to the encoder are not reference counted, so that it copies them and they can be reused right away
+    unique_lock<mutex> lock(_encoderMutex);
+    for (uint32_t i = 0; i < _encoderQueueSize + 1; ++i)
+    {
+        auto frame = av_frame_alloc();
+        if (!frame)
+        {
+            Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Unable to allocate frame" << Log::endl;
+            return false;
+        }
+
+        _freeFrames.push_back(frame);
+        frame->format = _context->pix_fmt;
+        frame->width = spec.width;
+        frame->height = spec.height;
+        if (av_image_alloc(frame->data, frame->linesize, spec.width, spec.height, _context->pix_fmt, 32) < 0)
+        {
+            Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Unable to allocate raw YUV picture buffer" << Log::endl;
+            return false;
+        }
+    }
+    lock.unlock();
+
+    _framesSinceKeyframe = 0;
+    _packetsSinceKeyframe = 0;
+    _startTime = Timer::get().getTime();
+
+    // Planes converted on the GPU are copied as is
+    if (isPlanarYUV(spec))
+        return true;
+
     _swsContext = sws_getContext(spec.width, spec.height, AV_PIX_FMT_RGB32, spec.width, spec.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
 
     _frame = av_frame_alloc();
-    _yuvFrame = av_frame_alloc();
-    if (!_frame || !_yuvFrame)
+    if (!_frame)
     {
         Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Unable to allocate frame" << Log::endl;
         return false;
@@ -117,22 +167,7 @@ bool Sink_Shmdata_Encoded::initFFmpegObjects(const ImageBufferSpec& spec)
     _frame->format = AV_PIX_FMT_RGB32;
     _frame->width = spec.width;
     _frame->height = spec.height;
-    if (av_image_alloc(_frame->data, _frame->linesize, _context->width, _context->height, AV_PIX_FMT_RGB32, 32) < 0)
-    {
-        Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Unable to allocate raw RGBA picture buffer" << Log::endl;
-        return false;
-    }
 
-    _yuvFrame->format = AV_PIX_FMT_YUV420P;
-    _yuvFrame->width = spec.width;
-    _yuvFrame->height = spec.height;
-    if (av_image_alloc(_yuvFrame->data, _yuvFrame->linesize, _context->width, _context->height, AV_PIX_FMT_YUV420P, 32) < 0)
-    {
-        Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Unable to allocate raw YUV420 picture buffer" << Log::endl;
-        return false;
-    }
-
-    _startTime = Timer::get().getTime();
     return true;
 }
 
@@ -148,11 +183,37 @@ void Sink_Shmdata_Encoded::freeFFmpegObjects()
 
     if (_frame)
         av_frame_free(&_frame);
-    if (_yuvFrame)
-        av_frame_free(&_yuvFrame);
+
+    lock_guard<mutex> lock(_encoderMutex);
+    for (auto& encoderFrame : _encoderQueue)
+        _freeFrames.push_back(encoderFrame.frame);
+    _encoderQueue.clear();
+    for (auto& frame : _freeFrames)
+    {
+        av_freep(&frame->data[0]);
+        av_frame_free(&frame);
+    }
+    _freeFrames.clear();
 
     if (_swsContext)
+    {
         sws_freeContext(_swsContext);
+        _swsContext = nullptr;
+    }
+}
+
+/*************/
+AVPixelFormat Sink_Shmdata_Encoded::getPixelFormat(const ImageBufferSpec& spec)
+{
+    if (spec.format == "Y42B")
+        return AV_PIX_FMT_YUV422P;
+    return AV_PIX_FMT_YUV420P;
+}
+
+/*************/
+bool Sink_Shmdata_Encoded::isPlanarYUV(const ImageBufferSpec& spec)
+{
+    return spec.format == "I420" || spec.format == "Y42B";
 }
 
 /*************/
@@ -186,6 +247,110 @@ string Sink_Shmdata_Encoded::generateCaps(const ImageBufferSpec& spec, uint32_t
     return caps;
 }
 
+/*************/
+void Sink_Shmdata_Encoded::encodeFrame(AVFrame* frame)
+{
+    // Rate control is updated in place, encoders supporting it reconfigure themselves on the next frame
+    _context->bit_rate = _bitRate;
+
+    frame->quality = _context->global_quality;
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    if (_framesSinceKeyframe == 0 || _framesSinceKeyframe >= _keyframeInterval)
+    {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        _framesSinceKeyframe = 0;
+    }
+    ++_framesSinceKeyframe;
+
+    auto ret = avcodec_send_frame(_context, frame);
+    if (ret < 0)
+    {
+        Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Error encoding frame" << Log::endl;
+        return;
+    }
+
+    while (1)
+    {
+        av_init_packet(&_packet);
+        _packet.data = nullptr;
+        _packet.size = 0;
+
+        ret = avcodec_receive_packet(_context, &_packet);
+        if (ret == AVERROR(EAGAIN))
+            break;
+        else if (ret < 0)
+            return;
+
+        // Readers connecting late need keyframes to start decoding. If the encoder does not emit the forced ones, it is reset
+        // with a GOP size matching the keyframe interval
+        if (_packet.flags & AV_PKT_FLAG_KEY)
+        {
+            _packetsSinceKeyframe = 0;
+        }
+        else if (++_packetsSinceKeyframe > 2 * _keyframeInterval + _maxEncoderDelay && !_forcedKeyframesIgnored)
+        {
+            Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Encoder " << _codec->name
+                       << " ignores forced keyframes, falling back to a fixed keyframe interval" << Log::endl;
+            _forcedKeyframesIgnored = true;
+            _resetEncoding = true;
+        }
+
+        // Sending through shmdata
+        if (_writer && _packet.size != 0)
+            _writer->copy_to_shm(_packet.data, _packet.size);
+        av_packet_unref(&_packet);
+    }
+}
+
+/*************/
+void Sink_Shmdata_Encoded::encoderLoop()
+{
+    unique_lock<mutex> lock(_encoderMutex);
+    while (true)
+    {
+        _encoderCondition.wait(lock, [&]() { return !_encoderRunning || !_encoderQueue.empty(); });
+        if (!_encoderRunning)
+            return;
+
+        auto encoderFrame = _encoderQueue.front();
+        _encoderQueue.pop_front();
+        _encoding = true;
+
+        lock.unlock();
+        encodeFrame(encoderFrame.frame);
+        lock.lock();
+
+        _freeFrames.push_back(encoderFrame.frame);
+        _encoding = false;
+        _encodeLatency = Timer::getTime() - encoderFrame.queueTime;
+        _encoderCondition.notify_all();
+    }
+}
+
+/*************/
+void Sink_Shmdata_Encoded::flushEncoderQueue()
+{
+    unique_lock<mutex> lock(_encoderMutex);
+    _encodeDroppedFrames += _encoderQueue.size();
+    for (auto& encoderFrame : _encoderQueue)
+        _freeFrames.push_back(encoderFrame.frame);
+    _encoderQueue.clear();
+    _encoderCondition.wait(lock, [&]() { return !_encoding; });
+}
+
+/*************/
+void Sink_Shmdata_Encoded::stopEncoderThread()
+{
+    {
+        lock_guard<mutex> lock(_encoderMutex);
+        _encoderRunning = false;
+        _encoderCondition.notify_all();
+    }
+
+    if (_encoderThread.joinable())
+        _encoderThread.join();
+}
+
 /*************/
 void Sink_Shmdata_Encoded::handlePixels(const char* pixels, const ImageBufferSpec& spec)
 {
@@ -197,6 +362,9 @@ void Sink_Shmdata_Encoded::handlePixels(const char* pixels, const ImageBufferSpe
     {
         _resetEncoding = false;
 
+        // The encoder thread has to be idle while its objects are replaced
+        flushEncoderQueue();
+
         // Reset FFmpeg context and stuff
         freeFFmpegObjects();
         if (!initFFmpegObjects(spec))
@@ -211,37 +379,47 @@ void Sink_Shmdata_Encoded::handlePixels(const char* pixels, const ImageBufferSpe
         _previousFramerate = _framerate;
     }
 
-    // Encoding
-    av_init_packet(&_packet);
-    _packet.data = nullptr;
-    _packet.size = 0;
-
-    av_image_fill_arrays(_frame->data, _frame->linesize, reinterpret_cast<const uint8_t*>(pixels), AV_PIX_FMT_RGB32, spec.width, spec.height, 1);
-    sws_scale(_swsContext, _frame->data, _frame->linesize, 0, spec.height, _yuvFrame->data, _yuvFrame->linesize);
-
-    _yuvFrame->pts = (static_cast<double>((Timer::get().getTime() - _startTime)) / 1e3) / _framerate;
-    _yuvFrame->quality = _context->global_quality;
-    _yuvFrame->pict_type = AV_PICTURE_TYPE_NONE;
-
-    auto ret = avcodec_send_frame(_context, _yuvFrame);
-    if (ret < 0)
+    // If the encoder is late, a frame is dropped according to the drop policy
+    auto dropPolicy = getDropPolicy();
+    AVFrame* frame{nullptr};
     {
-        Log::get() << Log::WARNING << "Sink_Shmdata_Encoded::" << __FUNCTION__ << " - Error encoding frame" << Log::endl;
-        return;
+        lock_guard<mutex> lock(_encoderMutex);
+        if (!_freeFrames.empty())
+        {
+            frame = _freeFrames.back();
+            _freeFrames.pop_back();
+        }
+        else if (dropPolicy == DropPolicy::DropOldest && !_encoderQueue.empty())
+        {
+            frame = _encoderQueue.front().frame;
+            _encoderQueue.pop_front();
+            ++_encodeDroppedFrames;
+        }
+        else
+        {
+            ++_encodeDroppedFrames;
+            return;
+        }
     }
 
-    while (1)
+    if (isPlanarYUV(spec))
     {
-        ret = avcodec_receive_packet(_context, &_packet);
-        if (ret == AVERROR(EAGAIN))
-            break;
-        else if (ret < 0)
-            return;
-
-        // Sending through shmdata
-        if (_writer && _packet.size != 0)
-            _writer->copy_to_shm(_packet.data, _packet.size);
+        uint8_t* planes[4];
+        int linesizes[4];
+        av_image_fill_arrays(planes, linesizes, reinterpret_cast<const uint8_t*>(pixels), getPixelFormat(spec), spec.width, spec.height, 1);
+        av_image_copy(frame->data, frame->linesize, const_cast<const uint8_t**>(planes), linesizes, getPixelFormat(spec), spec.width, spec.height);
     }
+    else
+    {
+        av_image_fill_arrays(_frame->data, _frame->linesize, reinterpret_cast<const uint8_t*>(pixels), AV_PIX_FMT_RGB32, spec.width, spec.height, 1);
+        sws_scale(_swsContext, _frame->data, _frame->linesize, 0, spec.height, frame->data, frame->linesize);
+    }
+
+    frame->pts = (static_cast<double>((Timer::get().getTime() - _startTime)) / 1e3) / _framerate;
+
+    lock_guard<mutex> lock(_encoderMutex);
+    _encoderQueue.push_back({frame, Timer::getTime()});
+    _encoderCondition.notify_all();
 }
 
 /*************/
@@ -252,12 +430,88 @@ void Sink_Shmdata_Encoded::registerAttributes()
     addAttribute("bitrate",
         [&](const Values& args) {
             _bitRate = std::max(1000000, args[0].as<int>());
+            return true;
+        },
+        [&]() -> Values { return {_bitRate.load()}; },
+        {'n'});
+    setAttributeDescription("bitrate", "Output encoded video target bitrate. It is applied without resetting the encoder, if the encoder supports it");
+
+    addAttribute("keyframeInterval",
+        [&](const Values& args) {
+            _keyframeInterval = std::max(1, args[0].as<int>());
+            // Without forced keyframes, the interval is the GOP size of the encoder
+            if (_forcedKeyframesIgnored)
+                _resetEncoding = true;
+            return true;
+        },
+        [&]() -> Values { return {_keyframeInterval.load()}; },
+        {'n'});
+    setAttributeDescription("keyframeInterval", "Number of frames between two keyframes, applied without resetting the encoder if it supports forced keyframes");
+
+    addAttribute("encoderThreads",
+        [&](const Values& args) {
+            _encoderThreads = std::max(0, args[0].as<int>());
+            _resetEncoding = true;
+            return true;
+        },
+        [&]() -> Values { return {_encoderThreads}; },
+        {'n'});
+    setAttributeDescription("encoderThreads", "Number of threads used by the encoder, 0 letting it decide");
+
+    addAttribute("encoderThreadType",
+        [&](const Values& args) {
+            auto threadType = args[0].as<string>();
+            if (threadType != "auto" && threadType != "frame" && threadType != "slice")
+                return false;
+            _encoderThreadType = threadType;
+            _resetEncoding = true;
+            return true;
+        },
+        [&]() -> Values { return {_encoderThreadType}; },
+        {'s'});
+    setAttributeDescription("encoderThreadType",
+        "Threading used by the encoder: 'frame' for frame threads, which add latency, 'slice' for slice threads, or 'auto' to allow both");
+
+    addAttribute("encoderQueueSize",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_encoderMutex);
+            _encoderQueueSize = std::max(1, args[0].as<int>());
             _resetEncoding = true;
             return true;
         },
-        [&]() -> Values { return {_bitRate}; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_encoderMutex);
+            return {static_cast<int>(_encoderQueueSize)};
+        },
         {'n'});
-    setAttributeDescription("bitrate", "Output encoded video target bitrate");
+    setAttributeDescription("encoderQueueSize", "Maximum number of frames waiting to be encoded, frames being dropped according to the drop policy past it");
+
+    addAttribute("encodeLatency",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_encoderMutex);
+            return {static_cast<float>(_encodeLatency) / 1e3f};
+        });
+    setAttributeParameter("encodeLatency", false, true);
+    setAttributeDescription("encodeLatency", "Duration between the queueing of the last frame and the end of its encoding, in ms");
+
+    addAttribute("encodeQueueDepth",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_encoderMutex);
+            return {static_cast<int>(_encoderQueue.size())};
+        });
+    setAttributeParameter("encodeQueueDepth", false, true);
+    setAttributeDescription("encodeQueueDepth", "Number of frames waiting to be encoded");
+
+    addAttribute("encodeDroppedFrames",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_encoderMutex);
+            return {static_cast<int64_t>(_encodeDroppedFrames)};
+        });
+    setAttributeParameter("encodeDroppedFrames", false, true);
+    setAttributeDescription("encodeDroppedFrames", "Number of frames dropped since the sink creation because the encoder queue was full");
 
     addAttribute("caps", [&](const Values& args) { return true; }, [&]() -> Values { return {_caps}; });
     setAttributeDescription("caps", "Generated caps");
@@ -266,6 +520,7 @@ void Sink_Shmdata_Encoded::registerAttributes()
         [&](const Values& args) {
             _codecName = args[0].as<string>();
             transform(_codecName.begin(), _codecName.end(), _codecName.begin(), ::tolower);
+            _forcedKeyframesIgnored = false;
             _resetEncoding = true;
             return true;
         },
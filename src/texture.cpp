@@ -46,6 +46,27 @@ bool Texture::linkTo(const shared_ptr<BaseObject>& obj)
     return BaseObject::linkTo(obj);
 }
 
+/*************/
+void Texture::setSampledSize(int width, int height)
+{
+    lock_guard<mutex> lock(_sampledSizeMutex);
+    if (width <= 0 || height <= 0)
+        _sampledSize = glm::ivec2(0, 0);
+    else if (_sampledSize.x < 0 || _sampledSize.y < 0)
+        _sampledSize = glm::ivec2(width, height);
+    else if (_sampledSize.x != 0 && _sampledSize.y != 0)
+        _sampledSize = glm::min(_sampledSize, glm::ivec2(width, height));
+}
+
+/*************/
+glm::ivec2 Texture::consumeSampledSize()
+{
+    lock_guard<mutex> lock(_sampledSizeMutex);
+    auto sampledSize = _sampledSize;
+    _sampledSize = glm::ivec2(-1, -1);
+    return sampledSize;
+}
+
 /*************/
 void Texture::registerAttributes()
 {
@@ -0,0 +1,280 @@
+#include "./texture_atlas.h"
+
+#include <algorithm>
+
+#include "./log.h"
+#include "./timer.h"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+Texture_Atlas::Texture_Atlas(RootObject* root)
+    : Texture(root)
+{
+    init();
+}
+
+/*************/
+Texture_Atlas::~Texture_Atlas()
+{
+    if (!_root)
+        return;
+
+#ifdef DEBUG
+    Log::get() << Log::DEBUGGING << "Texture_Atlas::~Texture_Atlas - Destructor" << Log::endl;
+#endif
+    GlStateCache::get().forgetTexture(_glTex);
+    glDeleteTextures(1, &_glTex);
+}
+
+/*************/
+void Texture_Atlas::init()
+{
+    _type = "texture_atlas";
+    registerAttributes();
+
+    // This is used for getting documentation "offline"
+    if (!_root)
+        return;
+
+    _timestamp = Timer::getTime();
+}
+
+/*************/
+void Texture_Atlas::bind()
+{
+    _activeTexture = GlStateCache::get().getActiveTexture();
+    GlStateCache::get().bindTextureUnit(_activeTexture, _glTex);
+}
+
+/*************/
+void Texture_Atlas::unbind()
+{
+#ifdef DEBUG
+    GlStateCache::get().bindTextureUnit(_activeTexture, 0);
+#endif
+}
+
+/*************/
+int Texture_Atlas::getLayer(const string& name) const
+{
+    lock_guard<mutex> lock(_mutex);
+    for (size_t i = 0; i < _layers.size(); ++i)
+    {
+        auto image = _layers[i].image.lock();
+        if (image && image->getName() == name)
+            return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+/*************/
+bool Texture_Atlas::linkTo(const shared_ptr<BaseObject>& obj)
+{
+    // Mandatory before trying to link
+    if (!Texture::linkTo(obj))
+        return false;
+
+    auto img = dynamic_pointer_cast<Image>(obj);
+    if (!img)
+        return false;
+
+    // The first empty layer is reused, so that the other images keep their index
+    lock_guard<mutex> lock(_mutex);
+    auto layerIt = find_if(_layers.begin(), _layers.end(), [](const Layer& layer) { return layer.image.expired(); });
+    if (layerIt == _layers.end())
+        layerIt = _layers.insert(_layers.end(), Layer());
+
+    layerIt->image = img;
+    layerIt->timestamp = 0;
+    img->setDirty();
+
+    return true;
+}
+
+/*************/
+void Texture_Atlas::unlinkFrom(const shared_ptr<BaseObject>& obj)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto layerIt = find_if(_layers.begin(), _layers.end(), [&](const Layer& layer) { return layer.image.lock() == obj; });
+        if (layerIt != _layers.end())
+            *layerIt = Layer();
+    }
+
+    Texture::unlinkFrom(obj);
+}
+
+/*************/
+bool Texture_Atlas::allocate(const ImageBufferSpec& spec, int layerCount, bool srgb)
+{
+    if (spec.type != ImageBufferSpec::Type::UINT8)
+        return false;
+
+    if (spec.format == "RGB" || spec.format == "BGR")
+    {
+        _glChannelOrder = spec.format == "RGB" ? GL_RGB : GL_BGR;
+        _glDataFormat = GL_UNSIGNED_BYTE;
+    }
+    else if (spec.format == "RGBA" || spec.format == "BGRA")
+    {
+        _glChannelOrder = spec.format == "RGBA" ? GL_RGBA : GL_BGRA;
+        _glDataFormat = GL_UNSIGNED_INT_8_8_8_8_REV;
+    }
+    else
+    {
+        return false;
+    }
+
+    // glTextureStorage3D is immutable, so we have to delete the texture first
+    // This runs in the upload context, and the render context must not keep the deleted texture bound if the name is reused
+    GlStateCache::get().forgetTexture(_glTex);
+    glDeleteTextures(1, &_glTex);
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &_glTex);
+    GlStateCache::get().forgetTexture(_glTex);
+
+    glTextureParameteri(_glTex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(_glTex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (_filtering)
+    {
+        glTextureParameteri(_glTex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(_glTex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    else
+    {
+        glTextureParameteri(_glTex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(_glTex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glTextureStorage3D(_glTex, _filtering ? _texLevels : 1, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, spec.width, spec.height, layerCount);
+
+    _spec = spec;
+    _srgb = srgb;
+    _allocatedLayers = layerCount;
+    return true;
+}
+
+/*************/
+void Texture_Atlas::update()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    // Only the images which changed since the last upload are updated
+    vector<shared_ptr<Image>> images(_layers.size());
+    vector<bool> changedLayers(_layers.size(), false);
+    for (size_t i = 0; i < _layers.size(); ++i)
+    {
+        images[i] = _layers[i].image.lock();
+        if (!images[i] || images[i]->getTimestamp() == _layers[i].timestamp)
+            continue;
+
+        images[i]->update();
+        changedLayers[i] = true;
+    }
+
+    // All layers share the spec of the first image
+    auto firstImageIt = find_if(images.begin(), images.end(), [](const shared_ptr<Image>& image) { return image != nullptr; });
+    if (firstImageIt == images.end())
+        return;
+
+    auto spec = (*firstImageIt)->getSpec();
+    if (spec.width == 0 || spec.height == 0)
+        return;
+
+    Values srgb;
+    (*firstImageIt)->getAttribute("srgb", srgb);
+    bool isSrgb = srgb.empty() || srgb[0].as<int>() > 0;
+
+    bool reallocated = false;
+    if (spec != _spec || isSrgb != _srgb || static_cast<int>(_layers.size()) != _allocatedLayers || _glTex == 0)
+    {
+        if (!allocate(spec, static_cast<int>(_layers.size()), isSrgb))
+        {
+            if (!_specWarned)
+                Log::get() << Log::WARNING << "Texture_Atlas::" << __FUNCTION__ << " - Atlas " << _name << " only supports uncompressed RGB(A) 8bpc images, got " << spec.format
+                           << Log::endl;
+            _specWarned = true;
+            return;
+        }
+        reallocated = true;
+    }
+
+    // Rows of RGB images are not padded to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool updated = false;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        auto& image = images[i];
+        if (!image || (!changedLayers[i] && !reallocated))
+            continue;
+
+        if (image->getSpec() != _spec)
+        {
+            if (!_specWarned)
+                Log::get() << Log::WARNING << "Texture_Atlas::" << __FUNCTION__ << " - Image " << image->getName() << " does not match the spec of atlas " << _name
+                           << ", it will not be uploaded" << Log::endl;
+            _specWarned = true;
+            continue;
+        }
+
+        image->lockWrite();
+        glTextureSubImage3D(_glTex, 0, 0, 0, i, _spec.width, _spec.height, 1, _glChannelOrder, _glDataFormat, image->data());
+        image->unlockWrite();
+
+        _layers[i].timestamp = image->getTimestamp();
+        updated = true;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (!updated)
+        return;
+
+    if (_filtering)
+        glGenerateTextureMipmap(_glTex);
+
+    _timestamp = Timer::getTime();
+
+    _shaderUniforms["size"] = {static_cast<float>(_spec.width), static_cast<float>(_spec.height)};
+    _shaderUniforms["flip"] = {0};
+    _shaderUniforms["flop"] = {0};
+    _shaderUniforms["YCoCg"] = {0};
+    _shaderUniforms["YUV"] = {0};
+}
+
+/*************/
+void Texture_Atlas::registerAttributes()
+{
+    Texture::registerAttributes();
+
+    addAttribute("filtering",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_mutex);
+            _filtering = args[0].as<int>() > 0 ? true : false;
+            _allocatedLayers = 0; // Forces the storage to be recreated with the new levels
+            return true;
+        },
+        [&]() -> Values { return {_filtering}; },
+        {'n'});
+    setAttributeDescription("filtering", "Activate the mipmaps for this texture");
+
+    addAttribute("layers",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            lock_guard<mutex> lock(_mutex);
+            Values layers;
+            for (const auto& layer : _layers)
+            {
+                auto image = layer.image.lock();
+                layers.push_back(image ? image->getName() : "");
+            }
+            return layers;
+        });
+    setAttributeParameter("layers", false, true);
+    setAttributeDescription("layers", "Names of the images stored in the atlas, in layer order. Empty layers are reused by the next linked image");
+}
+
+} // end of namespace
@@ -37,6 +37,7 @@ Texture_Image::~Texture_Image()
 #ifdef DEBUG
     Log::get() << Log::DEBUGGING << "Texture_Image::~Texture_Image - Destructor" << Log::endl;
 #endif
+    GlStateCache::get().forgetTexture(_glTex);
     glDeleteTextures(1, &_glTex);
     glDeleteBuffers(2, _pbos);
 }
@@ -51,15 +52,20 @@ Texture_Image& Texture_Image::operator=(const shared_ptr<Image>& img)
 /*************/
 void Texture_Image::bind()
 {
-    glGetIntegerv(GL_ACTIVE_TEXTURE, &_activeTexture);
-    _activeTexture = _activeTexture - GL_TEXTURE0; // TODO: handle texture units in a modern fashion
-    glBindTextureUnit(_activeTexture, _glTex);
+    _activeTexture = GlStateCache::get().getActiveTexture(); // TODO: handle texture units in a modern fashion
+    GlStateCache::get().bindTextureUnit(_activeTexture, _glTex);
 }
 
 /*************/
 void Texture_Image::generateMipmap() const
 {
+    if (Timer::get().isDebug())
+        Timer::get() << "mipmap " + _name;
+
     glGenerateTextureMipmap(_glTex);
+
+    if (Timer::get().isDebug())
+        Timer::get() >> "mipmap " + _name;
 }
 
 /*************/
@@ -118,7 +124,24 @@ shared_ptr<Image> Texture_Image::read()
 }
 
 /*************/
-void Texture_Image::reset(int width, int height, const string& pixelFormat, const GLvoid* data, int multisample, bool cubemap)
+bool Texture_Image::updateMipmap()
+{
+    auto sampledSize = consumeSampledSize();
+
+    if (!_filtering)
+        return false;
+
+    // In auto mode, mipmaps are skipped only if every consumer is known to sample
+    // the texture at a size equal or larger than its own, i.e. no minification happens
+    if (_mipmapMode == MipmapMode::Auto && sampledSize.x > 0 && sampledSize.y > 0 && sampledSize.x >= _spec.width && sampledSize.y >= _spec.height)
+        return false;
+
+    generateMipmap();
+    return true;
+}
+
+/*************/
+void Texture_Image::reset(int width, int height, const string& pixelFormat, const GLvoid* data, int multisample, bool cubemap, int layers)
 {
     if (width == 0 || height == 0)
     {
@@ -135,6 +158,7 @@ void Texture_Image::reset(int width, int height, const string& pixelFormat, cons
     _pixelFormat = realPixelFormat;
     _multisample = multisample;
     _cubemap = multisample == 0 ? cubemap : false;
+    _layers = _cubemap ? 0 : layers;
 
     if (realPixelFormat == "RGBA")
     {
@@ -171,6 +195,13 @@ void Texture_Image::reset(int width, int height, const string& pixelFormat, cons
         _texFormat = GL_RED;
         _texType = GL_UNSIGNED_SHORT;
     }
+    else if (realPixelFormat == "RG32F")
+    {
+        _spec = ImageBufferSpec(width, height, 2, 64, ImageBufferSpec::Type::FLOAT, "RG");
+        _texInternalFormat = GL_RG32F;
+        _texFormat = GL_RG;
+        _texType = GL_FLOAT;
+    }
     else if (realPixelFormat == "YUYV" || realPixelFormat == "UYVY")
     {
         _spec = ImageBufferSpec(width, height, 3, 16, ImageBufferSpec::Type::UINT8, realPixelFormat);
@@ -188,14 +219,23 @@ void Texture_Image::reset(int width, int height, const string& pixelFormat, cons
 
     // Create and initialize the texture
     if (glIsTexture(_glTex))
+    {
+        GlStateCache::get().forgetTexture(_glTex);
         glDeleteTextures(1, &_glTex);
+    }
 
-    if (_multisample > 1)
+    if (_multisample > 1 && _layers > 0)
+        glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, 1, &_glTex);
+    else if (_multisample > 1)
         glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &_glTex);
     else if (_cubemap)
         glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &_glTex);
+    else if (_layers > 0)
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &_glTex);
     else
         glCreateTextures(GL_TEXTURE_2D, 1, &_glTex);
+    // The new name may be the one just deleted, which other contexts may still have bound
+    GlStateCache::get().forgetTexture(_glTex);
 
     if (_texInternalFormat == GL_DEPTH_COMPONENT)
     {
@@ -230,7 +270,11 @@ void Texture_Image::reset(int width, int height, const string& pixelFormat, cons
         glPixelStorei(GL_PACK_ALIGNMENT, 4);
     }
 
-    if (_multisample > 1)
+    if (_multisample > 1 && _layers > 0)
+    {
+        glTextureStorage3DMultisample(_glTex, _multisample, _texInternalFormat, width, height, _layers, false);
+    }
+    else if (_multisample > 1)
     {
         glTextureStorage2DMultisample(_glTex, _multisample, _texInternalFormat, width, height, false);
     }
@@ -238,6 +282,10 @@ void Texture_Image::reset(int width, int height, const string& pixelFormat, cons
     {
         glTextureStorage2D(_glTex, _texLevels, _texInternalFormat, width, height);
     }
+    else if (_layers > 0)
+    {
+        glTextureStorage3D(_glTex, _texLevels, _texInternalFormat, width, height, _layers);
+    }
     else
     {
         glTextureStorage2D(_glTex, _texLevels, _texInternalFormat, width, height);
@@ -256,14 +304,14 @@ void Texture_Image::resize(int width, int height)
     if (!_resizable)
         return;
     if (width != _spec.width || height != _spec.height)
-        reset(width, height, _pixelFormat, 0, _multisample, _cubemap);
+        reset(width, height, _pixelFormat, 0, _multisample, _cubemap, _layers);
 }
 
 /*************/
 void Texture_Image::unbind()
 {
 #ifdef DEBUG
-    glBindTextureUnit(_activeTexture, 0);
+    GlStateCache::get().bindTextureUnit(_activeTexture, 0);
 #endif
 }
 
@@ -312,6 +360,12 @@ void Texture_Image::update()
     img->update();
     _timestamp = img->getTimestamp();
 
+    // Damage can only be used if the texture holds the previous frame of the image
+    auto frameIndex = img->getFrameIndex();
+    vector<ImageRegion> damage;
+    bool hasDamage = frameIndex == _imageFrameIndex + 1 && img->getDamage(damage);
+    _imageFrameIndex = frameIndex;
+
     if (_multisample > 1)
     {
         Log::get() << Log::ERROR << "Texture_Image::" << __FUNCTION__ << " - Texture " << _name << " is multisampled, and can not be set from an image" << Log::endl;
@@ -417,8 +471,11 @@ void Texture_Image::update()
     if (spec != _spec || !spec.videoFrame)
     {
         // glTexStorage2D is immutable, so we have to delete the texture first
+        // This runs in the upload context, and the render context must not keep the deleted texture bound if the name is reused
+        GlStateCache::get().forgetTexture(_glTex);
         glDeleteTextures(1, &_glTex);
         glCreateTextures(GL_TEXTURE_2D, 1, &_glTex);
+        GlStateCache::get().forgetTexture(_glTex);
 
         glTextureParameteri(_glTex, GL_TEXTURE_WRAP_S, _glTextureWrap);
         glTextureParameteri(_glTex, GL_TEXTURE_WRAP_T, _glTextureWrap);
@@ -474,17 +531,62 @@ void Texture_Image::update()
         // And copy it to the second PBO
         glCopyNamedBufferSubData(_pbos[0], _pbos[1], 0, 0, imageDataSize);
         _spec = spec;
+        _pboUpToDate = true;
+        _textureBehindPbo = false;
+    }
+    // Only upload the regions which changed, if they are small enough compared to the whole image
+    else if (hasDamage && !isCompressed && spec.type == ImageBufferSpec::Type::UINT8 && (spec.channels == 3 || spec.channels == 4) &&
+             getDamageSize(damage) <= spec.width * spec.height / 2)
+    {
+        // The frame from the last full update may still be waiting in its PBO
+        if (_textureBehindPbo)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pboReadIndex]);
+            glTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, spec.width);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        img->lockWrite();
+        auto pixels = static_cast<const char*>(img->data());
+        for (const auto& region : damage)
+        {
+            auto regionPixels = pixels + (region.y * spec.width + region.x) * spec.pixelBytes();
+            glTextureSubImage2D(_glTex, 0, region.x, region.y, region.width, region.height, glChannelOrder, dataFormat, regionPixels);
+        }
+        img->unlockWrite();
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // The PBOs do not hold the current frame anymore
+        _pboUpToDate = false;
+        _textureBehindPbo = false;
     }
     // Update the content of the texture, i.e the image
     else
     {
-        // Copy the pixels from the current PBO to the texture
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pboReadIndex]);
-        if (!isCompressed)
-            glTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, 0);
+        // Copy the pixels from the current PBO to the texture, or directly from the image if the PBO is outdated
+        if (_pboUpToDate)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pboReadIndex]);
+            if (!isCompressed)
+                glTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, 0);
+            else
+                glCompressedTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, internalFormat, imageDataSize, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
         else
-            glCompressedTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, internalFormat, imageDataSize, 0);
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        {
+            img->lockWrite();
+            if (!isCompressed)
+                glTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, img->data());
+            else
+                glCompressedTextureSubImage2D(_glTex, 0, 0, 0, spec.width, spec.height, internalFormat, imageDataSize, img->data());
+            img->unlockWrite();
+        }
+        _pboUpToDate = true;
+        _textureBehindPbo = true;
 
         _pboReadIndex = (_pboReadIndex + 1) % 2;
 
@@ -524,8 +626,17 @@ void Texture_Image::update()
     _shaderUniforms["flop"] = flop;
     _shaderUniforms["size"] = {(float)_spec.width, (float)_spec.height};
 
-    if (_filtering && !isCompressed)
-        generateMipmap();
+    if (!isCompressed)
+        updateMipmap();
+}
+
+/*************/
+uint32_t Texture_Image::getDamageSize(const vector<ImageRegion>& damage)
+{
+    uint32_t size = 0;
+    for (const auto& region : damage)
+        size += region.width * region.height;
+    return size;
 }
 
 /*************/
@@ -578,6 +689,22 @@ void Texture_Image::registerAttributes()
         {'n'});
     setAttributeDescription("filtering", "Activate the mipmaps for this texture");
 
+    addAttribute("mipmap",
+        [&](const Values& args) {
+            auto mode = args[0].as<string>();
+            if (mode == "always")
+                _mipmapMode = MipmapMode::Always;
+            else if (mode == "auto")
+                _mipmapMode = MipmapMode::Auto;
+            else
+                return false;
+            return true;
+        },
+        [&]() -> Values { return {_mipmapMode == MipmapMode::Always ? "always" : "auto"}; },
+        {'s'});
+    setAttributeDescription("mipmap",
+        "Mipmap generation mode when filtering is active: 'always' regenerates them on every update, 'auto' skips them when the texture is known not to be minified");
+
     addAttribute("clampToEdge",
         [&](const Values& args) {
             _glTextureWrap = args[0].as<int>() ? GL_CLAMP_TO_EDGE : GL_REPEAT;
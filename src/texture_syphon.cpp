@@ -47,10 +47,10 @@ void Texture_Syphon::bind()
         _shaderUniforms.clear();
         _shaderUniforms["size"] = {(float)_syphonReceiver.getWidth(), (float)_syphonReceiver.getHeight()};
 
-        glGetIntegerv(GL_ACTIVE_TEXTURE, &_activeTexture);
+        _activeTexture = GlStateCache::get().getActiveTexture();
         auto frameId = _syphonReceiver.getFrame();
         if (frameId != -1)
-            glBindTexture(GL_TEXTURE_RECTANGLE, frameId);
+            GlStateCache::get().bindTextureUnit(_activeTexture, frameId);
     }
 }
 
@@ -60,8 +60,7 @@ void Texture_Syphon::unbind()
     if (_syphonReceiver.isConnected())
     {
 #ifdef DEBUG
-        glActiveTexture((GLenum)_activeTexture);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GlStateCache::get().bindTextureUnit(_activeTexture, 0);
 #endif
         _syphonReceiver.releaseFrame();
     }
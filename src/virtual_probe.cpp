@@ -1,5 +1,7 @@
 #include "./virtual_probe.h"
 
+#include <cmath>
+
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace std;
@@ -100,12 +102,13 @@ void VirtualProbe::render()
     if (!_fbo || !_outFbo)
         return;
 
-    glViewport(0, 0, _cubemapSize, _cubemapSize);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_MULTISAMPLE);
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    GlStateCache::get().viewport(0, 0, _cubemapSize, _cubemapSize);
+    GlStateCache::get().enable(GL_DEPTH_TEST);
+    GlStateCache::get().enable(GL_MULTISAMPLE);
+    GlStateCache::get().enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    // First pass: render to the cubemap
+    // First pass: render to the cubemap, all faces at once
+    auto faces = computeVisibleFaces();
     _fbo->bindDraw();
 
     glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -124,7 +127,9 @@ void VirtualProbe::render()
         else
             previousFill.clear();
 
+        obj->setTexturesSampledSize(0, 0);
         obj->activate();
+        obj->getShader()->setAttribute("uniform", {"_cubemapFaces", faces});
 
         obj->setViewProjectionMatrix(computeViewMatrix(), _faceProjectionMatrix);
         obj->draw();
@@ -137,9 +142,8 @@ void VirtualProbe::render()
 
     // Second pass: render the projected cubemap
     _outFbo->bindDraw();
-    _fbo->getColorTexture()->generateMipmap();
 
-    glViewport(0, 0, _width, _height);
+    GlStateCache::get().viewport(0, 0, _width, _height);
     glClearColor(1.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -151,9 +155,31 @@ void VirtualProbe::render()
     _screen->deactivate();
 
     _outFbo->unbindDraw();
-    glDisable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_MULTISAMPLE);
+    GlStateCache::get().disable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    GlStateCache::get().disable(GL_DEPTH_TEST);
+    GlStateCache::get().disable(GL_MULTISAMPLE);
+}
+
+/*************/
+int VirtualProbe::computeVisibleFaces() const
+{
+    const int allFaces = 0x3F;
+    if (!_skipHiddenFaces || _projectionType != Spherical)
+        return allFaces;
+
+    // The spherical projection covers a cone around +Z. The side faces are reached past 45 degrees from
+    // its axis, and the back face past the angle of the cube corners. A margin is kept for seamless filtering.
+    const float margin = 1.f;
+    const float sideFacesAngle = 45.f;
+    const float backFaceAngle = 180.f - glm::degrees(std::acos(1.f / std::sqrt(3.f)));
+    const float halfFov = _sphericalFov / 2.f + margin;
+
+    int faces = 1 << 4; // +Z
+    if (halfFov > sideFacesAngle)
+        faces |= 0xF; // +X, -X, +Y, -Y
+    if (halfFov > backFaceAngle)
+        faces |= 1 << 5; // -Z
+    return faces;
 }
 
 /*************/
@@ -280,6 +306,15 @@ void VirtualProbe::registerAttributes()
         {'n', 'n'});
     setAttributeDescription("size", "Set the render size");
 
+    addAttribute("skipHiddenFaces",
+        [&](const Values& args) {
+            _skipHiddenFaces = args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values { return {static_cast<int>(_skipHiddenFaces)}; },
+        {'n'});
+    setAttributeDescription("skipHiddenFaces", "If set to 1, the cubemap faces which are not seen by the spherical projection are not rendered");
+
     addAttribute("sphericalFov",
         [&](const Values& args) {
             auto value = args[0].as<float>();
@@ -79,10 +79,13 @@ bool Warp::linkTo(const std::shared_ptr<BaseObject>& obj)
     {
         auto camera = _inCamera.lock();
         if (camera)
-            _screen->removeTexture(camera->getTexture());
+            _warpedScreen->removeTexture(camera->getTexture());
 
+        // The input has to stay the first texture, the displacement map the second one
         camera = dynamic_pointer_cast<Camera>(obj);
-        _screen->addTexture(camera->getTexture());
+        _warpedScreen->removeTexture(_displacementFbo->getColorTexture());
+        _warpedScreen->addTexture(camera->getTexture());
+        _warpedScreen->addTexture(_displacementFbo->getColorTexture());
         _inCamera = camera;
 
         return true;
@@ -109,7 +112,7 @@ void Warp::unlinkFrom(const std::shared_ptr<BaseObject>& obj)
 
             if (inCamera == camera)
             {
-                _screen->removeTexture(camera->getTexture());
+                _warpedScreen->removeTexture(camera->getTexture());
                 if (camera->getName() == inCamera->getName())
                     _inCamera.reset();
             }
@@ -133,18 +136,25 @@ void Warp::render()
     {
         _outTextureSpec = inputSpec;
         _fbo->setSize(inputSpec.width, inputSpec.height);
+        _displacementFbo->setSize(inputSpec.width, inputSpec.height);
+        _displacementPatchUpdateCount = -1;
     }
 
+    // The mesh timestamp also changes when the control points are shown, so it can not be used here
+    if (static_cast<int64_t>(_screenMesh->getPatchUpdateCount()) != _displacementPatchUpdateCount)
+        bakeDisplacementMap();
+
     _fbo->bindDraw();
-    glEnable(GL_FRAMEBUFFER_SRGB);
-    glViewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
+    GlStateCache::get().enable(GL_FRAMEBUFFER_SRGB);
+    GlStateCache::get().viewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
 
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    _screen->activate();
-    _screen->draw();
-    _screen->deactivate();
+    _warpedScreen->setTexturesSampledSize(_outTextureSpec.width, _outTextureSpec.height);
+    _warpedScreen->activate();
+    _warpedScreen->draw();
+    _warpedScreen->deactivate();
 
     if (_showControlPoints)
     {
@@ -155,7 +165,7 @@ void Warp::render()
         _screen->draw();
         _screen->deactivate();
 
-        _screen->setAttribute("fill", {"warp"});
+        _screen->setAttribute("fill", {"warp", "WARP_BAKE"});
         _screenMesh->switchMeshes(false);
 
         if (_selectedControlPointIndex != -1)
@@ -175,10 +185,29 @@ void Warp::render()
         }
     }
 
-    glDisable(GL_FRAMEBUFFER_SRGB);
+    GlStateCache::get().disable(GL_FRAMEBUFFER_SRGB);
     _fbo->unbindDraw();
 
-    _fbo->getColorTexture()->generateMipmap();
+    _fbo->getColorTexture()->updateMipmap();
+}
+
+/*************/
+void Warp::bakeDisplacementMap()
+{
+    // Read before drawing, so that a patch modified meanwhile is baked again
+    _displacementPatchUpdateCount = static_cast<int64_t>(_screenMesh->getPatchUpdateCount());
+
+    _displacementFbo->bindDraw();
+    GlStateCache::get().viewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
+
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    _screen->activate();
+    _screen->draw();
+    _screen->deactivate();
+
+    _displacementFbo->unbindDraw();
 }
 
 /*************/
@@ -259,13 +288,22 @@ void Warp::setupFBO()
     _fbo = make_unique<Framebuffer>(_root);
     _fbo->setParameters(0, false, true /* srgb */);
 
-    // Setup the virtual screen
+    // Source coordinates need more than 8bpc to address every input pixel
+    _displacementFbo = make_unique<Framebuffer>(_root);
+    _displacementFbo->setParameters(0, true /* sixteenbpc */);
+
+    // Setup the virtual screen, only rendered to bake the displacement map
     _screen = make_shared<Object>(_root);
-    _screen->setAttribute("fill", {"warp"});
+    _screen->setAttribute("fill", {"warp", "WARP_BAKE"});
     auto virtualScreen = make_shared<Geometry>(_root);
     _screenMesh = make_shared<Mesh_BezierPatch>(_root);
     virtualScreen->linkTo(_screenMesh);
     _screen->addGeometry(virtualScreen);
+
+    // The default geometry covers the whole output
+    _warpedScreen = make_shared<Object>(_root);
+    _warpedScreen->setAttribute("fill", {"warp", "WARP_MAP"});
+    _warpedScreen->addGeometry(make_shared<Geometry>(_root));
 }
 
 /*************/
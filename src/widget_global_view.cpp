@@ -164,6 +164,7 @@ void GuiGlobalView::render()
                 _noMove = false;
 
             processKeyEvents();
+            processPickingResults();
             processMouseEvents();
         }
         ImGui::EndChild();
@@ -508,6 +509,39 @@ void GuiGlobalView::processKeyEvents()
     }
 }
 
+/*************/
+void GuiGlobalView::processPickingResults()
+{
+    if (_calibrationPointPicking && _calibrationPointPicking->ready)
+    {
+        auto& position = _calibrationPointPicking->position;
+        if (position.size() == 3)
+        {
+            setObjectAttribute(_calibrationPointPicking->cameraName, "addCalibrationPoint", {position[0], position[1], position[2]});
+            _previousPointAdded = position;
+        }
+        else
+        {
+            setObjectAttribute(_calibrationPointPicking->cameraName, "deselectCalibrationPoint", {});
+        }
+        _calibrationPointPicking.reset();
+    }
+
+    if (_targetPicking && _targetPicking->ready)
+    {
+        // The target is only relevant to the camera it was picked from
+        if (_camera && _camera->getName() == _targetPicking->cameraName)
+        {
+            _newTarget = _targetPicking->position;
+            if (_targetPicking->depth == 0.f)
+                _newTargetDistance = 1.f;
+            else
+                _newTargetDistance = -_targetPicking->depth * 0.1f;
+        }
+        _targetPicking.reset();
+    }
+}
+
 /*************/
 void GuiGlobalView::processMouseEvents()
 {
@@ -534,16 +568,15 @@ void GuiGlobalView::processMouseEvents()
             }
             else if (io.KeyShift) // Define the screenpoint corresponding to the selected calibration point
                 setObjectAttribute(_camera->getName(), "setCalibrationPoint", {mousePos.x * 2.f - 1.f, mousePos.y * 2.f - 1.f});
-            else if (io.MouseClicked[0]) // Add a new calibration point
+            else if (io.MouseClicked[0]) // Add a new calibration point, once the picked point is available
             {
-                Values position = _camera->pickVertexOrCalibrationPoint(mousePos.x, mousePos.y);
-                if (position.size() == 3)
-                {
-                    setObjectAttribute(_camera->getName(), "addCalibrationPoint", {position[0], position[1], position[2]});
-                    _previousPointAdded = position;
-                }
-                else
-                    setObjectAttribute(_camera->getName(), "deselectCalibrationPoint", {});
+                auto picking = make_shared<PickingResult>();
+                picking->cameraName = _camera->getName();
+                _calibrationPointPicking = picking;
+                _camera->pickVertexOrCalibrationPointAsync(mousePos.x, mousePos.y, [picking](const Values& position) {
+                    picking->position = position;
+                    picking->ready = true;
+                });
             }
             return;
         }
@@ -551,13 +584,17 @@ void GuiGlobalView::processMouseEvents()
         // Calibration point set
         if (io.MouseClicked[1])
         {
-            float fragDepth = 0.f;
-            _newTarget = _camera->pickFragment(mousePos.x, mousePos.y, fragDepth);
-
-            if (fragDepth == 0.f)
-                _newTargetDistance = 1.f;
-            else
-                _newTargetDistance = -fragDepth * 0.1f;
+            _newTarget = Values();
+            _newTargetDistance = 1.f;
+
+            auto picking = make_shared<PickingResult>();
+            picking->cameraName = _camera->getName();
+            _targetPicking = picking;
+            _camera->pickFragmentAsync(mousePos.x, mousePos.y, [picking](const Values& position, float depth) {
+                picking->position = position;
+                picking->depth = depth;
+                picking->ready = true;
+            });
         }
 
         if (io.MouseWheel != 0)
@@ -81,6 +81,8 @@ Window::~Window()
     Log::get() << Log::DEBUGGING << "Window::~Window - Destructor" << Log::endl;
 #endif
 
+    GlStateCache::get().forgetFramebuffer(_renderFbo);
+    GlStateCache::get().forgetFramebuffer(_readFbo);
     glDeleteFramebuffers(1, &_renderFbo);
     glDeleteFramebuffers(1, &_readFbo);
 }
@@ -302,20 +304,30 @@ void Window::render()
     }
 
     glfwGetFramebufferSize(_window->get(), &w, &h);
-    glViewport(0, 0, w, h);
+    GlStateCache::get().viewport(0, 0, w, h);
 
 #ifdef DEBUG
     glGetError();
 #endif
 
-    glEnable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
+    GlStateCache::get().enable(GL_BLEND);
+    GlStateCache::get().disable(GL_DEPTH_TEST);
     glBlendEquation(GL_FUNC_ADD);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _renderFbo);
+    // Check whether all input textures are displayed full window
+    bool resize = true;
+    for (int i = 0; i < _inTextures.size(); ++i)
+    {
+        int value = _layout[i].as<int>();
+        for (int j = i + 1; j < _inTextures.size(); ++j)
+            if (_layout[j].as<int>() != value)
+                resize = false;
+    }
+
+    GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _renderFbo);
     if (_srgb)
-        glEnable(GL_FRAMEBUFFER_SRGB);
+        GlStateCache::get().enable(GL_FRAMEBUFFER_SRGB);
 
     // If we are in synchronization testing mode
     if (_swapSynchronizationTesting)
@@ -333,6 +345,10 @@ void Window::render()
         layout.push_front("layout");
         _screen->getShader()->setAttribute("uniform", layout);
         _screen->getShader()->setAttribute("uniform", {"_gamma", (float)_srgb, _gammaCorrection});
+        if (resize)
+            _screen->setTexturesSampledSize(w, h);
+        else
+            _screen->setTexturesSampledSize(0, 0);
         _screen->activate();
         _screen->draw();
         _screen->deactivate();
@@ -352,14 +368,6 @@ void Window::render()
     // Resize the input textures accordingly to the window size.
     // This goes upstream to the cameras and gui
     // Textures are resized to the number of "frame" there are, according to the layout
-    bool resize = true;
-    for (int i = 0; i < _inTextures.size(); ++i)
-    {
-        int value = _layout[i].as<int>();
-        for (int j = i + 1; j < _inTextures.size(); ++j)
-            if (_layout[j].as<int>() != value)
-                resize = false;
-    }
     if (resize) // We don't do this if we are directly connected to a Texture (updated from an image)
     {
         for (auto& t : _inTextures)
@@ -378,9 +386,9 @@ void Window::render()
         Log::get() << Log::WARNING << _type << "::" << __FUNCTION__ << " - Error while rendering the window: " << error << Log::endl;
 #endif
 
-    glDisable(GL_BLEND);
-    glDisable(GL_FRAMEBUFFER_SRGB);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GlStateCache::get().disable(GL_BLEND);
+    GlStateCache::get().disable(GL_FRAMEBUFFER_SRGB);
+    GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
     return;
 }
@@ -411,14 +419,17 @@ void Window::setupFBOs()
     else
         Log::get() << Log::DEBUGGING << "Window::" << __FUNCTION__ << " - Render framebuffer object successfully initialized" << Log::endl;
 
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _renderFbo);
+    GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _renderFbo);
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GlStateCache::get().bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
     // Read FBO
     if (_readFbo != 0)
+    {
+        GlStateCache::get().forgetFramebuffer(_readFbo);
         glDeleteFramebuffers(1, &_readFbo);
+    }
 
     glCreateFramebuffers(1, &_readFbo);
 
@@ -0,0 +1,30 @@
+#include <chrono>
+#include <memory>
+
+#include <doctest.h>
+
+#include "./mesh_bezierPatch.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+TEST_CASE("Benchmarking Bezier patch evaluation")
+{
+    auto patch = make_shared<Mesh_BezierPatch>(nullptr);
+    patch->setAttribute("patchSize", {10, 10});
+
+    for (auto resolution : {64, 256, 512})
+    {
+        const int iterations = 10;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            // Setting the resolution forces the patch to be evaluated again
+            patch->setAttribute("patchResolution", {resolution});
+            patch->update();
+        }
+        auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / iterations;
+        MESSAGE("Bezier patch 10x10 at resolution " << resolution << ": " << duration << "us");
+    }
+}
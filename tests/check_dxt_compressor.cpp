@@ -0,0 +1,140 @@
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <doctest.h>
+
+#include "./dxt_compressor.h"
+
+using namespace std;
+using namespace Splash;
+
+namespace
+{
+/*************/
+ImageBuffer createImage(unsigned int width, unsigned int height, const function<void(unsigned int, unsigned int, uint8_t*)>& setPixel)
+{
+    auto image = ImageBuffer(ImageBufferSpec(width, height, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA"));
+    auto pixels = reinterpret_cast<uint8_t*>(image.data());
+    for (unsigned int y = 0; y < height; ++y)
+        for (unsigned int x = 0; x < width; ++x)
+            setPixel(x, y, pixels + (y * width + x) * 4);
+    return image;
+}
+
+/*************/
+vector<uint8_t> getBytes(const ImageBuffer& image)
+{
+    auto data = reinterpret_cast<const uint8_t*>(image.data());
+    return vector<uint8_t>(data, data + image.getSize());
+}
+
+/*************/
+void setSolidRed(unsigned int, unsigned int, uint8_t* pixel)
+{
+    pixel[0] = 255;
+    pixel[1] = 0;
+    pixel[2] = 0;
+    pixel[3] = 255;
+}
+
+/*************/
+void setGrayGradient(unsigned int x, unsigned int, uint8_t* pixel)
+{
+    for (int c = 0; c < 4; ++c)
+        pixel[c] = static_cast<uint8_t>(x * 85);
+}
+} // namespace
+
+/*************/
+TEST_CASE("Testing DxtCompressor supported inputs")
+{
+    CHECK(DxtCompressor::isSupported(ImageBufferSpec(16, 8, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA")));
+    CHECK(DxtCompressor::isSupported(ImageBufferSpec(16, 8, 4, 32, ImageBufferSpec::Type::UINT8, "BGRA")));
+    CHECK(DxtCompressor::isSupported(ImageBufferSpec(16, 8, 3, 24, ImageBufferSpec::Type::UINT8, "RGB")));
+    CHECK(DxtCompressor::isSupported(ImageBufferSpec(16, 8, 3, 16, ImageBufferSpec::Type::UINT8, "UYVY")));
+    CHECK(!DxtCompressor::isSupported(ImageBufferSpec(18, 8, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA")));
+    CHECK(!DxtCompressor::isSupported(ImageBufferSpec(16, 6, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA")));
+    CHECK(!DxtCompressor::isSupported(ImageBufferSpec(16, 8, 4, 64, ImageBufferSpec::Type::UINT16, "RGBA")));
+    CHECK(!DxtCompressor::isSupported(ImageBufferSpec(16, 8, 1, 8, ImageBufferSpec::Type::UINT8, "R")));
+
+    CHECK(DxtCompressor::getFormatName(DxtCompressor::Format::RGB_DXT1) == "RGB_DXT1");
+    CHECK(DxtCompressor::getFormatName(DxtCompressor::Format::RGBA_DXT5) == "RGBA_DXT5");
+    CHECK(DxtCompressor::getFormatName(DxtCompressor::Format::YCoCg_DXT5) == "YCoCg_DXT5");
+}
+
+/*************/
+TEST_CASE("Testing DxtCompressor with a solid block")
+{
+    // Pure red is exactly represented in RGB565, so both endpoints are equal and all indices are 0
+    auto input = createImage(4, 4, setSolidRed);
+    ImageBuffer output;
+
+    for (auto quality : {DxtCompressor::Quality::Fast, DxtCompressor::Quality::High})
+    {
+        REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGB_DXT1, quality));
+        CHECK(output.getSpec().format == "RGB_DXT1");
+        CHECK(getBytes(output) == vector<uint8_t>({0x00, 0xF8, 0x00, 0xF8, 0x00, 0x00, 0x00, 0x00}));
+
+        REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGBA_DXT5, quality));
+        CHECK(output.getSpec().format == "RGBA_DXT5");
+        CHECK(getBytes(output) == vector<uint8_t>({0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0x00, 0xF8, 0x00, 0x00, 0x00, 0x00}));
+    }
+
+    // Every block of a larger image, spread over the worker threads, gives the same output
+    input = createImage(64, 64, setSolidRed);
+    REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGB_DXT1, DxtCompressor::Quality::Fast));
+    auto bytes = getBytes(output);
+    REQUIRE(bytes.size() == 16 * 16 * 8);
+    bool allBlocksEqual = true;
+    for (size_t i = 0; i < bytes.size(); ++i)
+        allBlocksEqual &= bytes[i] == bytes[i % 8];
+    CHECK(allBlocksEqual);
+}
+
+/*************/
+TEST_CASE("Testing DxtCompressor with a gradient block")
+{
+    // Columns go through 0, 85, 170 and 255, which matches the four DXT1 colors between black and white,
+    // in the index order color0 (white), color1 (black), 2/3 color0 and 1/3 color0
+    auto input = createImage(4, 4, setGrayGradient);
+    ImageBuffer output;
+
+    REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGB_DXT1, DxtCompressor::Quality::Fast));
+    CHECK(getBytes(output) == vector<uint8_t>({0xFF, 0xFF, 0x00, 0x00, 0x2D, 0x2D, 0x2D, 0x2D}));
+
+    // Alpha uses the eight values mode, each column being mapped to the closest of the interpolated values
+    REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGBA_DXT5, DxtCompressor::Quality::Fast));
+    CHECK(getBytes(output) == vector<uint8_t>({0xFF, 0x00, 0xF1, 0x10, 0x0F, 0xF1, 0x10, 0x0F, 0xFF, 0xFF, 0x00, 0x00, 0x2D, 0x2D, 0x2D, 0x2D}));
+
+    // High quality insets the endpoints by 1/16th of the range
+    REQUIRE(DxtCompressor::compress(input, output, DxtCompressor::Format::RGB_DXT1, DxtCompressor::Quality::High));
+    auto bytes = getBytes(output);
+    CHECK(bytes == vector<uint8_t>({0x9E, 0xF7, 0x61, 0x08, 0x2D, 0x2D, 0x2D, 0x2D}));
+
+    // Decoding the block gives back the gradient, up to the RGB565 and inset precision
+    auto decode565 = [](uint16_t value, int* color) {
+        int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    };
+    int palette[4][3];
+    decode565(bytes[0] | (bytes[1] << 8), palette[0]);
+    decode565(bytes[2] | (bytes[3] << 8), palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    int maxError = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int index = (bytes[4 + i / 4] >> (2 * (i % 4))) & 3;
+        for (int c = 0; c < 3; ++c)
+            maxError = max(maxError, abs(palette[index][c] - (i % 4) * 85));
+    }
+    CHECK(maxError <= 16);
+}
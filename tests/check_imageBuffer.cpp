@@ -0,0 +1,110 @@
+#include <doctest.h>
+
+#include "./splash.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+TEST_CASE("Testing ImageBuffer damage")
+{
+    auto buffer = ImageBuffer(ImageBufferSpec(256, 128, 4, 32));
+    vector<ImageRegion> damage;
+
+    // By default, the whole image is considered as changed
+    CHECK(buffer.getDamage(damage) == false);
+
+    ImageRegion region;
+    region.x = 200;
+    region.y = 100;
+    region.width = 100;
+    region.height = 100;
+    buffer.setDamage({region});
+    CHECK(buffer.getDamage(damage) == true);
+    REQUIRE(damage.size() == 1);
+    CHECK(damage[0].width == 56);
+    CHECK(damage[0].height == 28);
+
+    // No damage means that nothing changed
+    buffer.setDamage({});
+    CHECK(buffer.getDamage(damage) == true);
+    CHECK(damage.empty());
+
+    buffer.resetDamage();
+    CHECK(buffer.getDamage(damage) == false);
+}
+
+/*************/
+TEST_CASE("Testing ImageBuffer damage merge")
+{
+    auto spec = ImageBufferSpec(256, 128, 4, 32);
+    auto previous = ImageBuffer(spec);
+    auto current = ImageBuffer(spec);
+    vector<ImageRegion> damage;
+
+    ImageRegion region;
+    region.width = 16;
+    region.height = 16;
+    previous.setDamage({region});
+    region.x = 64;
+    current.setDamage({region});
+
+    current.mergeDamage(previous);
+    CHECK(current.getDamage(damage) == true);
+    CHECK(damage.size() == 2);
+
+    // Merging with a fully changed frame gives a fully changed frame
+    previous.resetDamage();
+    current.mergeDamage(previous);
+    CHECK(current.getDamage(damage) == false);
+
+    // Too many regions are merged into their bounding box
+    damage.clear();
+    for (uint32_t i = 0; i < 128; ++i)
+    {
+        region.x = i * 2;
+        region.y = i;
+        region.width = 1;
+        region.height = 1;
+        damage.push_back(region);
+    }
+    current.setDamage(damage);
+    CHECK(current.getDamage(damage) == true);
+    REQUIRE(damage.size() == 1);
+    CHECK(damage[0].x == 0);
+    CHECK(damage[0].y == 0);
+    CHECK(damage[0].width == 255);
+    CHECK(damage[0].height == 128);
+}
+
+/*************/
+TEST_CASE("Testing ImageRegion merge")
+{
+    vector<ImageRegion> regions;
+
+    ImageRegion region;
+    region.width = 32;
+    region.height = 32;
+    ImageBuffer::mergeRegions(regions, {region});
+    CHECK(regions.size() == 1);
+
+    // Regions already covered are skipped, and covered regions are replaced
+    ImageRegion inner;
+    inner.x = 8;
+    inner.y = 8;
+    inner.width = 8;
+    inner.height = 8;
+    ImageBuffer::mergeRegions(regions, {inner, region});
+    CHECK(regions.size() == 1);
+
+    ImageRegion outer;
+    outer.width = 64;
+    outer.height = 64;
+    ImageBuffer::mergeRegions(regions, {outer});
+    REQUIRE(regions.size() == 1);
+    CHECK(regions[0].width == 64);
+
+    region.x = 64;
+    ImageBuffer::mergeRegions(regions, {region});
+    CHECK(regions.size() == 2);
+}
@@ -0,0 +1,32 @@
+#include <cmath>
+#include <memory>
+
+#include <doctest.h>
+
+#include "./mesh_bezierPatch.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+TEST_CASE("Testing Bezier patch evaluation")
+{
+    auto patch = make_shared<Mesh_BezierPatch>(nullptr);
+    patch->setAttribute("patchSize", {10, 10});
+    patch->setAttribute("patchResolution", {32});
+    patch->update();
+
+    // Evenly spaced control points give back the identity
+    auto vertices = patch->getVertCoords();
+    auto uvs = patch->getUVCoords();
+    REQUIRE(vertices.size() == 31 * 31 * 6 * 4);
+    REQUIRE(uvs.size() == 31 * 31 * 6 * 2);
+
+    bool isIdentity = true;
+    for (size_t i = 0; i < uvs.size() / 2; ++i)
+    {
+        isIdentity &= abs(vertices[i * 4] - (uvs[i * 2] * 2.f - 1.f)) < 1e-4f;
+        isIdentity &= abs(vertices[i * 4 + 1] - (uvs[i * 2 + 1] * 2.f - 1.f)) < 1e-4f;
+    }
+    CHECK(isIdentity);
+}